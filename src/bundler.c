@@ -6,6 +6,21 @@
 #include <string.h>
 #include <unistd.h>
 
+// both are header only, from raylib's external folder
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+#define SDEFL_IMPLEMENTATION
+#include "sdefl.h"
+
+// for the font size and the codepoints to bake
+#include "immy/config.h"
+
+#define FONT_FILE_PATH "../resources/fonts/unifont-15.1.04.otf"
+
+// must match the atlas in immy/ui/text.c, it ignores the baked atlas otherwise
+#define ATLAS_WIDTH 1024
+#define GLYPH_PADDING 2
+
 #define genf(out, ...)                                                         \
     do {                                                                       \
         fprintf((out), __VA_ARGS__);                                           \
@@ -24,11 +39,13 @@ typedef struct {
 } Resource;
 
 Resource resources[] = {
-    {.file_path = "../resources/fonts/unifont-15.1.04.otf"},
+    {.file_path = FONT_FILE_PATH},
 };
 
 #define RESOURCES_COUNT (sizeof(resources) / sizeof(resources[0]))
 
+#define LINE_BYTE_COUNT 48
+
 size_t fsize(FILE* f) {
 
     fseek(f, 0, SEEK_END);
@@ -40,6 +57,244 @@ size_t fsize(FILE* f) {
     return size;
 }
 
+unsigned char* read_file(const char* path, size_t* size) {
+
+    FILE* f = fopen(path, "rb");
+
+    if (!f) {
+
+        fprintf(stderr, "Could not read %s: %s", path, strerror(errno));
+
+        exit(1);
+    }
+
+    *size = fsize(f);
+
+    unsigned char* data = malloc(*size);
+
+    if (!data || fread(data, 1, *size, f) != *size) {
+
+        fprintf(stderr, "Could not read %s: %s", path, strerror(errno));
+
+        exit(1);
+    }
+
+    fclose(f);
+
+    return data;
+}
+
+// decodes the next utf-8 codepoint, invalid bytes are skipped
+int next_codepoint(const unsigned char** p) {
+
+    const unsigned char* s = *p;
+
+    int cp;
+    int n;
+
+    if (s[0] < 0x80) {
+        cp = s[0];
+        n  = 1;
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F;
+        n  = 2;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F;
+        n  = 3;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07;
+        n  = 4;
+    } else {
+        *p += 1;
+        return -1;
+    }
+
+    for (int i = 1; i < n; i++) {
+
+        if ((s[i] & 0xC0) != 0x80) {
+            *p += i;
+            return -1;
+        }
+
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    *p += n;
+
+    return cp;
+}
+
+// Rasterizes CODEPOINT_BAKED at UNIFONT_SIZE the same way raylib's
+// LoadFontData does, and packs the glyphs in rows like immy/ui/text.c.
+// The coverage is deflated, the metrics are written as they are.
+void generate_font_atlas(FILE* out) {
+
+    size_t font_size = 0;
+    unsigned char* font = read_file(FONT_FILE_PATH, &font_size);
+
+    stbtt_fontinfo info;
+
+    if (!stbtt_InitFont(&info, font, 0)) {
+
+        fprintf(stderr, "Could not parse the font %s", FONT_FILE_PATH);
+
+        exit(1);
+    }
+
+    float scale = stbtt_ScaleForPixelHeight(&info, UNIFONT_SIZE);
+
+    int ascent, descent, line_gap;
+
+    stbtt_GetFontVMetrics(&info, &ascent, &descent, &line_gap);
+
+    const unsigned char* text = (const unsigned char*)CODEPOINT_BAKED;
+
+    size_t max_glyphs = strlen(CODEPOINT_BAKED);
+    size_t glyph_count = 0;
+
+    // codepoint, x, y, width, height, offsetX, offsetY, advanceX
+    int* glyphs = malloc(max_glyphs * 8 * sizeof(int));
+
+    int height = 0;
+    unsigned char* atlas = NULL;
+
+    int shelf_x = 0;
+    int shelf_y = 0;
+    int shelf_h = 0;
+
+    while (*text) {
+
+        int cp = next_codepoint(&text);
+
+        if (cp < 0)
+            continue;
+
+        bool seen = false;
+
+        for (size_t i = 0; i < glyph_count && !seen; i++)
+            seen = glyphs[i * 8] == cp;
+
+        if (seen)
+            continue;
+
+        int w, h, offset_x, offset_y, advance;
+
+        unsigned char* bitmap = stbtt_GetCodepointBitmap(
+            &info, scale, scale, cp, &w, &h, &offset_x, &offset_y);
+
+        stbtt_GetCodepointHMetrics(&info, cp, &advance, NULL);
+
+        advance = (int)((float)advance * scale);
+        offset_y += (int)((float)ascent * scale);
+
+        // raylib gives the space an empty image of advance x font size
+        if (cp == ' ') {
+            free(bitmap);
+            bitmap = calloc((size_t)advance * UNIFONT_SIZE, 1);
+            w = advance;
+            h = UNIFONT_SIZE;
+        }
+
+        int pw = w + GLYPH_PADDING * 2;
+        int ph = h + GLYPH_PADDING * 2;
+
+        if (pw > ATLAS_WIDTH) {
+
+            fprintf(stderr, "Glyph %d is too wide for the atlas", cp);
+
+            exit(1);
+        }
+
+        if (shelf_x + pw > ATLAS_WIDTH) {
+            shelf_y += shelf_h;
+            shelf_x = 0;
+            shelf_h = 0;
+        }
+
+        if (shelf_y + ph > height) {
+
+            int grown = shelf_y + ph;
+
+            atlas = realloc(atlas, (size_t)ATLAS_WIDTH * grown);
+
+            memset(atlas + (size_t)ATLAS_WIDTH * height, 0,
+                   (size_t)ATLAS_WIDTH * (grown - height));
+
+            height = grown;
+        }
+
+        int x = shelf_x + GLYPH_PADDING;
+        int y = shelf_y + GLYPH_PADDING;
+
+        for (int gy = 0; gy < h; gy++) {
+            memcpy(atlas + (size_t)(y + gy) * ATLAS_WIDTH + x,
+                   bitmap + (size_t)gy * w, w);
+        }
+
+        free(bitmap);
+
+        shelf_x += pw;
+        shelf_h = shelf_h > ph ? shelf_h : ph;
+
+        int* g = glyphs + glyph_count++ * 8;
+
+        g[0] = cp;
+        g[1] = x;
+        g[2] = y;
+        g[3] = w;
+        g[4] = h;
+        g[5] = offset_x;
+        g[6] = offset_y;
+        g[7] = advance;
+    }
+
+    size_t atlas_size = (size_t)ATLAS_WIDTH * height;
+
+    struct sdefl* deflate = calloc(1, sizeof(struct sdefl));
+    unsigned char* packed = malloc(sdefl_bound((int)atlas_size));
+
+    int packed_size =
+        sdeflate(deflate, packed, atlas, (int)atlas_size, SDEFL_LVL_MAX);
+
+    genf(out, "#define BUNDLE_HAS_FONT_ATLAS");
+    genf(out, "int bundle_font_size = %d;", UNIFONT_SIZE);
+    genf(out, "int bundle_font_atlas_width = %d;", ATLAS_WIDTH);
+    genf(out, "int bundle_font_atlas_height = %d;", height);
+    genf(out, "int bundle_font_atlas_padding = %d;", GLYPH_PADDING);
+    genf(out, "size_t bundle_font_glyph_count = %zu;", glyph_count);
+    genf(out, "int bundle_font_glyphs[] = {");
+
+    for (size_t i = 0; i < glyph_count; i++) {
+
+        int* g = glyphs + i * 8;
+
+        genf(out, "    %d, %d, %d, %d, %d, %d, %d, %d,", g[0], g[1], g[2],
+             g[3], g[4], g[5], g[6], g[7]);
+    }
+
+    genf(out, "};");
+    genf(out, "size_t bundle_font_atlas_size = %d;", packed_size);
+    genf(out, "unsigned char bundle_font_atlas[] = {");
+
+    for (int i = 0; i < packed_size; i++) {
+
+        genfp(out, "0x%02X,", packed[i]);
+
+        if ((i + 1) % LINE_BYTE_COUNT == 0) genfp(out, "\n");
+    }
+
+    genf(out, "};");
+
+    printf("Baked %zu glyphs into a %dx%d atlas, %d bytes deflated\n",
+           glyph_count, ATLAS_WIDTH, height, packed_size);
+
+    free(packed);
+    free(deflate);
+    free(atlas);
+    free(glyphs);
+    free(font);
+}
+
 void generate_resource_bundle(void) {
     const char* BUNDLE_H_PATH = "./bundle.h";
 
@@ -102,7 +357,6 @@ void generate_resource_bundle(void) {
     genf(out, "unsigned char resource_bundle[] = {");
 
     size_t read_bytes = 0;
-#define LINE_BYTE_COUNT 48
 
     // generate big array of bytes
     for (size_t i = 0; i < RESOURCES_COUNT; ++i) {
@@ -137,6 +391,9 @@ void generate_resource_bundle(void) {
     }
 
     genf(out, "};");
+
+    generate_font_atlas(out);
+
     genf(out, "#endif // BUNDLE_H_");
 
     fclose(out);
@@ -93,6 +93,99 @@ extern const size_t ZOOM_LEVELS_SIZE;
 // Imlib2 will not be used for any loading done in thread.
 #define ASYNC_IMAGE_LOADING true
 
+// Pixel buffers at least this big are mapped by the pixel pool on huge pages,
+// freed buffers are kept and reused by the next image of the same size.
+#define PIXEL_POOL_MIN_SIZE (1024 * 1024)
+
+// Freed pixel buffers kept for reuse, past this the oldest are unmapped.
+#define PIXEL_POOL_CACHE_SIZE (512 * 1024 * 1024)
+
+// When the system has less free memory than this,
+// the pages of the kept buffers are given back to it.
+#define PIXEL_POOL_LOW_MEMORY (512 * 1024 * 1024)
+
+// Keep images in the fewest channels they need instead of always R8G8B8A8.
+// Opaque images are stored as RGB, grayscale ones as gray, in memory and on the GPU.
+#define PACK_IMAGE_CHANNELS true
+
+// Images much bigger than the screen are kept as a screen sized proxy,
+// the full image is only loaded when zooming in past what the proxy can show.
+#define USE_PROXY_IMAGES true
+
+// Longest side of a proxy, 0 uses the size of the monitor.
+#define PROXY_IMAGE_SIZE 0
+
+// The monitor size assumed for the first image, which starts decoding before the window exists.
+#define PROXY_STARTUP_SIZE 3840
+
+// Only images with a side this many times longer than the proxy get one.
+#define PROXY_MIN_RATIO 1.5
+
+// The full image is loaded once a proxy pixel is drawn bigger than this many screen pixels.
+#define PROXY_PROMOTE_SCALE 1.0
+
+// Decoded images kept in RAM past this are compressed, least recently shown first.
+// The compressed copy is decoded again when the image is shown, which is much faster than its file.
+#define RESIDENT_RAW_BUDGET (1024L * 1024 * 1024)
+
+// Compressed images kept in RAM past this are dropped, they are loaded from their file again.
+#define RESIDENT_PACKED_BUDGET (512L * 1024 * 1024)
+
+// Textures of recently shown images kept on the GPU, so going back to them shows them at once.
+#define RESIDENT_TEXTURE_BUDGET (256L * 1024 * 1024)
+
+// Most textures kept on the GPU at once.
+#define RESIDENT_TEXTURE_SLOTS 8
+
+// Frames between checking the budgets, they are also checked whenever another image is selected.
+#define RESIDENCY_CHECK_FRAMES 30
+
+// Play animated images, their frames are decoded on a thread while they play.
+// Only works with imylib2, other images show their first frame.
+#define PLAY_ANIMATIONS true
+
+// Frames decoded ahead of the one shown, each is a full canvas of RGBA.
+// This is all the memory an animation uses no matter how many frames it has.
+#define ANIMATION_RING_FRAMES 4
+
+// Frames with a delay this short or none are shown for ANIMATION_DEFAULT_DELAY, like browsers do.
+#define ANIMATION_MIN_DELAY 10
+
+// Milliseconds a frame is shown if its delay is too short.
+#define ANIMATION_DEFAULT_DELAY 100
+
+// Show the rows of big images as they decode, over their thumbnail, instead of waiting for the whole image.
+// Only imylib2 loaders which report their rows can do this.
+#define USE_PROGRESSIVE_LOADING true
+
+// Images with fewer pixels than this decode fast enough to wait for.
+#define PROGRESSIVE_MIN_PIXELS (2048L * 2048)
+
+// Longest side of the image the decoded rows are shrunk into while loading.
+#define PROGRESSIVE_PREVIEW_SIZE 2048
+
+// While moving through images quickly, show their thumbnail or placeholder scaled up
+// and only decode the image the selection stops on.
+#define USE_SCRUB_MODE true
+
+// Moving this many images within SCRUB_WINDOW seconds starts scrubbing.
+// Holding a key bound with DELAY_MEDIUM moves about 6 images a second.
+#define SCRUB_STEPS 3
+#define SCRUB_WINDOW 0.6
+
+// Seconds the selection has to stay put before the image is decoded, longer than the slowest key repeat.
+#define SCRUB_SETTLE_TIME 0.25
+
+// Frames per second kb_Toggle_Flipbook plays a numbered image sequence at.
+#define FLIPBOOK_FPS 24
+
+// Decoded frames kept ahead of the playhead, the frames of a sequence are assumed to be the same size.
+// A sequence which fits is decoded once and then loops from memory.
+#define FLIPBOOK_CACHE_BUDGET (1024L * 1024 * 1024)
+
+// Most threads decoding frames ahead of the playhead, 0 means one per CPU.
+#define FLIPBOOK_MAX_THREADS 0
+
 // Number of threads that can be used when making thumbnails.
 // This is only used on the thumbnail page.
 // This MUST be >= 1.
@@ -117,6 +210,35 @@ extern const size_t ZOOM_LEVELS_SIZE;
 // They are saved as QOI generally in $HOME/.cache/immy
 #define SHOULD_CACHE_THUMBNAILS true
 
+// If true, thumbnails are encoded and written to the cache on a background thread.
+// Otherwise they are written by whichever thread created them.
+#define ASYNC_THUMBNAIL_SAVING true
+
+// The nice value given to the thread writing thumbnails (linux only).
+// Higher means lower priority. 0 leaves the priority alone.
+#define THUMB_SAVE_THREAD_NICE 10
+
+// Thumbnails waiting to be written at most, each holds its own copy of the pixels.
+// Once full new saves are dropped, their thumbnail is made again the next time it is needed.
+#define THUMB_SAVE_QUEUE_MAX 256
+
+// If true, thumbnails are averaged in linear light instead of sRGB.
+// Slower, but bright detail does not get darker when shrunk.
+#define THUMB_GAMMA_CORRECT false
+
+// Images with at least this many pixels are resized using multiple threads.
+#define THUMB_RESIZE_PARALLEL_PIXELS (4096 * 4096)
+
+// The most threads used to resize a single image. 0 means one per CPU.
+#define THUMB_RESIZE_MAX_THREADS 4
+
+// If true, every thumbnail is also made with nearest neighbour
+// and the time of both resizers is logged. Only useful for benchmarking.
+#define LOG_THUMBNAIL_RESIZE_TIMES false
+
+// The most threads used by --pregen-thumbs. 0 means one per CPU.
+#define PREGEN_THUMBS_MAX_THREADS 0
+
 // Use THUMBNAIL_BASE_CACHE_PATH as the thumb cache base directory
 #define OVERRIDE_THUMBNAIL_CACHE_PATH false
 
@@ -126,7 +248,7 @@ extern const size_t ZOOM_LEVELS_SIZE;
 
 // Joins the THUMBNAIL_BASE_CACHE_PATH and the thumb file.
 // A cached thumbnail would be in:
-//   THUMBNAIL_BASE_CACHE_PATH / THUMBNAIL_CACHE_PATH / SHA256 Of Image Path
+//   THUMBNAIL_BASE_CACHE_PATH / THUMBNAIL_CACHE_PATH / Level Size / SHA256 Of Image Path
 #define THUMBNAIL_CACHE_PATH "/.cache/immy/"
 
 // Feature flag for using Imylib2.
@@ -208,8 +330,30 @@ extern const size_t ZOOM_LEVELS_SIZE;
 // Options are:
 //  - SORT_ORDER__DEFAULT
 //  - SORT_ORDER__NATURAL
+//  - SORT_ORDER__MTIME
+//  - SORT_ORDER__SIZE
+//  - SORT_ORDER__DIMENSIONS
+//  - SORT_ORDER__DATE_TAKEN
 #define DEFAULT_SORT_ORDER SORT_ORDER__NATURAL
 
+// Lists with at least this many files are sorted on several threads.
+#define SORT_PARALLEL_MIN 16384
+
+// The most threads used to sort. 0 means one per CPU.
+#define SORT_MAX_THREADS 0
+
+// Threads used to read file metadata when sorting by it.
+// Most of the time is spent waiting on the disk, so this can be more than the CPU count.
+#define META_THREADS 8
+
+// When set true, the metadata of each directory is kept in the cache directory,
+// so sorting a big directory again only needs a stat per file.
+#define META_DISK_CACHE true
+
+// The most results the search prompt keeps, best first.
+// Everything past this is counted but cannot be reached from the prompt.
+#define SEARCH_MAX_RESULTS 1000
+
 // When set true, the first image is always centered.
 #define CENTER_IMAGE_ON_FIRST_START true
 
@@ -221,9 +365,36 @@ extern const size_t ZOOM_LEVELS_SIZE;
 #define IMAGE_INVERSE_MARGIN_X 32
 #define IMAGE_INVERSE_MARGIN_Y 32
 
-// Size of thumbnails for the thumbnail page.
+// Starting size of a cell on the thumbnail page.
 #define THUMB_SIZE 256
 
+// Thumbnails are made and cached at THUMB_LEVEL_COUNT sizes,
+// starting at THUMB_LEVEL_SMALLEST and doubling each time. (64, 128, 256, 512)
+// The thumbnail page uses the smallest level which covers a cell.
+#define THUMB_LEVEL_SMALLEST 64
+#define THUMB_LEVEL_COUNT 4
+
+// If true, the thumbnail page draws a tiny preview from the cache index
+// for any cell whose thumbnail is not ready yet.
+#define SHOW_THUMB_PLACEHOLDERS true
+
+// Reading a thumbnail from the cache blocks the frame.
+// At most this many are read per frame, the rest show a placeholder until the next frame.
+#define THUMB_CACHE_READS_PER_FRAME 8
+
+// Placeholder lookups queued for the cache index thread per frame.
+// They only read memory, so this is enough for every visible cell of a large grid.
+#define THUMB_PLACEHOLDER_REQUESTS_PER_FRAME 256
+
+// The cache index is rewritten at startup when it has more than this many records
+// and at least half of them have been replaced by newer ones.
+#define THUMB_INDEX_COMPACT_RECORDS 4096
+
+// Limits and step size when zooming the thumbnail page.
+#define THUMB_CELL_SIZE_MIN 48
+#define THUMB_CELL_SIZE_MAX 768
+#define THUMB_CELL_SIZE_STEP 32
+
 // The height of the bar 
 #define INFO_BAR_HEIGHT 32
 
@@ -241,6 +412,21 @@ extern const size_t ZOOM_LEVELS_SIZE;
 // When false, does not search directories recursivly
 #define SEARCH_DIRS_RECURSIVE true
 
+// Number of threads walking directories given on the command line.
+// More than one helps a lot on network filesystems where each readdir waits on the server.
+#define SCAN_THREADS 4
+
+// A directory with more images than this is handed over in several batches,
+// so the first images show up before a huge directory is fully read.
+#define SCAN_BATCH_SIZE 2048
+
+// Seconds between merging scanned files into the image list.
+// Each merge moves the images, so merging every frame would waste time on big lists.
+#define SCAN_MERGE_INTERVAL 0.25
+
+// Size in bytes of the buffer used to read directory entries.
+#define SCAN_DIRENT_BUFFER (64 * 1024)
+
 // The smallest scale value in the ZOOM_LEVELS array
 #define SMALLEST_SCALE_VALUE 0.01
 
@@ -338,6 +524,14 @@ const size_t ZOOM_LEVELS_SIZE = (sizeof((ZOOM_LEVELS)) / sizeof((ZOOM_LEVELS[0])
 #define GRAYSCALE_COEF_G 0.587
 #define GRAYSCALE_COEF_B 0.114
 
+// The error diffusion kernel kb_Dither starts with, shift + 9 cycles it.
+// One of DITHER_FLOYD_STEINBERG, DITHER_ATKINSON, DITHER_STUCKI
+#define DITHER_KERNEL DITHER_FLOYD_STEINBERG
+
+// Most threads a dither runs on, 0 means one per CPU.
+// Rows are handed out in order and each trails the row above by a few pixels.
+#define DITHER_MAX_THREADS 0
+
 
 
 // ###########################
@@ -403,6 +597,8 @@ InputMapping keybinds[] = {
     //
     BIND(KEY_V | CONTROL_MASK ,kb_Paste_Image_From_Clipboard, SCREEN_IMAGE, DELAY_FAST),
     BIND(KEY_NINE             , kb_Dither                   , SCREEN_IMAGE, DELAY_FAST),
+    BIND(KEY_NINE | SHIFT_MASK, kb_Cycle_Dither_Kernel      , SCREEN_IMAGE, DELAY_MEDIUM),
+    BIND(KEY_F                , kb_Toggle_Flipbook          , SCREEN_IMAGE, DELAY_MEDIUM),
     BIND(KEY_K                , kb_Move_Image_Up            , SCREEN_IMAGE, DELAY_FAST),
     BIND(KEY_J                , kb_Move_Image_Down          , SCREEN_IMAGE, DELAY_FAST),
     BIND(KEY_H                , kb_Move_Image_Left          , SCREEN_IMAGE, DELAY_FAST),
@@ -428,8 +624,9 @@ InputMapping keybinds[] = {
     BIND(KEY_SPACE            , kb_Move_Image_By_Mouse_Delta, SCREEN_IMAGE, DELAY_INSTANT),
 
 #if ENABLE_SHADERS
-    BIND(KEY_I, kb_Color_Invert_Shader   , SCREEN_IMAGE, DELAY_MEDIUM),
-    BIND(KEY_G, kb_Color_Grayscale_Shader, SCREEN_IMAGE, DELAY_MEDIUM),
+    BIND(KEY_I   , kb_Color_Invert_Shader   , SCREEN_IMAGE, DELAY_MEDIUM),
+    BIND(KEY_G   , kb_Color_Grayscale_Shader, SCREEN_IMAGE, DELAY_MEDIUM),
+    BIND(KEY_ZERO, kb_Bayer_Dither_Shader   , SCREEN_IMAGE, DELAY_MEDIUM),
 #else
     BIND(KEY_I, keybind_colorInvert, SCREEN_IMAGE, DELAY_MEDIUM),
 #endif
@@ -453,6 +650,8 @@ InputMapping keybinds[] = {
     BINDX(KEY_G | SHIFT_MASK              , kb_Jump_Image_End  , SCREEN_FILE_LIST, KEY_LIMIT, DELAY_MEDIUM),
     BINDX(KEY_G                           , kb_Jump_Image_Start, SCREEN_FILE_LIST, KEY_LIMIT, DELAY_MEDIUM),
     BIND(KEY_ENTER                        ,kb_Goto_Image_Screen, SCREEN_FILE_LIST, DELAY_FAST),
+    BIND(KEY_S                            , kb_Cycle_Sort_Order, SCREEN_FILE_LIST, DELAY_MEDIUM),
+    BIND(KEY_SLASH                        , kb_Search_Files    , SCREEN_FILE_LIST, DELAY_MEDIUM),
 
 
     // ###########################
@@ -463,6 +662,11 @@ InputMapping keybinds[] = {
     BIND(KEY_H,         kb_Thumb_Page_Left     , SCREEN_THUMB_GRID, DELAY_FAST),
     BIND(KEY_L,         kb_Thumb_Page_Right    , SCREEN_THUMB_GRID, DELAY_FAST),
     BIND(KEY_ENTER,     kb_Goto_Image_Screen   , SCREEN_THUMB_GRID, DELAY_FAST),
+    BIND(KEY_S,         kb_Thumb_Zoom_In       , SCREEN_THUMB_GRID, DELAY_FAST),
+    BIND(KEY_D,         kb_Thumb_Zoom_Out      , SCREEN_THUMB_GRID, DELAY_FAST),
+    BIND(KEY_K | SHIFT_MASK, kb_Thumb_Zoom_In  , SCREEN_THUMB_GRID, DELAY_FAST),
+    BIND(KEY_J | SHIFT_MASK, kb_Thumb_Zoom_Out , SCREEN_THUMB_GRID, DELAY_FAST),
+    BIND(KEY_SLASH,     kb_Search_Files        , SCREEN_THUMB_GRID, DELAY_MEDIUM),
 
     // ###########################
     // ##### keybind   page ######
@@ -487,6 +691,9 @@ InputMapping mousebinds[] = {
     BIND(MOUSE_WHEEL_FWD | SHIFT_MASK, kb_Prev_Image_By_10, SCREEN_FILE_LIST, DELAY_INSTANT),
     BIND(MOUSE_WHEEL_BWD | SHIFT_MASK, kb_Next_Image_By_10, SCREEN_FILE_LIST, DELAY_INSTANT),
 
+    BIND(MOUSE_WHEEL_FWD | CONTROL_MASK, kb_Thumb_Zoom_In , SCREEN_THUMB_GRID, DELAY_VFAST),
+    BIND(MOUSE_WHEEL_BWD | CONTROL_MASK, kb_Thumb_Zoom_Out, SCREEN_THUMB_GRID, DELAY_VFAST),
+
     BIND(MOUSE_WHEEL_FWD             , kb_Scroll_Keybind_List_Up  , SCREEN_KEYBINDS, DELAY_INSTANT),
     BIND(MOUSE_WHEEL_BWD             , kb_Scroll_Keybind_List_Down, SCREEN_KEYBINDS, DELAY_INSTANT),
 };
@@ -530,6 +737,9 @@ const size_t MOUSEBIND_COUNT = (sizeof(mousebinds) / sizeof(mousebinds[0]));
 // The spacing for the above font
 #define UNIFONT_SPACING 0
 
+// The size the font is rasterized at
+#define UNIFONT_SIZE 32
+
 // The codepoints to load for the above font at startup
 // If the font has utf8 you can put them here
 #define CODEPOINT_INITIAL                                                      \
@@ -537,6 +747,15 @@ const size_t MOUSEBIND_COUNT = (sizeof(mousebinds) / sizeof(mousebinds[0]));
     "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"                       \
     "abcdefghijklmnopqrstuvwxyz{|}"
 
+// The codepoints the bundler rasterizes into the release build at UNIFONT_SIZE
+// They need no rasterizing at startup, anything else is rasterized when first drawn
+#define CODEPOINT_BAKED                                                        \
+    CODEPOINT_INITIAL                                                          \
+    "~"                                                                        \
+    "¡¢£¤¥¦§¨©ª«¬®¯°±²³´µ¶·¸¹º»¼½¾¿"                                           \
+    "ÀÁÂÃÄÅÆÇÈÉÊËÌÍÎÏÐÑÒÓÔÕÖ×ØÙÚÛÜÝÞß"                                         \
+    "àáâãäåæçèéêëìíîïðñòóôõö÷øùúûüýþÿ"
+
 // ###########################
 // ##### Extension Filter ####
 // ###########################
@@ -618,6 +837,9 @@ const size_t MOUSEBIND_COUNT = (sizeof(mousebinds) / sizeof(mousebinds[0]));
 #define CLI_HELP_h_FLAG "-h <int> set the window height"
 #define CLI_HELP_l_FLAG "-l <int 1-6> set the log level"
 
+#define CLI_PREGEN_THUMBS_FLAG "--pregen-thumbs"
+#define CLI_HELP_PREGEN_THUMBS_FLAG CLI_PREGEN_THUMBS_FLAG " <paths...> fill the thumbnail cache and exit"
+
 #define CLI_HELP                                                               \
     "Usage: immy [options] filename/dirname\n"                                 \
     "\n"                                                                       \
@@ -626,7 +848,10 @@ const size_t MOUSEBIND_COUNT = (sizeof(mousebinds) / sizeof(mousebinds[0]));
     "\n  " CLI_HELP_D_FLAG "\n  " CLI_HELP_d_FLAG "\n  " CLI_HELP_C_FLAG       \
     "\n  " CLI_HELP_c_FLAG "\n  " CLI_HELP_t_FLAG "\n  " CLI_HELP_x_FLAG       \
     "\n  " CLI_HELP_y_FLAG "\n  " CLI_HELP_w_FLAG "\n  " CLI_HELP_h_FLAG       \
-    "\n  " CLI_HELP_l_FLAG
+    "\n  " CLI_HELP_l_FLAG                                                     \
+    "\n"                                                                       \
+    "\nHeadless options:"                                                      \
+    "\n  " CLI_HELP_PREGEN_THUMBS_FLAG
 
 #endif
 
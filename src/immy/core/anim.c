@@ -0,0 +1,474 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+#if defined(IMYLIB2_AVAILABLE) && USE_IMYLIB2
+#    include <imylib2.h>
+#endif
+
+// a frame shown this late is skipped if the one after it is decoded,
+// anything later than ANIMATION_MAX_LAG restarts the clock instead of rushing to catch up
+#define ANIMATION_MAX_LAG 0.5
+
+#ifdef IMYLIB2_H
+
+// A canvas waiting in the ring to be shown.
+typedef struct {
+        Color* pixels;
+        double delay; // seconds it stays up
+} AnimFrame_t;
+
+typedef struct {
+
+        // identifies the image, paths live until exit
+        const char* path;
+
+        pthread_t       thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t  cond; // signaled when a frame is added to or taken from the ring
+
+        // everything below is guarded by the mutex
+        AnimFrame_t ring[ANIMATION_RING_FRAMES];
+        int         head;  // the next frame to show
+        int         count; // decoded frames waiting
+        int         width; // canvas size, set before the first frame is added
+        int         height;
+        bool        done;  // the thread stopped, the ring still has to be emptied
+        bool        cancel;
+
+        // only touched by the main thread
+        Texture2D texture;
+        double    nextFrameAt; // when the shown frame is over, 0 before the first
+        bool      waiting;     // the shown frame is over, but the next is not decoded
+        size_t    shown;
+        size_t    dropped;
+        size_t    late;
+
+} AnimJob_t;
+
+static AnimJob_t* job = NULL;
+
+// Draws a frame onto the canvas, parts of the frame off the canvas are clipped.
+static void composite_frame(Color* canvas, int cw, int ch, const il2Frame* f) {
+
+    int x0 = MAX(0, f->x);
+    int y0 = MAX(0, f->y);
+    int x1 = MIN(cw, f->x + f->w);
+    int y1 = MIN(ch, f->y + f->h);
+
+    bool blend = (f->flags & FF_FRAME_BLEND) && f->has_alpha;
+
+    for (int y = y0; y < y1; y++) {
+
+        Color*       dst = canvas + (size_t)y * cw;
+        const Color* src = (const Color*)f->data + (size_t)(y - f->y) * f->w - f->x;
+
+        if (!blend) {
+
+            memcpy(dst + x0, src + x0, (size_t)(x1 - x0) * sizeof(Color));
+
+            continue;
+        }
+
+        for (int x = x0; x < x1; x++) {
+
+            Color s = src[x];
+
+            if (s.a == 255) {
+
+                dst[x] = s;
+
+            } else if (s.a != 0) {
+
+                // source over, the canvas may be transparent itself
+                Color d  = dst[x];
+                int   da = d.a * (255 - s.a) / 255;
+                int   a  = s.a + da;
+
+                dst[x] = (Color){
+                    (s.r * s.a + d.r * da) / a,
+                    (s.g * s.a + d.g * da) / a,
+                    (s.b * s.a + d.b * da) / a,
+                    a,
+                };
+            }
+        }
+    }
+}
+
+static void clear_rect(Color* canvas, int cw, int ch, const il2Frame* f) {
+
+    int x0 = MAX(0, f->x);
+    int y0 = MAX(0, f->y);
+    int x1 = MIN(cw, f->x + f->w);
+    int y1 = MIN(ch, f->y + f->h);
+
+    for (int y = y0; y < y1; y++)
+        memset(canvas + (size_t)y * cw + x0, 0, (size_t)(x1 - x0) * sizeof(Color));
+}
+
+// Waits for a free slot and copies the canvas into it.
+// Returns false if the animation was stopped while waiting.
+static bool push_frame(AnimJob_t* j, const Color* canvas, size_t bytes, int delay) {
+
+    pthread_mutex_lock(&j->mutex);
+
+    while (j->count == ANIMATION_RING_FRAMES && !j->cancel)
+        pthread_cond_wait(&j->cond, &j->mutex);
+
+    if (j->cancel) {
+
+        pthread_mutex_unlock(&j->mutex);
+
+        return false;
+    }
+
+    AnimFrame_t* slot = j->ring + (j->head + j->count) % ANIMATION_RING_FRAMES;
+
+    pthread_mutex_unlock(&j->mutex);
+
+    // the main thread never touches a slot past count, so this copy needs no lock
+    memcpy(slot->pixels, canvas, bytes);
+
+    slot->delay = (delay <= ANIMATION_MIN_DELAY ? ANIMATION_DEFAULT_DELAY : delay) / 1000.0;
+
+    pthread_mutex_lock(&j->mutex);
+
+    j->count++;
+
+    pthread_cond_broadcast(&j->cond);
+    pthread_mutex_unlock(&j->mutex);
+
+    return true;
+}
+
+static void* anim_thread_main(void* raw_arg) {
+
+    AnimJob_t*   j        = raw_arg;
+    il2Animation anim     = {0};
+    Color*       canvas   = NULL;
+    Color*       previous = NULL;
+    int          loaded   = 0;
+
+    if (!il2OpenAnimation(j->path, &anim))
+        goto done;
+
+    int    w     = anim.canvas_w;
+    int    h     = anim.canvas_h;
+    size_t bytes = (size_t)w * h * sizeof(Color);
+
+    canvas   = RL_MALLOC(bytes);
+    previous = RL_MALLOC(bytes);
+
+    bool ringOk = canvas != NULL && previous != NULL;
+
+    for (int i = 0; i < ANIMATION_RING_FRAMES && ringOk; i++) {
+
+        j->ring[i].pixels = RL_MALLOC(bytes);
+
+        ringOk = j->ring[i].pixels != NULL;
+    }
+
+    if (!ringOk) {
+
+        L_E("%s: Cannot allocate %d frames of %dx%d for %s", __func__, ANIMATION_RING_FRAMES, w, h, j->path);
+
+        goto done;
+    }
+
+    pthread_mutex_lock(&j->mutex);
+
+    j->width  = w;
+    j->height = h;
+
+    pthread_mutex_unlock(&j->mutex);
+
+    L_D("%s: Playing %d %s frames of %dx%d from %s", __func__, anim.frames, anim.format, w, h, j->path);
+
+    for (int loop = 0; anim.loops == 0 || loop < anim.loops; loop++) {
+
+        memset(canvas, 0, bytes);
+
+        for (int n = 1; n <= anim.frames; n++) {
+
+            il2Frame f;
+
+            // a truncated file plays the frames it has
+            if (!il2LoadFrame(&anim, n, &f)) {
+
+                if (loaded == 0)
+                    goto done;
+
+                anim.frames = n - 1;
+
+                break;
+            }
+
+            loaded++;
+
+            il2SwapRedBlue(f.data, f.data, (size_t)f.w * f.h);
+
+            // what the canvas goes back to once this frame is over
+            if (f.flags & FF_FRAME_DISPOSE_PREV)
+                memcpy(previous, canvas, bytes);
+
+            composite_frame(canvas, w, h, &f);
+
+            bool ok = push_frame(j, canvas, bytes, f.delay);
+
+            if (f.flags & FF_FRAME_DISPOSE_CLEAR)
+                clear_rect(canvas, w, h, &f);
+            else if (f.flags & FF_FRAME_DISPOSE_PREV)
+                memcpy(canvas, previous, bytes);
+
+            il2FreeFrame(&f);
+
+            if (!ok)
+                goto done;
+        }
+
+        if (anim.frames <= 1)
+            break;
+    }
+
+done:
+
+    if (anim.load != NULL)
+        il2CloseAnimation(&anim);
+
+    RL_FREE(canvas);
+    RL_FREE(previous);
+
+    pthread_mutex_lock(&j->mutex);
+
+    j->done = true;
+
+    pthread_cond_broadcast(&j->cond);
+    pthread_mutex_unlock(&j->mutex);
+
+    return NULL;
+}
+
+static void stop_animation() {
+
+    pthread_mutex_lock(&job->mutex);
+
+    job->cancel = true;
+
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+
+    pthread_join(job->thread, NULL);
+
+    if (job->shown > 0)
+        L_D("%s: %s showed %zu frames, dropped %zu, %zu were late", __func__, job->path, job->shown, job->dropped,
+            job->late);
+
+    if (IsTextureReady(job->texture))
+        UnloadTexture(job->texture);
+
+    for (int i = 0; i < ANIMATION_RING_FRAMES; i++)
+        RL_FREE(job->ring[i].pixels);
+
+    pthread_mutex_destroy(&job->mutex);
+    pthread_cond_destroy(&job->cond);
+
+    free(job);
+
+    job = NULL;
+}
+
+static bool start_animation(const char* path) {
+
+    AnimJob_t* j = calloc(1, sizeof(AnimJob_t));
+
+    if (j == NULL)
+        return false;
+
+    j->path = path;
+
+    pthread_mutex_init(&j->mutex, NULL);
+    pthread_cond_init(&j->cond, NULL);
+
+    if (pthread_create(&j->thread, NULL, anim_thread_main, j) != 0) {
+
+        L_E("%s: Cannot start playing %s", __func__, path);
+
+        pthread_mutex_destroy(&j->mutex);
+        pthread_cond_destroy(&j->cond);
+
+        free(j);
+
+        return false;
+    }
+
+    job = j;
+
+    return true;
+}
+
+// Takes the frame at the head of the ring, skipping frames which are already over.
+// Returns the frame to show, or NULL if it is not decoded yet.
+static AnimFrame_t* next_frame(double now) {
+
+    AnimFrame_t* frame = NULL;
+
+    pthread_mutex_lock(&job->mutex);
+
+    // the first frame, or a stall long enough that catching up would look like fast forward
+    if (job->count > 0 && (job->nextFrameAt == 0 || now - job->nextFrameAt > ANIMATION_MAX_LAG))
+        job->nextFrameAt = now;
+
+    while (job->count > 0 && now >= job->nextFrameAt) {
+
+        frame = job->ring + job->head;
+
+        job->nextFrameAt += frame->delay;
+
+        // this one is over before it could be shown, show the next if it is ready
+        if (now >= job->nextFrameAt && job->count > 1) {
+
+            job->dropped++;
+            job->head = (job->head + 1) % ANIMATION_RING_FRAMES;
+            job->count--;
+
+            frame = NULL;
+
+            continue;
+        }
+
+        break;
+    }
+
+    pthread_mutex_unlock(&job->mutex);
+
+    return frame;
+}
+
+// Gives the head of the ring back to the thread once it has been uploaded.
+static void release_frame() {
+
+    pthread_mutex_lock(&job->mutex);
+
+    job->head = (job->head + 1) % ANIMATION_RING_FRAMES;
+    job->count--;
+
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+void iUpdateAnimation(ImmyControl_t* ctrl) {
+
+    ImmyImage_t* im = ctrl->screen == SCREEN_IMAGE ? ctrl->selected_image : NULL;
+
+    // edits are made to the first frame, so it stays up once the image is changed
+    bool wanted = PLAY_ANIMATIONS && im != NULL && im->state->status == IMAGE_STATUS_LOADED && !im->rebuildBuff &&
+                  !im->isEdited && iDitherProgress(im) < 0;
+
+    if (job != NULL && (!wanted || job->path != im->path))
+        stop_animation();
+
+    if (!wanted)
+        return;
+
+    if (job == NULL && !start_animation(im->path))
+        return;
+
+    double now = iGetTime();
+
+    AnimFrame_t* frame = next_frame(now);
+
+    pthread_mutex_lock(&job->mutex);
+
+    bool playing = !job->done || job->count > 0;
+    int  w       = job->width;
+    int  h       = job->height;
+
+    pthread_mutex_unlock(&job->mutex);
+
+    if (frame == NULL) {
+
+        // count each frame which could not be shown on time once
+        if (job->nextFrameAt != 0 && now >= job->nextFrameAt && playing && !job->waiting) {
+
+            job->late++;
+            job->waiting = true;
+        }
+
+        if (playing)
+            ctrl->renderFrames = RENDER_FRAMES;
+
+        return;
+    }
+
+    job->waiting = false;
+
+    if (!IsTextureReady(job->texture)) {
+
+        Image canvas = {
+            .data    = frame->pixels,
+            .width   = w,
+            .height  = h,
+            .mipmaps = 1,
+            .format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+
+        job->texture = LoadTextureFromImage(canvas);
+
+    } else {
+
+        UpdateTexture(job->texture, frame->pixels);
+    }
+
+    // filtered the same as the still image when zoomed out
+    if (IsTextureReady(job->texture))
+        GenTextureMipmaps(&job->texture);
+
+    job->shown++;
+
+    release_frame();
+
+    ctrl->renderFrames = RENDER_FRAMES;
+}
+
+bool iGetAnimationTexture(const ImmyImage_t* im, Texture2D* texture) {
+
+    if (job == NULL || job->path != im->path || !IsTextureReady(job->texture))
+        return false;
+
+    *texture = job->texture;
+
+    return true;
+}
+
+void iAnimationDeinit() {
+
+    if (job != NULL)
+        stop_animation();
+}
+
+#else
+
+void iUpdateAnimation(ImmyControl_t* ctrl) {
+
+    (void)ctrl;
+}
+
+bool iGetAnimationTexture(const ImmyImage_t* im, Texture2D* texture) {
+
+    (void)im;
+    (void)texture;
+
+    return false;
+}
+
+void iAnimationDeinit() {}
+
+#endif
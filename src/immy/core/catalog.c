@@ -0,0 +1,126 @@
+#include <raylib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+// Grows one column to length items, it is left as it was if it cannot.
+static bool grow_column(void** column, size_t itemSize, size_t length) {
+
+    void* buffer = realloc(*column, itemSize * length);
+
+    if (buffer == NULL)
+        return false;
+
+    *column = buffer;
+
+    return true;
+}
+
+// Points every image at its entry in the states column again, after the column moved.
+static void link_states(ImmyCatalog_t* cat) {
+
+    for (size_t i = 0; i < cat->size; i++)
+        cat->images[i].state = cat->states + i;
+}
+
+bool iCatalogReserve(ImmyCatalog_t* cat, size_t length) {
+
+    if (length <= cat->length)
+        return true;
+
+    size_t newLength = cat->length == 0 ? 32 : cat->length;
+
+    while (length > newLength)
+        newLength *= 2;
+
+    // a column which grew while a later one could not just has room to spare
+    bool ok = grow_column((void**)&cat->paths, sizeof(*cat->paths), newLength) &&
+              grow_column((void**)&cat->names, sizeof(*cat->names), newLength) &&
+              grow_column((void**)&cat->groups, sizeof(*cat->groups), newLength) &&
+              grow_column((void**)&cat->states, sizeof(*cat->states), newLength) &&
+              grow_column((void**)&cat->metas, sizeof(*cat->metas), newLength) &&
+              grow_column((void**)&cat->images, sizeof(*cat->images), newLength);
+
+    // the states may have moved even if the images could not grow
+    link_states(cat);
+
+    if (ok)
+        cat->length = newLength;
+
+    return ok;
+}
+
+void iCatalogSetNew(ImmyCatalog_t* cat, size_t i, char* path, int group, int thumbLevel) {
+
+    cat->paths[i]  = path;
+    cat->names[i]  = GetFileName(path);
+    cat->groups[i] = group;
+    cat->states[i] = (ImmyImageState_t){.status = IMAGE_STATUS_NOT_LOADED};
+    cat->metas[i]  = (ImageMeta_t){0};
+
+    cat->images[i] = (ImmyImage_t){
+        .path       = path,
+        .state      = cat->states + i,
+        .thumb_size = thumbLevel,
+        .scale      = 1,
+    };
+}
+
+void iCatalogMove(ImmyCatalog_t* cat, size_t to, size_t from) {
+
+    cat->paths[to]  = cat->paths[from];
+    cat->names[to]  = cat->names[from];
+    cat->groups[to] = cat->groups[from];
+    cat->states[to] = cat->states[from];
+    cat->metas[to]  = cat->metas[from];
+    cat->images[to] = cat->images[from];
+
+    cat->images[to].state = cat->states + to;
+}
+
+// Reorders one column through scratch, which holds at least count items.
+static void permute_column(void* column, size_t itemSize, const size_t* order, size_t count, char* scratch) {
+
+    const char* src = column;
+
+    for (size_t i = 0; i < count; i++)
+        memcpy(scratch + i * itemSize, src + order[i] * itemSize, itemSize);
+
+    memcpy(column, scratch, count * itemSize);
+}
+
+bool iCatalogPermute(ImmyCatalog_t* cat, const size_t* order) {
+
+    // the images are the widest column, every other one fits in the same scratch
+    char* scratch = malloc(MAX(1, cat->size) * sizeof(ImmyImage_t));
+
+    if (scratch == NULL)
+        return false;
+
+    permute_column(cat->paths, sizeof(*cat->paths), order, cat->size, scratch);
+    permute_column(cat->names, sizeof(*cat->names), order, cat->size, scratch);
+    permute_column(cat->groups, sizeof(*cat->groups), order, cat->size, scratch);
+    permute_column(cat->states, sizeof(*cat->states), order, cat->size, scratch);
+    permute_column(cat->metas, sizeof(*cat->metas), order, cat->size, scratch);
+    permute_column(cat->images, sizeof(*cat->images), order, cat->size, scratch);
+
+    free(scratch);
+
+    link_states(cat);
+
+    return true;
+}
+
+void iCatalogFree(ImmyCatalog_t* cat) {
+
+    free(cat->paths);
+    free(cat->names);
+    free(cat->groups);
+    free(cat->states);
+    free(cat->metas);
+    free(cat->images);
+
+    *cat = (ImmyCatalog_t){0};
+}
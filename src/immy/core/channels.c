@@ -0,0 +1,124 @@
+
+#include <raylib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+// What the pixels of an image actually use.
+typedef struct {
+        bool gray;   // every pixel has r == g == b
+        bool opaque; // every pixel has a == 255
+} PixelUse_t;
+
+// Stops as soon as the pixels are known to need every channel.
+// Always inlined so each format gets its own loop with a constant stride.
+static inline __attribute__((always_inline)) PixelUse_t
+scan_pixels(const uint8_t* p, size_t count, int channels, bool color, bool alpha) {
+
+    PixelUse_t use = {color, alpha};
+
+    for (size_t i = 0; i < count && (use.gray || use.opaque); i++, p += channels) {
+
+        if (use.gray && (p[0] != p[1] || p[0] != p[2]))
+            use.gray = false;
+
+        if (use.opaque && p[channels - 1] != 255)
+            use.opaque = false;
+    }
+
+    return use;
+}
+
+// Copies the channels that are kept, the output is never wider so this works in place.
+static inline __attribute__((always_inline)) void
+pack_pixels(uint8_t* dst, const uint8_t* src, size_t count, int from, int to, bool gray, bool alpha) {
+
+    for (size_t i = 0; i < count; i++, src += from, dst += to) {
+
+        dst[0] = src[0];
+
+        if (!gray) {
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+
+        if (alpha)
+            dst[to - 1] = src[from - 1];
+    }
+}
+
+static int packed_format(bool gray, bool alpha) {
+
+    if (gray)
+        return alpha ? PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA : PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
+
+    return alpha ? PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 : PIXELFORMAT_UNCOMPRESSED_R8G8B8;
+}
+
+bool iPackImageChannels(Image* im, bool mayHaveAlpha) {
+
+    if (im->data == NULL || im->width <= 0 || im->height <= 0 || im->mipmaps != 1)
+        return false;
+
+    size_t   count = (size_t)im->width * im->height;
+    uint8_t* px    = im->data;
+
+    PixelUse_t use;
+    int        from;
+
+    switch (im->format) {
+
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8:
+        from = 4;
+        use  = mayHaveAlpha ? scan_pixels(px, count, 4, true, true) : scan_pixels(px, count, 4, true, false);
+
+        if (!mayHaveAlpha)
+            use.opaque = true;
+        break;
+
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8:
+        from = 3;
+        use  = scan_pixels(px, count, 3, true, false);
+        break;
+
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA:
+        from = 2;
+        use  = (PixelUse_t){true, mayHaveAlpha ? scan_pixels(px, count, 2, false, true).opaque : true};
+        break;
+
+    default:
+        return false;
+    }
+
+    bool alpha  = (from == 4 || from == 2) && !use.opaque;
+    int  format = packed_format(use.gray, alpha);
+
+    if (format == im->format)
+        return false;
+
+    int to = (use.gray ? 1 : 3) + alpha;
+
+    // every case is spelled out so the loops are unrolled for it
+    if (from == 4 && to == 3)
+        pack_pixels(px, px, count, 4, 3, false, false);
+    else if (from == 4 && to == 2)
+        pack_pixels(px, px, count, 4, 2, true, true);
+    else if (from == 4 && to == 1)
+        pack_pixels(px, px, count, 4, 1, true, false);
+    else if (from == 3 && to == 1)
+        pack_pixels(px, px, count, 3, 1, true, false);
+    else if (from == 2 && to == 1)
+        pack_pixels(px, px, count, 2, 1, true, false);
+
+    // give the rest back, keeping the wide buffer is fine if that fails
+    void* shrunk = RL_REALLOC(px, count * to);
+
+    if (shrunk != NULL)
+        im->data = shrunk;
+
+    im->format = format;
+
+    return true;
+}
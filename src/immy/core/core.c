@@ -2,7 +2,9 @@
 #include <errno.h>
 #include <raylib.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../config.h"
@@ -11,40 +13,178 @@
 
 LogLevel_t log_level      = LOG_LEVEL;
 
+// when the last few selection changes happened, to tell holding a key from stepping
+static double navigationTimes[SCRUB_STEPS] = {0};
+static int    navigationNext               = 0;
+static bool   scrubbing                    = false;
+
 int iAddImage(ImmyControl_t* ctrl, const char* path_) {
 
-    char* path = iStrDup(path_);
+    char* path = iInternPath(path_);
+
+    if (!path)
+        return -1;
+
+    L_D("Adding file [%zu]: %s", ctrl->image_files.size, path, path);
+
+    ImmyCatalog_t* cat           = &ctrl->image_files;
+    int            newImageIndex = cat->size;
+    ImmyImage_t*   old           = cat->images;
 
-    if (!path) {
+    if (!iCatalogReserve(cat, cat->size + 1)) {
 
-        L_E("Cannot duplicate string '%s'! %s", strerror(errno));
+        L_E("%s: Cannot grow the image list", __func__);
 
         return -1;
     }
 
-    L_D("Adding file [%zu]: %s", ctrl->image_files.size, path, path);
-
-    const char* name = GetFileName(path);
+    iCatalogSetNew(cat, cat->size++, path, ctrl->image_group, ctrl->thumbLevel);
 
-    ImmyImage_t i = {
-        .path        = path,
-        .name        = name,
-        .rayim       = {0},
-        .scale       = 1,
-        .rotation    = 0,
-        .rebuildBuff = 0,
-        .status      = IMAGE_STATUS_NOT_LOADED,
-        .srcRect     = {0},
-        .dstPos      = {0},
-    };
+    if (cat->images != old) {
 
-    int newImageIndex = ctrl->image_files.size;
+        ctrl->image_files_gen++;
 
-    dImmyImageArrAppend(&ctrl->image_files, i);
+        if (ctrl->selected_image != NULL)
+            ctrl->selected_image = cat->images + ctrl->selected_index;
+    }
 
     return newImageIndex;
 }
 
+// Compares entry i of the catalog against a new path, new images have no metadata yet.
+static inline int image_cmp(const ImmyControl_t* ctrl, size_t i, int group, const char* path) {
+
+    const ImmyCatalog_t* cat = &ctrl->image_files;
+
+    if (cat->groups[i] != group)
+        return cat->groups[i] < group ? -1 : 1;
+
+    if (iSortOrderNeedsMeta(ctrl->filename_cmp)) {
+
+        int64_t value = iGetImageSortValue(cat, i, ctrl->filename_cmp);
+
+        if (value != SORT_VALUE_UNKNOWN)
+            return 1;
+    }
+
+    return iComparePaths(cat->paths[i], path, iGetPathOrder(ctrl->filename_cmp));
+}
+
+size_t iAddImages(ImmyControl_t* ctrl, char** paths, size_t count, int group) {
+
+    if (count == 0)
+        return 0;
+
+    if (!iSortPaths(paths, count, iGetPathOrder(ctrl->filename_cmp)))
+        L_W("%s: Could not sort the new files", __func__);
+
+    ImmyCatalog_t* cat = &ctrl->image_files;
+    ImmyImage_t*   old = cat->images;
+
+    size_t oldSize = cat->size;
+    bool   grown   = iCatalogReserve(cat, oldSize + count);
+
+    // the images may have moved even if nothing is added below
+    if (cat->images != old) {
+
+        ctrl->image_files_gen++;
+
+        if (ctrl->selected_image != NULL)
+            ctrl->selected_image = cat->images + ctrl->selected_index;
+    }
+
+    if (!grown) {
+
+        L_E("%s: Cannot grow the image list", __func__);
+
+        for (size_t i = 0; i < count; i++)
+            free(paths[i]);
+
+        return 0;
+    }
+
+    // every path was allocated on its own, the list keeps them packed together instead
+    for (size_t i = 0; i < count; i++) {
+
+        char* interned = iInternPath(paths[i]);
+
+        if (interned == NULL) {
+
+            for (size_t j = i; j < count; j++)
+                free(paths[j]);
+
+            return 0;
+        }
+
+        free(paths[i]);
+
+        paths[i] = interned;
+    }
+
+    cat->size = oldSize + count;
+
+    // merge from the back so nothing is moved twice,
+    // new paths usually belong at the end so most of the list is not touched
+    size_t i        = oldSize;
+    size_t j        = count;
+    size_t k        = oldSize + count;
+    size_t selected = ctrl->selected_index;
+
+    while (j > 0) {
+
+        if (i > 0 && image_cmp(ctrl, i - 1, group, paths[j - 1]) > 0) {
+
+            iCatalogMove(cat, --k, --i);
+
+            if (i == (size_t)ctrl->selected_index)
+                selected = k;
+
+        } else {
+
+            iCatalogSetNew(cat, --k, paths[--j], group, ctrl->thumbLevel);
+        }
+    }
+
+    if (ctrl->selected_image != NULL) {
+        ctrl->selected_index = selected;
+        ctrl->selected_image = cat->images + selected;
+    }
+
+    ctrl->image_files_gen++;
+
+    L_D("%s: Added %zu files to group %d", __func__, count, group);
+
+    return count;
+}
+
+void iSetThumbLevel(ImmyControl_t* ctrl, int level) {
+
+    L_D("Changing thumbnail level from %d to %d", ctrl->thumbLevel, level);
+
+    ctrl->thumbLevel = level;
+
+    DARRAY_FOR_EACH(ctrl->image_files, i) {
+
+        ImmyImage_t* im = ctrl->image_files.images + i;
+
+        if (im->thumb_size == level)
+            continue;
+
+        im->thumb_size = level;
+
+        if (im->state->thumb_status == IMAGE_STATUS_LOADED)
+            UnloadImage(im->thumb);
+
+        // the new level might be cached even if the old one failed
+        if (im->state->thumb_status != IMAGE_STATUS_LOADING) {
+
+            im->state->thumb_status = IMAGE_STATUS_NOT_LOADED;
+
+            memset(&im->thumb, 0, sizeof(im->thumb));
+        }
+    }
+}
+
 void iSetImage(ImmyControl_t* ctrl, size_t index) {
 
     if (index >= ctrl->image_files.size) {
@@ -54,9 +194,42 @@ void iSetImage(ImmyControl_t* ctrl, size_t index) {
         return;
     }
 
-    ctrl->selected_image = ctrl->image_files.buffer + index;
+    ImmyImage_t* previous = ctrl->selected_image;
+
+    ctrl->selected_image = ctrl->image_files.images + index;
     ctrl->selected_index = index;
     ctrl->renderFrames   = RENDER_FRAMES;
+
+    // the full image is only kept while it is shown
+    if (previous != NULL && previous != ctrl->selected_image)
+        iDemoteImage(previous);
+
+    if (previous == ctrl->selected_image)
+        return;
+
+    double now = iGetTime();
+
+    // the oldest of the last SCRUB_STEPS changes is recent enough, the user is moving too fast to look
+    if (now - navigationTimes[navigationNext] < SCRUB_WINDOW)
+        scrubbing = USE_SCRUB_MODE;
+
+    navigationTimes[navigationNext] = now;
+    navigationNext                  = (navigationNext + 1) % SCRUB_STEPS;
+}
+
+bool iIsScrubbing() {
+
+    if (!scrubbing)
+        return false;
+
+    int    newest = (navigationNext + SCRUB_STEPS - 1) % SCRUB_STEPS;
+    double now    = iGetTime();
+
+    // navigation settled on an image
+    if (now - navigationTimes[newest] > SCRUB_SETTLE_TIME)
+        scrubbing = false;
+
+    return scrubbing;
 }
 
 void iLogRaylib(int msgType, const char* fmt, va_list ap) {
@@ -229,3 +402,19 @@ void iDetachFromTerminal() {
 
 #endif
 }
+
+void iSignalStartupDone() {
+
+#ifdef __unix__
+    uSignalStartupDone();
+#endif
+}
+
+double iGetTime() {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
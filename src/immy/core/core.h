@@ -6,6 +6,7 @@
 #include "external/glfw/include/GLFW/glfw3.h"
 #include "raylib.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -98,9 +99,19 @@
 #define HAS_SHIFT(k) ((((int)(k)) & SHIFT_MASK) != 0)
 #define GET_RAYKEY(k) ((k) & KEY_MASK)
 
+// Size of the grid of colors kept for a thumbnail placeholder.
+// Changing this changes the format of the cache index.
+#define THUMB_PLACEHOLDER_GRID 4
+
+// Sort value of images whose metadata is not known, they go first.
+#define SORT_VALUE_UNKNOWN INT64_MIN
+
 // Max padding / width on the keybinds page for screen column.
 #define STRLEN_SCREEN_STR 17
 
+// Size of the search query, including the null terminator.
+#define SEARCH_QUERY_SIZE 256
+
 // Max padding / width on the keybinds page for key column.
 #define STRLEN_KEY_STR 20
 
@@ -128,8 +139,16 @@ typedef enum {
 } ImageFormat_t;
 
 typedef enum {
-    SORT_ORDER__DEFAULT, // using strcmp
-    SORT_ORDER__NATURAL, // using strnatcmp
+    SORT_ORDER__DEFAULT,    // using strcmp
+    SORT_ORDER__NATURAL,    // digit runs are compared by value
+    SORT_ORDER__MTIME,      // oldest first, the rest sort by natural order
+    SORT_ORDER__SIZE,       // smallest file first
+    SORT_ORDER__DIMENSIONS, // fewest pixels first
+    SORT_ORDER__DATE_TAKEN, // exif capture date, or the mtime without one
+
+    // so we can cycle with integer addition
+    SORT_ORDER__START = SORT_ORDER__DEFAULT,
+    SORT_ORDER__END   = SORT_ORDER__DATE_TAKEN,
 
 } StrCompare_t;
 
@@ -140,6 +159,18 @@ typedef enum {
     IMAGE_STATUS_FAILED,
 } ImageLoadStatus_t;
 
+// Error diffusion kernels for the black and white dither.
+typedef enum {
+    DITHER_FLOYD_STEINBERG,
+    DITHER_ATKINSON, // only spreads 3/4 of the error, keeps more contrast
+    DITHER_STUCKI,   // spreads over two rows, smoother gradients
+
+    // so we can cycle with integer addition
+    DITHER__START = DITHER_FLOYD_STEINBERG,
+    DITHER__END   = DITHER_STUCKI,
+
+} DitherKernel_t;
+
 typedef enum {
     SCREEN_IMAGE = 0,
     SCREEN_FILE_LIST,
@@ -159,38 +190,88 @@ typedef enum {
 
 } UIPanel_t;
 
-// Holds an image and everything about it.
+// A tiny preview drawn while the real thumbnail loads.
+typedef struct ThumbPlaceholder {
+
+        Color avg;                                                   // average color
+        Color grid[THUMB_PLACEHOLDER_GRID * THUMB_PLACEHOLDER_GRID]; // average of each block, row major
+
+        // size of the smallest thumbnail level, for the aspect ratio
+        unsigned short width;
+        unsigned short height;
+
+} ThumbPlaceholder_t;
+
+// What the image can be sorted by, read without decoding the image.
+typedef struct ImageMeta {
+        int64_t mtime; // seconds since the epoch
+        int64_t size;  // bytes
+        int     width; // 0 if the header could not be read
+        int     height;
+        int64_t taken; // exif capture date in seconds since the epoch, 0 if unknown
+} ImageMeta_t;
+
+// The load states of an image, kept in their own column of the catalog so status scans read them densely.
+typedef struct ImmyImageState {
+        ImageLoadStatus_t status             : 3;
+        ImageLoadStatus_t thumb_status       : 3;
+        ImageLoadStatus_t meta_status        : 3; // only gathered when sorting by it
+        ImageLoadStatus_t placeholder_status : 3; // shown on the thumbnail page until the thumbnail is ready
+} ImmyImageState_t;
+
+// The pixels and view of an image, the cold part of a catalog entry.
+// What scans over the whole list read lives in the dense columns of ImmyCatalog_t instead.
 typedef struct ImmyImage {
 
-        // absolute path to the image
+        // absolute path to the image, interned in the path pool DO NOT FREE
+        // the same pointer as the paths column, kept here since loaders only get the image
         char* path;
 
-        // the filename (this is path + some value) DO NOT FREE
-        const char* name;
+        // the states column entry of this image,
+        // images made outside the catalog point it at a state of their own
+        ImmyImageState_t* state;
 
-        ImageLoadStatus_t status;
-        ImageLoadStatus_t thumb_status;
-        Image             rayim;
-        Image             thumb;
-        Rectangle         srcRect;
-        Vector2           dstPos;
+        int thumb_size; // the thumbnail level wanted for this image
+
+        bool rebuildBuff           : 1; // updates the Texture2D
+        bool updateShaders         : 1;
+        bool applyGrayscaleShader  : 1;
+        bool applyInvertShader     : 1;
+        bool applyBayerShader      : 1;
+        bool isLoadingForThumbOnly : 1;
+        bool isProxy               : 1; // rayim is a screen sized copy, srcRect keeps the full size
+        bool promoteFailed         : 1; // the full image behind the proxy could not be loaded, it is not tried again
+        bool isEdited              : 1; // the pixels were changed, so they cannot be loaded again
+
+        Image     rayim;
+        Image     thumb;
+        Rectangle srcRect;
+        Vector2   dstPos;
+
+        ThumbPlaceholder_t* placeholder; // only allocated for images shown on the grid
 
         double scale;
         double rotation;
 
         TextureFilter interpolation;
 
-        bool rebuildBuff; // updates the Texture2D
-        bool updateShaders;
-        bool applyGrayscaleShader;
-        bool applyInvertShader;
-        bool isLoadingForThumbOnly;
-        bool panels[1];
-
 } ImmyImage_t;
 
+// The image list as parallel arrays, entry i of every column is the same image.
+// Scans over the whole list only touch the columns they read, the pixels and view state are in images.
+typedef struct ImmyCatalog {
+        size_t size;   // images in the list
+        size_t length; // entries allocated in every column
+
+        char**            paths;  // interned in the path pool DO NOT FREE
+        const char**      names;  // the filename, the end of the path DO NOT FREE
+        int*              groups; // ordered by group first, then by path. each start argument and drop gets its own
+        ImmyImageState_t* states;
+        ImageMeta_t*      metas; // valid once the meta_status of the image is IMAGE_STATUS_LOADED
+        ImmyImage_t*      images;
+} ImmyCatalog_t;
+
 // Define dynamic array types.
-DARRAY_DEF(dImmyImageArr, ImmyImage_t);
 DARRAY_DEF(dIntArr, int);
 DARRAY_DEF(dByteArr, unsigned char);
 DARRAY_DEF(dTexture2DArr, Texture2D);
@@ -224,6 +305,22 @@ typedef struct ImmyConfig {
 
 // The main control data.
 // A singleton is passed to every keypress callback.
+// State of the search prompt on the file list and thumbnail pages.
+typedef struct ImmySearch {
+
+        bool      active;                   // the prompt has the keyboard
+        char      query[SEARCH_QUERY_SIZE]; // what was typed
+        size_t    length;                   // bytes in query
+        dIntArr_t results;                  // image indices of the best matches, best first
+        size_t    matches;                  // every match, results only keeps the best
+        size_t    cursor;                   // the selected result
+        size_t    version;                  // iSearchVersion the results were made with
+
+        // selected before the search, to go back to if it is cancelled
+        const char* startPath;
+
+} ImmySearch_t;
+
 typedef struct ImmyControl {
 
         // these are updated on every frame
@@ -234,22 +331,37 @@ typedef struct ImmyControl {
         int selected_index; // index of selected_image from image_files
 
         ImmyImage_t* selected_image; // the selected image;
-                                     // points to the image_files;
+                                     // points into image_files.images
+
+        ImmyMessage_t message;     // message to show to the user
+        ImmyCatalog_t image_files; // images files loaded or not
+        ImmyConfig_t  config;      // runtime settings
 
-        ImmyMessage_t   message;     // message to show to the user
-        dImmyImageArr_t image_files; // images files loaded or not
-        ImmyConfig_t    config;      // runtime settings
+        // bumped whenever images move in image_files,
+        // anything holding an ImmyImage_t* must find it again
+        size_t image_files_gen;
+        int    image_group; // group of the newest images
 
         // for keeping state on the keybinds page
         size_t keybindPageScroll;
         size_t thumbPageScroll;
 
+        // for the thumbnail page
+        int thumbCellSize; // size of a cell on screen
+        int thumbLevel;    // thumbnail level used for the cells
+
         // which screen the user is on
         UIScreen_t screen;
 
         // function used for filename comparison
         StrCompare_t filename_cmp;
 
+        // the search prompt
+        ImmySearch_t search;
+
+        // used by kb_Dither
+        DitherKernel_t ditherKernel;
+
 } ImmyControl_t;
 
 ///
@@ -293,8 +405,20 @@ bool iEndsWith(const char *str, const char *suffix, bool ignorecase);
 // Gets the cache directory
 const char* iGetCacheDirectory();
 
-// Gets the cache location for the given file path.
-char* iGetCachedPath(const char* path);
+// Copies the path into the path pool, the copy lives until iFreePathPool.
+// Only call from the main thread. Returns NULL if the pool cannot grow.
+char* iInternPath(const char* path);
+
+// Frees every interned path at once.
+void iFreePathPool();
+
+// Hashes the absolute path of the file, hash must fit 32 bytes.
+// Returns false if the file does not exist.
+bool iGetPathHash(const char* path, unsigned char* hash);
+
+// Gets the cache location of the given thumbnail level for the file path.
+// Returns NULL if the file does not exist.
+char* iGetCachedPath(const char* path, int size);
 
 ///
 /// Image Functions
@@ -331,31 +455,82 @@ bool iGetOrCreateThumbEx(ImmyImage_t* im, bool createOnly);
 bool iSaveThumbnail(const ImmyImage_t* im);
 
 // Save a thumbnail at the given path.
+// The thumbnail is written to a temporary file which is renamed over the path.
 bool iSaveThumbnailAt(const ImmyImage_t* im, const char* path);
 
+// Returns true if the cached thumbnail exists and is not older than the image.
+bool iIsThumbCacheValid(const char* path, const char* cachePath);
+
+// Computes the placeholder colors of a thumbnail.
+bool iMakeThumbPlaceholder(const Image* thumb, ThumbPlaceholder_t* ph);
+
+// Computes the placeholder for the thumbnail and appends it to the cache index.
+bool iAddThumbPlaceholder(const char* path, const Image* thumb);
+
+// Looks up the placeholder of the image in the cache index.
+// Returns false if there is none, the image changed since it was made or the index is still being read.
+bool iGetThumbPlaceholder(const char* path, ThumbPlaceholder_t* ph);
+
+// Queues a lookup of the placeholder of the image on the cache index thread, path must be interned.
+void iRequestThumbPlaceholder(const char* path);
+
+// Gets the result of iRequestThumbPlaceholder, ph is filled when it returns IMAGE_STATUS_LOADED.
+// Returns IMAGE_STATUS_NOT_LOADED if the image should be requested, either for the first time
+// or because the index has gained records since it was not found.
+ImageLoadStatus_t iPollThumbPlaceholder(const char* path, ThumbPlaceholder_t* ph);
+
 // Saves a Raylib image in the QOI format.
 bool iSaveQOI(Image image, const char* path);
 
 // Sets the image to this index if possible
 void iSetImage(ImmyControl_t* ctrl, size_t index);
 
+// Returns true while the selection is changing faster than anything could be decoded.
+// Only previews are shown then, the image is decoded once the selection stays put for SCRUB_SETTLE_TIME.
+bool iIsScrubbing();
+
 // Append an image to the array.
 // Return the new image index or -1 if there is an error.
 int iAddImage(ImmyControl_t* ctrl, const char* path_);
 
+// Sorts the paths and merges them into the array under the given group.
+// Takes ownership of the path strings but not the array, they are interned and freed.
+// Returns the number of images added.
+size_t iAddImages(ImmyControl_t* ctrl, char** paths, size_t count, int group);
+
 // Create a thumbnail image from the given image into the other given image.
 bool iCreateThumbnail(const Image* image, Image* newimage, int newWidth, int newHeight);
 
-// Apply a black and white floyd steinburg dither to the image.
-void iDitherImage(ImmyImage_t* im);
+// Gets the smallest thumbnail level which is at least size, or the largest level.
+int iGetThumbLevel(int size);
+
+// Gets the thumbnail level wanted for the image.
+int iGetImageThumbLevel(const ImmyImage_t* im);
+
+// Gets the size of the nth thumbnail level.
+int iGetThumbLevelSize(int n);
+
+// Creates a thumbnail for every level, levels must hold THUMB_LEVEL_COUNT images.
+// Only the largest level is made from the image, each smaller level is made from the one above it.
+bool iCreateThumbLevels(const Image* image, Image* levels);
+
+// Changes the thumbnail level of every image.
+// Thumbnails made for another level are unloaded.
+void iSetThumbLevel(ImmyControl_t* ctrl, int level);
 
 ///
 /// IO Functions
 ///
 
 bool iCreateDirectory(const char* path);
+
+// Forks into the background. The parent stays until iSignalStartupDone,
+// so scripts can remove the file once immy exits.
 void iDetachFromTerminal();
 
+// Lets the parent left by iDetachFromTerminal exit, the first image has been read.
+void iSignalStartupDone();
+
 ///
 /// Logging Functions
 ///
@@ -366,6 +541,10 @@ void iLog(LogLevel_t level, FILE* stream, const char* fmt, ...);
 // Log function to replace the Raylib log function.
 void iLogRaylib(int msgType, const char* text, va_list args);
 
+// Seconds from a monotonic clock.
+// Unlike Raylib's GetTime this works before the window exists and from any thread.
+double iGetTime();
+
 ///
 /// To String Functions
 ///
@@ -382,6 +561,12 @@ const char* iMouseToStr(int key);
 // Gets a pretty name for the TextureFilter.
 const char* iInterpolationToStr(TextureFilter tf);
 
+// Gets a pretty name for the sort order.
+const char* iSortOrderToStr(StrCompare_t order);
+
+// Gets a pretty name for the dither kernel.
+const char* iDitherKernelToStr(DitherKernel_t kernel);
+
 ///
 /// Clipboard Functions
 ///
@@ -394,8 +579,140 @@ bool iCopyImageToClipboard(ImmyImage_t* im);
 int iPasteImageFromClipboard(ImmyControl_t* ctrl);
 
 // Return a resized copy of the image using nearest neighbour algorithm.
+// Uncompressed formats keep their format.
 bool iCopyAndResizeImageNN(const Image* image, Image* newimage, int newWidth, int newHeight);
 
+///
+/// Resize Functions
+///
+
+// Return a resized copy of the image by averaging every source pixel under each output pixel.
+// 8 bit formats keep their format, anything else is resized as R8G8B8A8.
+// If gamma is true the average is done in linear light, alpha is always linear.
+bool iCopyAndResizeImageBox(const Image* image, Image* newimage, int newWidth, int newHeight, bool gamma);
+
+///
+/// Channel Functions
+///
+
+// Narrows an 8 bit image to the fewest channels its pixels need, in place.
+// Grayscale pixels become GRAYSCALE or GRAY_ALPHA, and opaque ones drop their alpha.
+// If mayHaveAlpha is false the loader said there is no alpha, so it is dropped without looking.
+// Returns true if the format changed.
+bool iPackImageChannels(Image* image, bool mayHaveAlpha);
+
+///
+/// Proxy Functions
+///
+
+// Sets the longest side of proxy images, 0 turns them off.
+void iSetProxySize(int size);
+
+// Returns true if an image this big is shown through a proxy.
+bool iWantsProxy(int width, int height);
+
+// Replaces the decoded image with a proxy if it wants one, srcRect must already hold the full size.
+// This is thread-safe so it can run on the loading thread.
+bool iMakeProxy(ImmyImage_t* im);
+
+// Starts loading the full image behind a proxy.
+// Returns true once the full image has replaced the proxy, if wait is true this blocks until then.
+// If the full image cannot be loaded the proxy stays, and this returns false until the image is loaded again.
+bool iPromoteImage(ImmyImage_t* im, bool wait);
+
+// Swaps a full image back to a proxy once it is no longer shown.
+// Edited images are kept, since their pixels cannot be loaded again.
+bool iDemoteImage(ImmyImage_t* im);
+
+///
+/// Residency Functions
+///
+
+// Keeps the decoded images within RESIDENT_RAW_BUDGET, the least recently shown are compressed first.
+// Compressed copies past RESIDENT_PACKED_BUDGET are dropped, unless they hold edits. Call once per frame.
+void iUpdateResidency(ImmyControl_t* ctrl);
+
+// Decodes the compressed copy of the image, path must be the interned path.
+// srcRect, isProxy and isEdited are restored with the pixels. This is thread-safe.
+// Returns false if the image has no compressed copy.
+bool iUnpackImage(const char* path, ImmyImage_t* im);
+
+// Stops the compression thread and frees every compressed copy.
+void iResidencyDeinit();
+
+///
+/// Animation Functions
+///
+
+// Plays the selected image if it is animated, frames are decoded on a thread into a small ring.
+// Frames are shown on time, ones which are over before they could be shown are skipped. Call once per frame.
+void iUpdateAnimation(ImmyControl_t* ctrl);
+
+// Gets the texture holding the current frame of the image.
+// Returns false if the image is not playing, its decoded first frame is shown then.
+bool iGetAnimationTexture(const ImmyImage_t* im, Texture2D* texture);
+
+// Stops the playing animation and frees its frames.
+void iAnimationDeinit();
+
+///
+/// Flipbook Functions
+///
+
+// Plays the run of numbered frames around the selected image, like shot_0001.exr to shot_0240.exr.
+// Frames are decoded ahead on worker threads, nearest deadline first. Returns false if there is no run.
+bool iStartFlipbook(ImmyControl_t* ctrl);
+
+// Stops playback, the frame that was showing is selected. ctrl may be NULL to only stop.
+void iStopFlipbook(ImmyControl_t* ctrl);
+
+// Returns true while a sequence is playing.
+bool iFlipbookPlaying();
+
+// Shows the frame that is due, counting frames which were late or never shown. Call once per frame.
+void iUpdateFlipbook(ImmyControl_t* ctrl);
+
+// Gets the texture holding the frame shown over the image playback was started from.
+// Returns false if it is not playing.
+bool iGetFlipbookTexture(const ImmyImage_t* im, Texture2D* texture);
+
+// Gets a line describing the playback for the info bar, NULL if it is not playing.
+const char* iFlipbookStatus();
+
+///
+/// Catalog Functions
+///
+
+// Makes room for at least length images in every column, the new entries are not set.
+// The images may move, so ImmyImage_t pointers into the catalog must be found again after.
+bool iCatalogReserve(ImmyCatalog_t* cat, size_t length);
+
+// Sets entry i to an image which is not loaded yet, the path must already be interned.
+void iCatalogSetNew(ImmyCatalog_t* cat, size_t i, char* path, int group, int thumbLevel);
+
+// Copies entry from over entry to in every column.
+void iCatalogMove(ImmyCatalog_t* cat, size_t to, size_t from);
+
+// Reorders the catalog so entry i is what entry order[i] was.
+bool iCatalogPermute(ImmyCatalog_t* cat, const size_t* order);
+
+// Frees the columns, the pixels of the images must already be unloaded.
+void iCatalogFree(ImmyCatalog_t* cat);
+
+///
+/// Thread Functions
+///
+
+// A function run by iParallelFor over the range [begin, end).
+typedef void iParallelFunc_t(size_t begin, size_t end, void* arg);
+
+// Gets the number of online CPUs, always at least 1.
+int iGetCPUCount();
+
+// Splits [0, count) into contiguous chunks and runs them across threads.
+// Returns once every chunk is done. maxThreads <= 0 means use every CPU.
+void iParallelFor(size_t count, iParallelFunc_t* func, void* arg, int maxThreads);
+
 ///
 /// Async Functions
 ///
@@ -411,12 +728,163 @@ bool iAsyncHasImage(const ImmyImage_t* im);
 // Returns true if the image is done loading.
 bool iGetImageAsync(ImmyImage_t* im);
 
+// Copies the rows of the image decoded so far into texture, making it the first time.
+// Only the rows decoded since the last call are uploaded, texture must only be used for this image.
+// Returns false if the image is not loading or no rows are decoded yet.
+bool iGetImageAsyncProgress(const ImmyImage_t* im, Texture2D* texture);
+
+// Blocks until the image from iLoadImageAsync is done and gets it.
+// Returns false if the image is not loading.
+bool iWaitImageAsync(ImmyImage_t* im);
+
+// Queue a copy of the thumbnail to be saved in the cache.
+// The encode and write happen on a low priority thread.
+// A save of the same file still waiting is given the new pixels, returns false if the queue is full.
+bool iQueueThumbnailSave(const ImmyImage_t* im);
+
+// Blocks until every queued thumbnail has been saved.
+void iFlushThumbnailSaves();
+
+// Loads an image without touching anything that is not thread-safe.
+// Returns true if the image is ready.
+bool iLoadImageThreadSafe(const char* path, Image* image);
+
+///
+/// Dither Functions
+///
+
+// Starts a black and white dither of a copy of the image on worker threads.
+// Only one runs at a time, returns false if one is running or the image cannot be dithered.
+bool iDitherImageAsync(ImmyImage_t* im, DitherKernel_t kernel);
+
+// Gets how far the dither of the image is from 0 to 1.
+// Returns a negative number if the image is not being dithered, NULL matches any image.
+float iDitherProgress(const ImmyImage_t* im);
+
+// Swaps the finished dither into its image. Call once per frame.
+void iUpdateDither(ImmyControl_t* ctrl);
+
+// Stops the running dither and waits for its threads.
+void iDitherDeinit();
+
+///
+/// Sort Functions
+///
+
+// Compares two paths in the given order, the same way iSortPaths sorts them.
+int iComparePaths(const char* a, const char* b, StrCompare_t order);
+
+// Sorts the paths in the given order.
+// Each path gets a key once, made so that memcmp gives the order, big lists are sorted on several threads.
+bool iSortPaths(char** paths, size_t count, StrCompare_t order);
+
+// Sorts the images by group then path using ctrl->filename_cmp.
+// The metadata orders sort by the metadata value before the path.
+// The selected image stays selected.
+bool iSortImages(ImmyControl_t* ctrl);
+
+///
+/// Metadata Functions
+///
+
+// Returns true if the order sorts by metadata instead of only the path.
+bool iSortOrderNeedsMeta(StrCompare_t order);
+
+// Gets the order used for the path, which breaks ties in the metadata orders.
+StrCompare_t iGetPathOrder(StrCompare_t order);
+
+// Gets the value entry i of the catalog is sorted by before its path, SORT_VALUE_UNKNOWN without metadata.
+int64_t iGetImageSortValue(const ImmyCatalog_t* cat, size_t i, StrCompare_t order);
+
+// Reads the size and capture date from the header of the image without decoding it.
+// Fills width, height and taken, returns false if the format is not known.
+bool iProbeImageHeader(const char* path, ImageMeta_t* meta);
+
+// Probes every path like iProbeImageHeader on up to threads threads, the sizes come from il2ProbeBatch.
+// Returns the number of images whose size is known.
+size_t iProbeImageHeaders(const char* const* paths, size_t count, ImageMeta_t* metas, int threads);
+
+// Gets the metadata of the file, from the cache of its directory if the file did not change.
+// Thread-safe, returns false if the file cannot be stat'd.
+bool iGetFileMeta(const char* path, ImageMeta_t* meta);
+
+// Applies finished metadata to the images and starts gathering for new images without blocking.
+// Does nothing unless ctrl->filename_cmp needs metadata.
+// Returns true if metadata was applied and the images should be sorted again.
+bool iGatherImageMeta(ImmyControl_t* ctrl);
+
+///
+/// Search Functions
+///
+
+// Indexes images added since the last call on a background thread, call every frame.
+void iUpdateSearchIndex(const ImmyControl_t* ctrl);
+
+// Changes whenever the index changes, results made with an older version may be stale.
+size_t iSearchVersion();
+
+// Finds the images whose name fuzzily matches the query, best first.
+// Writes the indices of up to max images into results and returns the number of matches.
+size_t iSearchImages(const ImmyControl_t* ctrl, const char* query, dIntArr_t* results, size_t max);
+
+// Waits for the index thread and frees the index.
+void iSearchDeinit();
+
+// Opens the search prompt, it takes the keyboard until closed.
+void iSearchOpen(ImmyControl_t* ctrl);
+
+// Closes the search prompt, going back to the image selected before unless keepSelection.
+void iSearchClose(ImmyControl_t* ctrl, bool keepSelection);
+
+// Searches for the query and selects the best match.
+void iSearchSetQuery(ImmyControl_t* ctrl, const char* query);
+
+// Searches again if the index changed since the results were made.
+void iSearchRefresh(ImmyControl_t* ctrl);
+
+// Selects the result by places after the current one, wrapping around.
+void iSearchMove(ImmyControl_t* ctrl, int by);
+
+///
+/// Scan Functions
+///
+
+// Paths found in one directory by the scanner.
+typedef struct ScanBatch {
+        char**            paths;
+        size_t            count;
+        int               group;
+        struct ScanBatch* next;
+} ScanBatch_t;
+
+// Starts walking the directory on the scanner threads.
+// Images found are handed out in batches by iScanTakeBatches.
+bool iScanDirectory(const char* path, int group, bool recursive);
+
+// Returns true while any directory is still being walked or a batch is waiting.
+bool iScanIsRunning();
+
+// Takes every batch found so far, or NULL if there is none.
+ScanBatch_t* iScanTakeBatches();
+
+// Frees the batch but not the path strings, those are given to iAddImages.
+void iScanFreeBatch(ScanBatch_t* batch);
+
+///
+/// Headless Functions
+///
+
+// Fills the thumbnail cache for the given files and directories without a window.
+// Prints the throughput when done and returns the exit code.
+int iPregenThumbnails(int argc, char* argv[]);
+
 ///
 /// Platform Specific Stuff
 ///
 
 #ifdef __unix__
 bool uDetachFromTerminal();
+void uSignalStartupDone();
 #endif
 
 #ifdef _WIN32
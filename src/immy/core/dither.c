@@ -0,0 +1,389 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+// luminance is kept as 8.4 fixed point so small errors still add up
+#define LUM_SHIFT 4
+#define LUM_WHITE (255 << LUM_SHIFT)
+#define LUM_HALF (128 << LUM_SHIFT)
+
+// grayscale weights out of 4096, the 8 extra bits are shifted back down to 8.4
+#define LUM_R ((int)(GRAYSCALE_COEF_R * 4096 + 0.5))
+#define LUM_G ((int)(GRAYSCALE_COEF_G * 4096 + 0.5))
+#define LUM_B ((int)(GRAYSCALE_COEF_B * 4096 + 0.5))
+
+// the widest kernel reaches 2 pixels sideways and 2 rows down,
+// the plane is padded by that much so taps never need a bounds check
+#define DITHER_PAD 2
+
+// columns done between looking at the row above, smaller keeps threads closer together
+#define DITHER_ROW_CHUNK 256
+
+// An error diffusion tap, the pixel at (dx, dy) gets weight / divisor of the error.
+typedef struct {
+        int dx;
+        int dy;
+        int weight;
+} DitherTap_t;
+
+typedef struct {
+        const DitherTap_t* taps;
+        int                tapCount;
+        int                scale; // 65536 / divisor, so dividing is a multiply and shift
+        int                reach; // largest dx
+} DitherKernelInfo_t;
+
+static const DitherTap_t floydSteinbergTaps[] = {
+    {1, 0, 7},
+    {-1, 1, 3},
+    {0, 1, 5},
+    {1, 1, 1},
+};
+
+static const DitherTap_t atkinsonTaps[] = {
+    {1, 0, 1},
+    {2, 0, 1},
+    {-1, 1, 1},
+    {0, 1, 1},
+    {1, 1, 1},
+    {0, 2, 1},
+};
+
+static const DitherTap_t stuckiTaps[] = {
+    {1, 0, 8},
+    {2, 0, 4},
+    {-2, 1, 2},
+    {-1, 1, 4},
+    {0, 1, 8},
+    {1, 1, 4},
+    {2, 1, 2},
+    {-2, 2, 1},
+    {-1, 2, 2},
+    {0, 2, 4},
+    {1, 2, 2},
+    {2, 2, 1},
+};
+
+static const DitherKernelInfo_t floydSteinberg = {floydSteinbergTaps, 4, 65536 / 16, 1};
+static const DitherKernelInfo_t atkinson       = {atkinsonTaps, 6, 65536 / 8, 2};
+static const DitherKernelInfo_t stucki         = {stuckiTaps, 12, 65536 / 42, 2};
+
+typedef struct {
+
+        // identifies the image, paths live until exit
+        const char* path;
+
+        Image           source; // copy of the image taken on the main thread
+        Image           result;
+        DitherKernel_t  kernel;
+        pthread_t       thread;
+        int             threads;
+        int16_t*        plane;   // padded luminance with the error added in
+        size_t          stride;  // plane row length
+        Color*          pixels;  // written black or white as rows finish
+        atomic_int*     columns; // columns finished in each row
+        atomic_int      nextRow;
+        atomic_int      rowsDone;
+        atomic_bool     done;
+        atomic_bool     cancel;
+
+} DitherJob_t;
+
+static DitherJob_t* job = NULL;
+
+static void build_plane_rows(size_t begin, size_t end, void* arg) {
+
+    DitherJob_t* j = arg;
+    int          w = j->source.width;
+
+    for (size_t y = begin; y < end; y++) {
+
+        const Color* src = j->pixels + y * w;
+        int16_t*     dst = j->plane + y * j->stride + DITHER_PAD;
+
+        // no branches or floats, this vectorizes
+        for (int x = 0; x < w; x++)
+            dst[x] = (src[x].r * LUM_R + src[x].g * LUM_G + src[x].b * LUM_B) >> (12 - LUM_SHIFT);
+    }
+}
+
+// Waits until the row above has finished every pixel this chunk reads or writes around.
+static bool wait_for_row(DitherJob_t* j, int y, int needed) {
+
+    if (y == 0)
+        return true;
+
+    while (atomic_load_explicit(j->columns + y - 1, memory_order_acquire) < needed) {
+
+        if (atomic_load_explicit(&j->cancel, memory_order_relaxed))
+            return false;
+
+        sched_yield();
+    }
+
+    return true;
+}
+
+// Diffuses rows handed out in order, each row trails the one above by twice the kernel reach.
+// Always inlined so the tap loop is unrolled for each kernel.
+static inline __attribute__((always_inline)) void
+diffuse_rows(DitherJob_t* j, const DitherKernelInfo_t* k) {
+
+    const int       w      = j->source.width;
+    const int       h      = j->source.height;
+    const ptrdiff_t stride = j->stride;
+
+    for (int y; (y = atomic_fetch_add(&j->nextRow, 1)) < h;) {
+
+        int16_t* row = j->plane + y * stride + DITHER_PAD;
+        Color*   out = j->pixels + (size_t)y * w;
+
+        for (int x0 = 0; x0 < w; x0 += DITHER_ROW_CHUNK) {
+
+            int x1 = MIN(w, x0 + DITHER_ROW_CHUNK);
+
+            if (!wait_for_row(j, y, MIN(w, x1 + 2 * k->reach)))
+                return;
+
+            for (int x = x0; x < x1; x++) {
+
+                int v   = row[x];
+                int lum = v >= LUM_HALF ? LUM_WHITE : 0;
+                int err = v - lum;
+
+                for (int t = 0; t < k->tapCount; t++)
+                    row[x + k->taps[t].dx + k->taps[t].dy * stride] += (err * k->taps[t].weight * k->scale) >> 16;
+
+                unsigned char c = lum ? 255 : 0;
+
+                out[x] = (Color){c, c, c, out[x].a};
+            }
+
+            atomic_store_explicit(j->columns + y, x1, memory_order_release);
+        }
+
+        atomic_fetch_add(&j->rowsDone, 1);
+    }
+}
+
+// The rows are handed out by the job, not by the range.
+static void diffuse_floyd_steinberg(size_t begin, size_t end, void* arg) {
+
+    (void)begin;
+    (void)end;
+
+    diffuse_rows(arg, &floydSteinberg);
+}
+
+static void diffuse_atkinson(size_t begin, size_t end, void* arg) {
+
+    (void)begin;
+    (void)end;
+
+    diffuse_rows(arg, &atkinson);
+}
+
+static void diffuse_stucki(size_t begin, size_t end, void* arg) {
+
+    (void)begin;
+    (void)end;
+
+    diffuse_rows(arg, &stucki);
+}
+
+static void* dither_thread_main(void* raw_arg) {
+
+    DitherJob_t* j = raw_arg;
+    int          w = j->source.width;
+    int          h = j->source.height;
+
+    if (j->source.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+
+        j->pixels      = j->source.data;
+        j->source.data = NULL;
+
+    } else {
+
+        j->pixels = LoadImageColors(j->source);
+    }
+
+    UnloadImage(j->source);
+
+    j->stride  = w + DITHER_PAD * 2;
+    j->plane   = calloc(j->stride * (h + DITHER_PAD), sizeof(int16_t));
+    j->columns = calloc(h, sizeof(atomic_int));
+
+    if (j->pixels == NULL || j->plane == NULL || j->columns == NULL) {
+
+        L_E("%s: Cannot allocate the buffers for a %dx%d dither", __func__, w, h);
+
+        RL_FREE(j->pixels);
+
+        j->pixels = NULL;
+
+        goto done;
+    }
+
+    iParallelFor(h, build_plane_rows, j, j->threads);
+
+    iParallelFunc_t* diffuse = diffuse_floyd_steinberg;
+
+    if (j->kernel == DITHER_ATKINSON)
+        diffuse = diffuse_atkinson;
+    else if (j->kernel == DITHER_STUCKI)
+        diffuse = diffuse_stucki;
+
+    // one item per worker, the rows are handed out inside
+    iParallelFor(j->threads, diffuse, j, j->threads);
+
+    if (atomic_load(&j->cancel)) {
+
+        RL_FREE(j->pixels);
+
+        j->pixels = NULL;
+
+        goto done;
+    }
+
+    j->result = (Image){
+        .data    = j->pixels,
+        .width   = w,
+        .height  = h,
+        .mipmaps = 1,
+        .format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    j->pixels = NULL;
+
+    // give the image back in the format the texture was made with
+    if (j->source.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+        ImageFormat(&j->result, j->source.format);
+
+done:
+
+    free(j->plane);
+    free(j->columns);
+
+    j->plane   = NULL;
+    j->columns = NULL;
+
+    atomic_store(&j->done, true);
+
+    return NULL;
+}
+
+static void free_job() {
+
+    pthread_join(job->thread, NULL);
+
+    UnloadImage(job->result);
+
+    free(job);
+
+    job = NULL;
+}
+
+bool iDitherImageAsync(ImmyImage_t* im, DitherKernel_t kernel) {
+
+    if (job != NULL || im->state->status != IMAGE_STATUS_LOADED)
+        return false;
+
+    if (im->rayim.format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+        return false;
+
+    DitherJob_t* j = calloc(1, sizeof(DitherJob_t));
+
+    if (j == NULL)
+        return false;
+
+    j->path    = im->path;
+    j->kernel  = kernel;
+    j->threads = DITHER_MAX_THREADS > 0 ? DITHER_MAX_THREADS : iGetCPUCount();
+
+    // a plain copy, the conversion to colors happens on the thread
+    j->source = ImageCopy(im->rayim);
+
+    if (!IsImageReady(j->source) || pthread_create(&j->thread, NULL, dither_thread_main, j) != 0) {
+
+        L_E("%s: Cannot start dithering %s", __func__, im->path);
+
+        UnloadImage(j->source);
+
+        free(j);
+
+        return false;
+    }
+
+    job = j;
+
+    return true;
+}
+
+float iDitherProgress(const ImmyImage_t* im) {
+
+    if (job == NULL || (im != NULL && im->path != job->path))
+        return -1;
+
+    return (float)atomic_load(&job->rowsDone) / job->source.height;
+}
+
+void iUpdateDither(ImmyControl_t* ctrl) {
+
+    if (job == NULL)
+        return;
+
+    // keep drawing so the progress moves
+    ctrl->renderFrames = RENDER_FRAMES;
+
+    if (!atomic_load(&job->done))
+        return;
+
+    ImmyImage_t* im = ctrl->selected_image;
+
+    if (im == NULL || im->path != job->path) {
+
+        im = NULL;
+
+        DARRAY_FOR_EACH(ctrl->image_files, i) {
+
+            if (ctrl->image_files.paths[i] == job->path) {
+
+                im = ctrl->image_files.images + i;
+
+                break;
+            }
+        }
+    }
+
+    // the image may have been unloaded or flipped to another size while this ran
+    if (im != NULL && im->state->status == IMAGE_STATUS_LOADED && IsImageReady(job->result) &&
+        im->rayim.width == job->result.width && im->rayim.height == job->result.height) {
+
+        RL_FREE(im->rayim.data);
+
+        im->rayim       = job->result;
+        im->rebuildBuff = 1;
+        job->result     = (Image){0};
+    }
+
+    free_job();
+}
+
+void iDitherDeinit() {
+
+    if (job == NULL)
+        return;
+
+    atomic_store(&job->cancel, true);
+
+    free_job();
+}
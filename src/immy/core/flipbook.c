@@ -0,0 +1,486 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+// weight of the newest decode in the running decode time
+#define DECODE_TIME_WEIGHT 0.2
+
+// A decoded frame, or one being decoded.
+typedef struct {
+        int   frame; // index into the sequence, -1 if the slot is free
+        bool  ready; // decoded, a frame which failed to decode is ready with no data
+        Image image;
+} FlipSlot_t;
+
+typedef struct {
+
+        // the frames in order, paths live until exit
+        const char** paths;
+        int          count;
+        int          first; // the frame playback was started from
+        double       fps;
+
+        // the image playback was started from, stops when another is selected
+        const char* owner;
+
+        pthread_t thread;
+        int       threads;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t  cond; // signaled when the playhead moves or a frame is decoded
+
+        // everything below is guarded by the mutex
+        FlipSlot_t* slots;
+        int         slotCount;  // also how many frames are decoded ahead
+        int         playhead;   // frame being shown
+        double      playheadAt; // when it was due
+        double      decodeTime; // running average of one decode in seconds
+        bool        cancel;
+
+        // only touched by the main thread
+        Texture2D texture;
+        double    start;
+        long      tick;      // frames since start, -1 until the first frame is decoded
+        bool      tickShown; // the frame of this tick made it to the screen
+        bool      tickLate;  // the frame of this tick was not decoded when it was due
+        int       shownFrame;
+        size_t    shown;
+        size_t    dropped;
+        size_t    late;
+
+} Flipbook_t;
+
+static Flipbook_t* book = NULL;
+
+// Finds the number right before the extension of a name like shot_0042.exr.
+// Returns false if there is none, prefix is the length before it and digits its length.
+static bool split_frame_name(const char* name, size_t* prefix, size_t* digits) {
+
+    const char* dot = strrchr(name, '.');
+    const char* end = dot != NULL ? dot : name + strlen(name);
+    const char* p   = end;
+
+    while (p > name && p[-1] >= '0' && p[-1] <= '9')
+        p--;
+
+    *prefix = p - name;
+    *digits = end - p;
+
+    return *digits > 0;
+}
+
+// Returns true if images a and b of the catalog are numbered frames of the same sequence in the same directory.
+static bool same_sequence(const ImmyCatalog_t* cat, size_t a, size_t b) {
+
+    const char* nameA = cat->names[a];
+    const char* nameB = cat->names[b];
+
+    size_t dirA = nameA - cat->paths[a];
+    size_t dirB = nameB - cat->paths[b];
+
+    if (dirA != dirB || memcmp(cat->paths[a], cat->paths[b], dirA) != 0)
+        return false;
+
+    size_t prefixA, digitsA, prefixB, digitsB;
+
+    if (!split_frame_name(nameA, &prefixA, &digitsA) || !split_frame_name(nameB, &prefixB, &digitsB))
+        return false;
+
+    return prefixA == prefixB && memcmp(nameA, nameB, prefixA) == 0 &&
+           strcmp(nameA + prefixA + digitsA, nameB + prefixB + digitsB) == 0;
+}
+
+// frames ahead of the playhead, wrapping around the end
+static int frames_ahead(const Flipbook_t* fb, int frame) {
+
+    return (frame - fb->playhead + fb->count) % fb->count;
+}
+
+static int find_slot(const Flipbook_t* fb, int frame) {
+
+    for (int i = 0; i < fb->slotCount; i++) {
+
+        if (fb->slots[i].frame == frame)
+            return i;
+    }
+
+    return -1;
+}
+
+// Picks the frame with the nearest deadline which can still make it.
+// Frames which would be decoded after their time on screen is over are left for the playhead to skip.
+// Returns -1 if every frame in the window is decoded or being decoded.
+static int pick_frame(const Flipbook_t* fb, double now) {
+
+    int fallback = -1;
+
+    for (int k = 0; k < fb->slotCount; k++) {
+
+        int frame = (fb->playhead + k) % fb->count;
+
+        if (find_slot(fb, frame) >= 0)
+            continue;
+
+        if (now + fb->decodeTime <= fb->playheadAt + (k + 1) / fb->fps)
+            return frame;
+
+        // nothing can make it, the furthest frame is the most likely to
+        fallback = frame;
+    }
+
+    return fallback;
+}
+
+// A slot is free once its frame falls behind the playhead.
+static int free_slot(const Flipbook_t* fb) {
+
+    for (int i = 0; i < fb->slotCount; i++) {
+
+        const FlipSlot_t* s = fb->slots + i;
+
+        if (s->frame < 0 || (s->ready && frames_ahead(fb, s->frame) >= fb->slotCount))
+            return i;
+    }
+
+    return -1;
+}
+
+// Run by every worker, frames are handed out one at a time until playback stops.
+static void decode_frames(size_t begin, size_t end, void* arg) {
+
+    (void)begin;
+    (void)end;
+
+    Flipbook_t* fb = arg;
+
+    pthread_mutex_lock(&fb->mutex);
+
+    while (!fb->cancel) {
+
+        int frame = pick_frame(fb, iGetTime());
+        int slot  = frame >= 0 ? free_slot(fb) : -1;
+
+        if (slot < 0) {
+
+            pthread_cond_wait(&fb->cond, &fb->mutex);
+
+            continue;
+        }
+
+        FlipSlot_t* s   = fb->slots + slot;
+        Image       old = s->image;
+
+        s->frame = frame;
+        s->ready = false;
+        s->image = (Image){0};
+
+        pthread_mutex_unlock(&fb->mutex);
+
+        UnloadImage(old);
+
+        double start = iGetTime();
+        Image  image;
+
+        if (!iLoadImageThreadSafe(fb->paths[frame], &image))
+            L_W("%s: Could not load frame %d %s", __func__, frame, fb->paths[frame]);
+
+        double took = iGetTime() - start;
+
+        pthread_mutex_lock(&fb->mutex);
+
+        s->image = image;
+        s->ready = true;
+
+        fb->decodeTime = fb->decodeTime == 0 ? took : fb->decodeTime + (took - fb->decodeTime) * DECODE_TIME_WEIGHT;
+
+        pthread_cond_broadcast(&fb->cond);
+    }
+
+    pthread_mutex_unlock(&fb->mutex);
+}
+
+static void* flipbook_thread_main(void* raw_arg) {
+
+    Flipbook_t* fb = raw_arg;
+
+    // one item per worker, the frames are handed out inside
+    iParallelFor(fb->threads, decode_frames, fb, fb->threads);
+
+    return NULL;
+}
+
+static void free_book() {
+
+    for (int i = 0; i < book->slotCount; i++)
+        UnloadImage(book->slots[i].image);
+
+    if (IsTextureReady(book->texture))
+        UnloadTexture(book->texture);
+
+    pthread_mutex_destroy(&book->mutex);
+    pthread_cond_destroy(&book->cond);
+
+    free(book->slots);
+    free(book->paths);
+    free(book);
+
+    book = NULL;
+}
+
+bool iStartFlipbook(ImmyControl_t* ctrl) {
+
+    ImmyImage_t* im = ctrl->selected_image;
+
+    if (book != NULL || im == NULL)
+        return false;
+
+    // the run of frames around the selected image, in the order they are listed
+    size_t first = ctrl->selected_index;
+    size_t last  = ctrl->selected_index;
+
+    while (first > 0 && same_sequence(&ctrl->image_files, ctrl->selected_index, first - 1))
+        first--;
+
+    while (last + 1 < ctrl->image_files.size && same_sequence(&ctrl->image_files, ctrl->selected_index, last + 1))
+        last++;
+
+    int count = last - first + 1;
+
+    if (count < 2)
+        return false;
+
+    ImageMeta_t size = {.width = im->srcRect.width, .height = im->srcRect.height};
+
+    // the selected frame is not decoded yet, its header says how big the frames are
+    if (im->state->status != IMAGE_STATUS_LOADED && !iProbeImageHeader(im->path, &size)) {
+
+        L_W("%s: Cannot tell the frame size of %s", __func__, im->path);
+
+        return false;
+    }
+
+    Flipbook_t* fb = calloc(1, sizeof(Flipbook_t));
+
+    if (fb == NULL)
+        return false;
+
+    fb->paths = malloc(count * sizeof(const char*));
+
+    for (int i = 0; fb->paths != NULL && i < count; i++)
+        fb->paths[i] = ctrl->image_files.paths[first + i];
+
+    // sized for the selected frame as RGBA, the rest of the sequence should match it
+    size_t frameBytes = GetPixelDataSize(size.width, size.height, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    fb->count      = count;
+    fb->fps        = FLIPBOOK_FPS;
+    fb->owner      = im->path;
+    fb->threads    = FLIPBOOK_MAX_THREADS > 0 ? FLIPBOOK_MAX_THREADS : iGetCPUCount();
+    fb->slotCount  = MIN((size_t)count, MAX(2, FLIPBOOK_CACHE_BUDGET / MAX(1, frameBytes)));
+    fb->slots      = calloc(fb->slotCount, sizeof(FlipSlot_t));
+    fb->first      = ctrl->selected_index - first;
+    fb->playhead   = fb->first;
+    fb->playheadAt = iGetTime();
+    fb->shownFrame = fb->first;
+    fb->tick       = -1;
+
+    for (int i = 0; fb->slots != NULL && i < fb->slotCount; i++)
+        fb->slots[i].frame = -1;
+
+    pthread_mutex_init(&fb->mutex, NULL);
+    pthread_cond_init(&fb->cond, NULL);
+
+    book = fb;
+
+    if (fb->paths == NULL || fb->slots == NULL || pthread_create(&fb->thread, NULL, flipbook_thread_main, fb) != 0) {
+
+        L_E("%s: Cannot start playing %d frames", __func__, count);
+
+        free_book();
+
+        return false;
+    }
+
+    L_I("Playing %d frames at %.0f fps, %d decoded ahead on %d threads", count, fb->fps, fb->slotCount,
+        fb->threads);
+
+    return true;
+}
+
+void iStopFlipbook(ImmyControl_t* ctrl) {
+
+    if (book == NULL)
+        return;
+
+    pthread_mutex_lock(&book->mutex);
+
+    book->cancel = true;
+
+    pthread_cond_broadcast(&book->cond);
+    pthread_mutex_unlock(&book->mutex);
+
+    pthread_join(book->thread, NULL);
+
+    L_I("Flipbook showed %zu frames, dropped %zu, %zu were late", book->shown, book->dropped, book->late);
+
+    const char* path  = book->paths[book->shownFrame];
+    bool        moved = ctrl != NULL && ctrl->selected_image != NULL && ctrl->selected_image->path == book->owner &&
+                 path != book->owner;
+
+    free_book();
+
+    if (!moved)
+        return;
+
+    // stay on the frame that was showing
+    DARRAY_FOR_EACH(ctrl->image_files, i) {
+
+        if (ctrl->image_files.paths[i] == path) {
+
+            iSetImage(ctrl, i);
+
+            break;
+        }
+    }
+}
+
+bool iFlipbookPlaying() {
+
+    return book != NULL;
+}
+
+// Gets the frame at the playhead if it is decoded.
+static bool playhead_frame(Image* image) {
+
+    pthread_mutex_lock(&book->mutex);
+
+    int  slot  = find_slot(book, book->playhead);
+    bool ready = slot >= 0 && book->slots[slot].ready;
+
+    if (ready)
+        *image = book->slots[slot].image;
+
+    pthread_mutex_unlock(&book->mutex);
+
+    return ready;
+}
+
+static void move_playhead(int frame, double at) {
+
+    pthread_mutex_lock(&book->mutex);
+
+    book->playhead   = frame;
+    book->playheadAt = at;
+
+    pthread_cond_broadcast(&book->cond);
+    pthread_mutex_unlock(&book->mutex);
+}
+
+void iUpdateFlipbook(ImmyControl_t* ctrl) {
+
+    if (book == NULL)
+        return;
+
+    // selecting another image or leaving the screen stops playback where it is
+    if (ctrl->screen != SCREEN_IMAGE || ctrl->selected_image == NULL || ctrl->selected_image->path != book->owner) {
+
+        iStopFlipbook(NULL);
+
+        return;
+    }
+
+    ctrl->renderFrames = RENDER_FRAMES;
+
+    double now = iGetTime();
+    Image  image;
+
+    // the clock starts once the first frame is decoded, so waiting for it is not counted
+    if (book->tick < 0) {
+
+        if (!playhead_frame(&image))
+            return;
+
+        book->start = now;
+        book->tick  = 0;
+
+        move_playhead(book->playhead, now);
+    }
+
+    long tick = (now - book->start) * book->fps;
+
+    if (tick != book->tick) {
+
+        // the frame of the last tick never made it, and ticks this loop was too slow to see
+        book->dropped += !book->tickShown + (tick - book->tick - 1);
+
+        book->tick      = tick;
+        book->tickShown = false;
+        book->tickLate  = false;
+
+        move_playhead((book->first + tick) % book->count, book->start + tick / book->fps);
+    }
+
+    if (book->tickShown)
+        return;
+
+    if (!playhead_frame(&image)) {
+
+        book->late += !book->tickLate;
+        book->tickLate = true;
+
+        return;
+    }
+
+    // the slot is not reused until the playhead moves on, so the pixels stay while they upload
+    if (IsImageReady(image)) {
+
+        if (IsTextureReady(book->texture) &&
+            (book->texture.width != image.width || book->texture.height != image.height ||
+             book->texture.format != image.format)) {
+
+            UnloadTexture(book->texture);
+
+            book->texture = (Texture2D){0};
+        }
+
+        if (!IsTextureReady(book->texture))
+            book->texture = LoadTextureFromImage(image);
+        else
+            UpdateTexture(book->texture, image.data);
+
+        if (IsTextureReady(book->texture))
+            GenTextureMipmaps(&book->texture);
+    }
+
+    // the playhead only moves on this thread
+    book->shownFrame = book->playhead;
+    book->tickShown  = true;
+    book->shown++;
+}
+
+bool iGetFlipbookTexture(const ImmyImage_t* im, Texture2D* texture) {
+
+    if (book == NULL || book->owner != im->path || !IsTextureReady(book->texture))
+        return false;
+
+    *texture = book->texture;
+
+    return true;
+}
+
+const char* iFlipbookStatus() {
+
+    if (book == NULL)
+        return NULL;
+
+    double elapsed = iGetTime() - book->start;
+
+    return TextFormat("frame %d/%d  %.1f fps  %zu dropped  %zu late  %s", book->shownFrame + 1, book->count,
+                      elapsed > 0 ? book->shown / elapsed : 0, book->dropped, book->late,
+                      GetFileName(book->paths[book->shownFrame]));
+}
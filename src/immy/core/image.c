@@ -24,9 +24,12 @@
 
 bool iLoadImage(ImmyImage_t* im) {
 
-    if (im->status == IMAGE_STATUS_LOADED)
+    if (im->state->status == IMAGE_STATUS_LOADED)
         return true;
 
+    // only imylib2 says, the other loaders are checked
+    bool mayHaveAlpha = true;
+
 #ifdef IMYLIB2_H
 
     L_D("Using imylib2 to load image.");
@@ -40,6 +43,7 @@ bool iLoadImage(ImmyImage_t* im) {
         im->rayim.height = il2Image.h;
         im->rayim.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
         im->rayim.mipmaps = 1;
+        mayHaveAlpha = il2Image.has_alpha;
     }
     else
 
@@ -69,21 +73,28 @@ bool iLoadImage(ImmyImage_t* im) {
         // krita is low priority here
         !iLoadKritaImage(im->path, &im->rayim)) {
 
-        im->status = IMAGE_STATUS_FAILED;
+        im->state->status = IMAGE_STATUS_FAILED;
 
         L_W("Could not load image %s", im->path);
 
         return false;
     }
 
+#if PACK_IMAGE_CHANNELS
+    iPackImageChannels(&im->rayim, mayHaveAlpha);
+#endif
+
     im->srcRect = (Rectangle){
         0.0,
         0.0,
         im->rayim.width,
         im->rayim.height,
     };
-    im->dstPos = (Vector2){0, 0};
-    im->status = IMAGE_STATUS_LOADED;
+    im->dstPos        = (Vector2){0, 0};
+    im->state->status = IMAGE_STATUS_LOADED;
+    im->isProxy       = false;
+    im->isEdited      = false;
+    im->promoteFailed = false;
 
 #if GENERATE_THUMB_WHEN_LOADING_IMAGE
     iGetOrCreateThumb(im);
@@ -94,43 +105,103 @@ bool iLoadImage(ImmyImage_t* im) {
 
 bool iCreateThumbnail(const Image* im, Image* newim, int newW, int newH) {
 
-    double ratio;
-    bool   result;
-
+    // keep the aspect ratio, but never go below 1 pixel
     if (im->width > im->height) {
 
-        ratio = (double)im->height / im->width;
-
-        result = iCopyAndResizeImageNN(im, newim, newW, ratio * newH);
+        newH = MAX(1, (double)im->height / im->width * newH);
 
     } else {
 
-        ratio = (double)im->width / im->height;
-
-        result = iCopyAndResizeImageNN(im, newim, ratio * newW, newH);
+        newW = MAX(1, (double)im->width / im->height * newW);
     }
 
+#if LOG_THUMBNAIL_RESIZE_TIMES
+
+    Image  nn;
+    double start = iGetTime();
+
+    if (iCopyAndResizeImageNN(im, &nn, newW, newH))
+        UnloadImage(nn);
+
+    double nnTime = iGetTime() - start;
+
+    start = iGetTime();
+#endif
+
+    bool result = iCopyAndResizeImageBox(im, newim, newW, newH, THUMB_GAMMA_CORRECT);
+
+#if LOG_THUMBNAIL_RESIZE_TIMES
+
+    double boxTime = iGetTime() - start;
+
+    L_I("Thumbnail %dx%d -> %dx%d: nearest %.3fms, box %.3fms", im->width, im->height, newW, newH, nnTime * 1000,
+        boxTime * 1000);
+#endif
+
     if (!result)
         memset(newim, 0, sizeof(*newim));
 
     return result;
 }
 
+int iGetThumbLevelSize(int n) {
+
+    return THUMB_LEVEL_SMALLEST << n;
+}
+
+int iGetThumbLevel(int size) {
+
+    int level = THUMB_LEVEL_SMALLEST;
+
+    for (int i = 1; i < THUMB_LEVEL_COUNT && level < size; i++)
+        level = iGetThumbLevelSize(i);
+
+    return level;
+}
+
+bool iCreateThumbLevels(const Image* im, Image* levels) {
+
+    memset(levels, 0, sizeof(Image) * THUMB_LEVEL_COUNT);
+
+    const Image* from = im;
+
+    for (int i = THUMB_LEVEL_COUNT - 1; i >= 0; i--) {
+
+        int size = iGetThumbLevelSize(i);
+
+        if (!iCreateThumbnail(from, levels + i, size, size)) {
+
+            for (int j = i + 1; j < THUMB_LEVEL_COUNT; j++)
+                UnloadImage(levels[j]);
+
+            memset(levels, 0, sizeof(Image) * THUMB_LEVEL_COUNT);
+
+            return false;
+        }
+
+        from = levels + i;
+    }
+
+    return true;
+}
+
 // edited from the raylib ImageResizeNN function
 bool iCopyAndResizeImageNN(const Image* im, Image* newim, int newW, int newH) {
     // Security check to avoid program crash
     if ((im->data == NULL) || (im->width == 0) || (im->height == 0))
         return false;
 
-    Color* pixels;
+    // EDIT: uncompressed formats are copied as is, whatever their pixel size
+    if (im->format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+        return false;
 
-    if (im->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
-        pixels = LoadImageColors(*im);
-    } else {
-        pixels = im->data;
-    }
+    int bpp = GetPixelDataSize(1, 1, im->format);
+
+    const unsigned char* pixels = im->data;
+    unsigned char*       output = RL_MALLOC((size_t)newW * newH * bpp);
 
-    Color* output = (Color*)RL_MALLOC(newW * newH * sizeof(Color));
+    if (output == NULL)
+        return false;
 
     // EDIT: added +1 to account for an early rounding problem
     int xRatio = (int)((im->width << 16) / newW) + 1;
@@ -146,7 +217,7 @@ bool iCopyAndResizeImageNN(const Image* im, Image* newim, int newW, int newH) {
 
             x2 = ((x * xRatio) >> 16);
 
-            output[(y * newW) + x] = pixels[(y2 * im->width) + x2];
+            memcpy(output + ((size_t)y * newW + x) * bpp, pixels + ((size_t)y2 * im->width + x2) * bpp, bpp);
         }
     }
 
@@ -154,10 +225,7 @@ bool iCopyAndResizeImageNN(const Image* im, Image* newim, int newW, int newH) {
     newim->width   = newW;
     newim->height  = newH;
     newim->mipmaps = 1;
-    newim->format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
-
-    if (im->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
-        UnloadImageColors(pixels);
+    newim->format  = im->format;
 
     return true;
 }
@@ -167,78 +235,104 @@ bool iGetOrCreateThumb(ImmyImage_t* im) {
     return iGetOrCreateThumbEx(im, false);
 }
 
-bool iGetOrCreateThumbEx(ImmyImage_t* im, bool createOnly) {
+int iGetImageThumbLevel(const ImmyImage_t* im) {
 
-    if (im->thumb_status == IMAGE_STATUS_LOADED)
-        return true;
+    // images added without a control have no level yet
+    return iGetThumbLevel(im->thumb_size > 0 ? im->thumb_size : THUMB_SIZE);
+}
+
+// Makes the thumbnail from the loaded image.
+// When saving, every level is made and cached since the image is already decoded,
+// but only the level wanted by the image is kept.
+static bool create_thumb_from_image(ImmyImage_t* im, bool save) {
+
+    int size = iGetImageThumbLevel(im);
 
 #if !SHOULD_CACHE_THUMBNAILS
+    save = false;
+#endif
 
-    if (iCreateThumbnail(&im->rayim, &im->thumb, THUMB_SIZE, THUMB_SIZE)) {
+    if (!save) {
 
-        im->thumb_status = IMAGE_STATUS_LOADED;
+        if (!iCreateThumbnail(&im->rayim, &im->thumb, size, size))
+            return false;
+
+        im->state->thumb_status = IMAGE_STATUS_LOADED;
 
         return true;
     }
 
-    return false;
-#else
+    Image levels[THUMB_LEVEL_COUNT];
 
-    // if we've already loaded the image,
-    // we can just create a thumbnail.
-    if (im->status == IMAGE_STATUS_LOADED) {
+    if (!iCreateThumbLevels(&im->rayim, levels))
+        return false;
+
+    for (int i = 0; i < THUMB_LEVEL_COUNT; i++) {
 
-        if (iCreateThumbnail(&im->rayim, &im->thumb, THUMB_SIZE, THUMB_SIZE)) {
+        ImmyImage_t level = {
+            .path         = im->path,
+            .thumb        = levels[i],
+            .thumb_size   = iGetThumbLevelSize(i),
+            .state        = &(ImmyImageState_t){.thumb_status = IMAGE_STATUS_LOADED},
+        };
 
-            im->thumb_status = IMAGE_STATUS_LOADED;
+#if ASYNC_THUMBNAIL_SAVING
+        iQueueThumbnailSave(&level);
+#else
+        iSaveThumbnail(&level);
+#endif
 
-#    if UPDATE_CACHE_IF_IMAGE_LOADED
-            iSaveThumbnail(im);
-#    endif
-            return true;
+        if (level.thumb_size == size) {
+            im->thumb = levels[i];
+        } else {
+            UnloadImage(levels[i]);
         }
     }
 
+    im->state->thumb_status = IMAGE_STATUS_LOADED;
+
+    return true;
+}
+
+bool iGetOrCreateThumbEx(ImmyImage_t* im, bool createOnly) {
+
+    if (im->state->thumb_status == IMAGE_STATUS_LOADED)
+        return true;
+
+#if !SHOULD_CACHE_THUMBNAILS
+
+    return create_thumb_from_image(im, false);
+#else
+
+    // if we've already loaded the image,
+    // we can just create a thumbnail.
+    if (im->state->status == IMAGE_STATUS_LOADED && create_thumb_from_image(im, UPDATE_CACHE_IF_IMAGE_LOADED))
+        return true;
+
     if (createOnly) {
         return false;
     }
 
-    char* thumbPath = iGetCachedPath(im->path);
+    char* thumbPath = iGetCachedPath(im->path, iGetImageThumbLevel(im));
 
     L_D("Trying to read thumb from: %s", thumbPath);
 
     qoi_desc desc;
 
-    void* rgba_pixels = qoi_read(thumbPath, &desc, 0);
+    // the path is null when the image no longer exists
+    void* rgba_pixels = thumbPath != NULL ? qoi_read(thumbPath, &desc, 0) : NULL;
+
+    free(thumbPath);
 
     if (!rgba_pixels) {
 
         L_D("Could not read thumb from cache");
 
-        bool r = false;
-
-        if (im->status != IMAGE_STATUS_LOADED) {
-            FALLTHROUGH;
-        } else if (!iCreateThumbnail(&im->rayim, &im->thumb, THUMB_SIZE, THUMB_SIZE)) {
-            FALLTHROUGH;
-        } else {
-
-            r = true;
-
-            im->thumb_status = IMAGE_STATUS_LOADED;
-
-            iSaveThumbnailAt(im, thumbPath);
-        }
-
-        free(thumbPath);
-
-        return r;
+        return im->state->status == IMAGE_STATUS_LOADED && create_thumb_from_image(im, true);
     }
 
     L_D("Cache hit for thumbnail");
 
-    free(thumbPath);
-
     im->thumb.width   = desc.width;
     im->thumb.height  = desc.height;
     im->thumb.data    = rgba_pixels;
@@ -250,7 +344,12 @@ bool iGetOrCreateThumbEx(ImmyImage_t* im, bool createOnly) {
         im->thumb.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
     }
 
-    im->thumb_status = IMAGE_STATUS_LOADED;
+#if PACK_IMAGE_CHANNELS
+    // qoi has no gray, so grayscale thumbnails are narrowed again here
+    iPackImageChannels(&im->thumb, desc.channels == 4);
+#endif
+
+    im->state->thumb_status = IMAGE_STATUS_LOADED;
 
     return true;
 #endif
@@ -294,135 +393,82 @@ bool iSaveQOI(Image image, const char* path) {
 
 bool iSaveThumbnailAt(const ImmyImage_t* im, const char* path) {
 
-    if (im->thumb_status != IMAGE_STATUS_LOADED)
+    if (im->state->thumb_status != IMAGE_STATUS_LOADED || path == NULL)
         return false;
 
-    /*
-       struct stat b;
-
-       if(stat(path, &b) == 0) {
-
-       double timeInterval = 60 * 60 * 24;
-       double timeDifference = difftime(time(NULL), b.st_mtime);
-
-       if (timeDifference < timeInterval) {
-
-       L_I("Thumb cache was last modified today. Assuming still fine.");
+    if (!iCreateDirectory(path))
+        return false;
 
-       return true;
-       }
-       }
-       */
+    // write to a temporary file and rename it over the entry,
+    // so a reader or another writer never sees a half written thumbnail
+    static _Atomic unsigned int tmpCounter = 0;
 
-    bool r = false;
+    char tmpPath[IMMY_PATH_MAX + 32];
 
-    if (iCreateDirectory(path)) {
+    int n = snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%d.%u", path, (int)getpid(), tmpCounter++);
 
-        L_I("%s: saving thumbnail to %s", __func__, path);
+    if (n < 0 || (size_t)n >= sizeof(tmpPath))
+        return false;
 
-        r = iSaveQOI(im->thumb, path);
-    }
+    L_I("%s: saving thumbnail to %s", __func__, path);
 
-    return r;
-}
+    bool r = iSaveQOI(im->thumb, tmpPath);
 
-bool iSaveThumbnail(const ImmyImage_t* im) {
+#ifdef _WIN32
+    // rename does not replace existing files on windows
+    if (r)
+        remove(path);
+#endif
 
-    if (im->thumb_status != IMAGE_STATUS_LOADED)
-        return false;
+    if (r && rename(tmpPath, path) != 0) {
 
-    char* cachedPath = iGetCachedPath(im->path);
+        L_E("%s: could not rename %s: %s", __func__, tmpPath, strerror(errno));
 
-    DIE_IF_NULL(cachedPath, "%s: Cannot get cache path: %s", __func__, strerror(errno));
+        r = false;
+    }
 
-    bool r = iSaveThumbnailAt(im, cachedPath);
+    if (!r)
+        remove(tmpPath);
 
-    free(cachedPath);
+    // the placeholder comes from the smallest level, it is the cheapest to read
+    if (r && im->thumb_size == THUMB_LEVEL_SMALLEST && !iAddThumbPlaceholder(im->path, &im->thumb))
+        L_D("%s: could not add a placeholder for %s", __func__, im->path);
 
     return r;
 }
 
-void iDitherImage(ImmyImage_t* im) {
-
-    if (im->status != IMAGE_STATUS_LOADED)
-        return;
-
-    if (im->rayim.format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
-        return;
-
-    Color* pixels = LoadImageColors(im->rayim);
-
-    if (pixels == NULL)
-        return;
-
-    RL_FREE(im->rayim.data);
-
-    int    w            = im->rayim.width;
-    int    h            = im->rayim.height;
-    size_t pixels_count = w * h;
+bool iIsThumbCacheValid(const char* path, const char* cachePath) {
 
-    im->rayim.data   = pixels;
-    im->rayim.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
-    im->rebuildBuff  = 1;
+    struct stat src;
+    struct stat dst;
 
-    Color oldPixel = WHITE;
-    Color newPixel = WHITE;
+    if (stat(path, &src) != 0 || stat(cachePath, &dst) != 0)
+        return false;
 
-    for (int i = 0; i < pixels_count; ++i) {
+    return dst.st_mtime >= src.st_mtime && dst.st_size > 0;
+}
 
-        oldPixel = pixels[i];
+bool iSaveThumbnail(const ImmyImage_t* im) {
 
-        float lum =
-            (oldPixel.r * GRAYSCALE_COEF_R + oldPixel.g * GRAYSCALE_COEF_G + oldPixel.b * GRAYSCALE_COEF_B) / 255.0f;
+    if (im->state->thumb_status != IMAGE_STATUS_LOADED)
+        return false;
 
-        if (lum < 0.5)
-            newPixel = BLACK;
-        else
-          newPixel = WHITE;
+    char* cachedPath = iGetCachedPath(im->path, iGetImageThumbLevel(im));
 
-        Color error = (Color
-        ){sub_char_clamp(oldPixel.r, newPixel.r),
-          sub_char_clamp(oldPixel.g, newPixel.g),
-          sub_char_clamp(oldPixel.b, newPixel.b),
-          oldPixel.a};
+    if (cachedPath == NULL) {
 
-        pixels[i] = newPixel;
+        L_W("%s: Cannot get cache path for %s: %s", __func__, im->path, strerror(errno));
 
-        // x + 1
-        if (i + 1 < pixels_count) {
-          int k = i + 1;
-          pixels[k].r = add_char_clamp(pixels[k].r, (error.r * 7) >> 4);
-          pixels[k].g = add_char_clamp(pixels[k].g, (error.g * 7) >> 4);
-          pixels[k].b = add_char_clamp(pixels[k].b, (error.b * 7) >> 4);
-        }
+        return false;
+    }
 
-        // x - 1; y + 1
-        if (i - 1 + w < pixels_count) {
-          int k = i + w - 1;
-          pixels[k].r = add_char_clamp(pixels[k].r, (error.r * 3) >> 4);
-          pixels[k].g = add_char_clamp(pixels[k].g, (error.g * 3) >> 4);
-          pixels[k].b = add_char_clamp(pixels[k].b, (error.b * 3) >> 4);
-        }
+    bool r = iSaveThumbnailAt(im, cachedPath);
 
-        // y + 1
-        if (i + w < pixels_count) {
-          int k = i + w;
-          pixels[k].r = add_char_clamp(pixels[k].r, (error.r * 5) >> 4);
-          pixels[k].g = add_char_clamp(pixels[k].g, (error.g * 5) >> 4);
-          pixels[k].b = add_char_clamp(pixels[k].b, (error.b * 5) >> 4);
-        }
+    free(cachedPath);
 
-        // x + 1; y + 1
-        if (i + 1 + w < pixels_count) {
-          int k = i + w + 1;
-          pixels[k].r = add_char_clamp(pixels[k].r, (error.r * 1) >> 4);
-          pixels[k].g = add_char_clamp(pixels[k].g, (error.g * 1) >> 4);
-          pixels[k].b = add_char_clamp(pixels[k].b, (error.b * 1) >> 4);
-        }
-    }
+    return r;
 }
 
-
 bool iLoadKritaImage(const char* path, Image* im) {
 
     mz_zip_archive zip = {0};
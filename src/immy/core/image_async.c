@@ -1,4 +1,5 @@
 
+#include <math.h>
 #include <pthread.h>
 #include <raylib.h>
 #include <string.h>
@@ -18,16 +19,25 @@ typedef struct {
         pthread_mutex_t mutex;
         bool            finished;
         bool            dothumbnail;
+        bool            doproxy; // false when replacing a proxy with the full image
         char*           path;
+        const char*     key;     // the interned path of the image
         ImmyImage_t    im;
+        ImmyImageState_t state; // im.state, the catalog's entry is only updated on the main thread
+
+        // the rows decoded so far shrunk to fit PROGRESSIVE_PREVIEW_SIZE, guarded by the mutex
+        Image progress;
+        int   dirtyTop; // rows of progress written since the main thread last took them
+        int   dirtyBottom;
 } ImgLoadThreadData_t;
 
 typedef struct {
-        const ImmyImage_t*  key;
+        const char*          key;
         ImgLoadThreadData_t* value;
 } HashMapThreadData_t;
 
-// maps our ImmyImage_t* to the thread loading said image
+// maps the path pointer of our ImmyImage_t to the thread loading said image.
+// the ImmyImage_t itself moves when files are added, its path does not
 struct hashmap* asyncMap;
 
 // to make stuff a little bit nicer to read
@@ -39,7 +49,7 @@ struct hashmap* asyncMap;
 int _thread_cmp(const void* a, const void* b, void* udata) {
     const HashMapThreadData_t* at = a;
     const HashMapThreadData_t* bt = b;
-    return at->key - bt->key;
+    return (at->key > bt->key) - (at->key < bt->key);
 }
 
 // for hashmap hashing of key
@@ -48,13 +58,75 @@ uint64_t _thread_hash(const void* item, uint64_t seed0, uint64_t seed1) {
     return hashmap_sip(THREAD->key, sizeof(THREAD->key), seed0, seed1);
 }
 
-void* async_image_load_thread_main(void* raw_arg) {
+#ifdef IMYLIB2_H
 
-    L_D("%s: Thread is running", __func__);
+// Point samples the rows the loader finished into the progress image, on the loading thread.
+static bool progress_rows(void* arg, const uint32_t* pixels, int w, int h, int y, int rows, int pass) {
 
-    ImgLoadThreadData_t* thread = raw_arg;
+    ImgLoadThreadData_t* thread = arg;
 
-    L_D("%s: Thread is about to load %s", __func__, thread->path);
+    // later passes of interlaced images go over rows which are already shown
+    if (pass > 0 || (int64_t)w * h < PROGRESSIVE_MIN_PIXELS)
+        return true;
+
+    Image* p = &thread->progress;
+
+    pthread_mutex_lock(&thread->mutex);
+
+    if (p->data == NULL) {
+
+        double scale = fmin(1, (double)PROGRESSIVE_PREVIEW_SIZE / MAX(w, h));
+
+        p->width   = MAX(1, w * scale);
+        p->height  = MAX(1, h * scale);
+        p->mipmaps = 1;
+        p->format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+
+        // rows not decoded yet are see through, the thumbnail shows under them
+        p->data = RL_CALLOC((size_t)p->width * p->height, sizeof(uint32_t));
+
+        thread->dirtyTop    = p->height;
+        thread->dirtyBottom = 0;
+    }
+
+    // the progress rows whose source row is in [y, y + rows)
+    int top    = ((int64_t)y * p->height + h - 1) / h;
+    int bottom = MIN(p->height, ((int64_t)(y + rows) * p->height + h - 1) / h);
+
+    for (int py = top; p->data != NULL && py < bottom; py++) {
+
+        const uint32_t* src = pixels + (size_t)((int64_t)py * h / p->height) * w;
+        uint32_t*       dst = (uint32_t*)p->data + (size_t)py * p->width;
+
+        for (int px = 0; px < p->width; px++) {
+
+            uint32_t v = src[(int64_t)px * w / p->width];
+
+            // BGRA to RGBA
+            dst[px] = (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16);
+        }
+    }
+
+    if (top < bottom) {
+
+        thread->dirtyTop    = MIN(thread->dirtyTop, top);
+        thread->dirtyBottom = MAX(thread->dirtyBottom, bottom);
+    }
+
+    pthread_mutex_unlock(&thread->mutex);
+
+    return true;
+}
+
+#endif
+
+// thread is NULL unless the rows are wanted while they decode
+static bool load_image(const char* path, Image* image, ImgLoadThreadData_t* thread) {
+
+    memset(image, 0, sizeof(*image));
+
+    // only imylib2 says, the other loaders are checked
+    bool mayHaveAlpha = true;
 
 #ifdef IMYLIB2_H
 
@@ -62,13 +134,16 @@ void* async_image_load_thread_main(void* raw_arg) {
 
     struct ImlibImage il2Image;
 
-    if (il2LoadImageAsRGBA(thread->path, &il2Image)) {
+    il2ProgressFunction progress = thread != NULL && USE_PROGRESSIVE_LOADING ? progress_rows : NULL;
 
-        thread->im.rayim.data = il2Image.data;
-        thread->im.rayim.width = il2Image.w;
-        thread->im.rayim.height = il2Image.h;
-        thread->im.rayim.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
-        thread->im.rayim.mipmaps = 1;
+    if (il2LoadImageAsRGBAEx(path, &il2Image, progress, thread)) {
+
+        image->data    = il2Image.data;
+        image->width   = il2Image.w;
+        image->height  = il2Image.h;
+        image->format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+        image->mipmaps = 1;
+        mayHaveAlpha   = il2Image.has_alpha;
     }
     else
 
@@ -78,28 +153,60 @@ void* async_image_load_thread_main(void* raw_arg) {
     //
     if (
 #ifdef IMMY_USE_MAGICK
-        !(iLoadImageWithMagick(thread->path, &thread->im.rayim)) &&
+        !(iLoadImageWithMagick(path, image)) &&
 #endif
 
 #ifdef IMMY_USE_FFMPEG
-        !(iLoadImageWithFFmpeg(thread->path, &thread->im.rayim)) &&
+        !(iLoadImageWithFFmpeg(path, image)) &&
 #endif
         true) {
 
         // raylibs load image checks file extension
         // so if it ends with .kra don't bother having raylib load it
-        if (!iEndsWith(thread->path, ".kra", 1))
-            thread->im.rayim = LoadImage(thread->path);
+        if (!iEndsWith(path, ".kra", 1))
+            *image = LoadImage(path);
 
-        if (!IsImageReady(thread->im.rayim))
-            iLoadKritaImage(thread->path, &thread->im.rayim);
+        if (!IsImageReady(*image))
+            iLoadKritaImage(path, image);
     }
 
+    if (!IsImageReady(*image))
+        return false;
+
+#if PACK_IMAGE_CHANNELS
+    iPackImageChannels(image, mayHaveAlpha);
+#endif
+
+    return true;
+}
+
+bool iLoadImageThreadSafe(const char* path, Image* image) {
+
+    return load_image(path, image, NULL);
+}
+
+void* async_image_load_thread_main(void* raw_arg) {
+
+    L_D("%s: Thread is running", __func__);
+
+    ImgLoadThreadData_t* thread = raw_arg;
+
+    L_D("%s: Thread is about to load %s", __func__, thread->path);
+
+    // a compressed copy is much faster than the file, and keeps any edits
+    bool unpacked = thread->doproxy && iUnpackImage(thread->key, &thread->im);
+
+    // only the first load is shown while it decodes, a proxy already covers the full image
+    if (!unpacked && !load_image(thread->path, &thread->im.rayim, thread->doproxy ? thread : NULL))
+        L_D("%s: Could not load %s", __func__, thread->path);
+
 #if GENERATE_THUMB_WHEN_LOADING_IMAGE
 
+    // only the resize happens here,
+    // saving to the cache is queued so the image is handed over sooner
     if (thread->dothumbnail && IsImageReady(thread->im.rayim)) {
 
-        thread->im.status = IMAGE_STATUS_LOADED;
+        thread->im.state->status = IMAGE_STATUS_LOADED;
 
         if (!iGetOrCreateThumb(&thread->im))
 
@@ -108,6 +215,15 @@ void* async_image_load_thread_main(void* raw_arg) {
 
 #endif
 
+    if (!unpacked && IsImageReady(thread->im.rayim)) {
+
+        thread->im.srcRect = (Rectangle){0, 0, thread->im.rayim.width, thread->im.rayim.height};
+
+        // after the thumbnail, so it is made from the full image
+        if (thread->doproxy)
+            iMakeProxy(&thread->im);
+    }
+
     pthread_mutex_lock(&thread->mutex);
     thread->finished = true;
     pthread_mutex_unlock(&thread->mutex);
@@ -139,7 +255,7 @@ static void immy_async_destroy_thread(const ImmyImage_t* im, bool image_gotten)
 
     L_D("%s: Removing item from thread hashmap", __func__);
 
-    const HashMapThreadData_t* THREAD = HM_DELETE(im);
+    const HashMapThreadData_t* THREAD = HM_DELETE(im->path);
 
     if (!THREAD)
         return;
@@ -150,6 +266,7 @@ static void immy_async_destroy_thread(const ImmyImage_t* im, bool image_gotten)
     }
 
     if (THREAD->value != NULL) {
+        UnloadImage(THREAD->value->progress);
         pthread_mutex_destroy(&THREAD->value->mutex);
         free(THREAD->value->path);
         free(THREAD->value);
@@ -160,12 +277,12 @@ bool iAsyncHasImage(const ImmyImage_t* im) {
 
     hashmap_init();
 
-    return HM_GET(im) != NULL;
+    return HM_GET(im->path) != NULL;
 }
 
 bool iGetImageAsync(ImmyImage_t* im) {
 
-    const HashMapThreadData_t* ITEM = HM_GET(im);
+    const HashMapThreadData_t* ITEM = HM_GET(im->path);
 
     if (ITEM == NULL) {
         return false;
@@ -187,43 +304,67 @@ bool iGetImageAsync(ImmyImage_t* im) {
     // thread is gone
     L_D("%s: Async image load finished", __func__);
 
+    // a shown proxy being replaced by the full image, it keeps its place on screen
+    bool promoting = im->state->status == IMAGE_STATUS_LOADED;
+
+    if (promoting && (!IsImageReady(thread->im.rayim) || thread->im.srcRect.width != im->srcRect.width ||
+                      thread->im.srcRect.height != im->srcRect.height)) {
+
+        L_W("%s: Could not load the full image %s, keeping the proxy", __func__, im->path);
+
+        // still a proxy, but don't try again every frame
+        im->promoteFailed = true;
+
+        UnloadImage(thread->im.rayim);
+        UnloadImage(thread->im.thumb);
+
+        goto done;
+    }
+
     if (!IsImageReady(thread->im.rayim)) {
 
-        im->status = IMAGE_STATUS_FAILED;
+        im->state->status = IMAGE_STATUS_FAILED;
 
         L_W("%s: Loaded image was invalid for %s", im->path);
 
         goto done;
     }
 
-    im->rayim   = thread->im.rayim;
-    im->srcRect = (Rectangle){
-        0.0,
-        0.0,
-        im->rayim.width,
-        im->rayim.height,
-    };
-    im->dstPos = (Vector2){0, 0};
-    im->status = IMAGE_STATUS_LOADED;
+    if (promoting)
+        UnloadImage(im->rayim);
+    else
+        im->dstPos = (Vector2){0, 0};
+
+    im->rayim         = thread->im.rayim;
+    im->isProxy       = thread->im.isProxy;
+    im->isEdited      = thread->im.isEdited;
+    im->promoteFailed = false;
+    im->srcRect       = thread->im.srcRect;
+    im->state->status = IMAGE_STATUS_LOADED;
 
     // reset thumbnail status so we can maybe load it now
-    if (im->thumb_status == IMAGE_STATUS_FAILED)
-        im->thumb_status = IMAGE_STATUS_NOT_LOADED;
+    if (im->state->thumb_status == IMAGE_STATUS_FAILED)
+        im->state->thumb_status = IMAGE_STATUS_NOT_LOADED;
 
 #if GENERATE_THUMB_WHEN_LOADING_IMAGE
 
     if (didThumb) {
 
-        if (IsImageReady(thread->im.thumb)) {
+        // the thumbnail level can change while the image is loading
+        if (thread->im.thumb_size != im->thumb_size) {
+
+            UnloadImage(thread->im.thumb);
+
+        } else if (IsImageReady(thread->im.thumb)) {
 
             UnloadImage(im->thumb);
 
-            im->thumb        = thread->im.thumb;
-            im->thumb_status = IMAGE_STATUS_LOADED;
+            im->thumb               = thread->im.thumb;
+            im->state->thumb_status = IMAGE_STATUS_LOADED;
 
         } else if (!IsImageReady(im->thumb)) {
 
-            im->thumb_status = IMAGE_STATUS_NOT_LOADED;
+            im->state->thumb_status = IMAGE_STATUS_NOT_LOADED;
 
             memset(&im->thumb, 0, sizeof(im->thumb));
         }
@@ -236,6 +377,62 @@ done:
     return true;
 }
 
+bool iGetImageAsyncProgress(const ImmyImage_t* im, Texture2D* texture) {
+
+    hashmap_init();
+
+    const HashMapThreadData_t* ITEM = HM_GET(im->path);
+
+    if (ITEM == NULL)
+        return false;
+
+    ImgLoadThreadData_t* thread = ITEM->value;
+    Image*               p      = &thread->progress;
+
+    pthread_mutex_lock(&thread->mutex);
+
+    bool started = p->data != NULL;
+
+    if (started && (!IsTextureReady(*texture) || texture->width != p->width || texture->height != p->height)) {
+
+        if (IsTextureReady(*texture))
+            UnloadTexture(*texture);
+
+        *texture = LoadTextureFromImage(*p);
+
+    } else if (started && thread->dirtyTop < thread->dirtyBottom) {
+
+        // only the band decoded since last time goes to the GPU
+        Rectangle band = {0, thread->dirtyTop, p->width, thread->dirtyBottom - thread->dirtyTop};
+
+        UpdateTextureRec(*texture, band, (uint32_t*)p->data + (size_t)thread->dirtyTop * p->width);
+    }
+
+    if (started) {
+
+        thread->dirtyTop    = p->height;
+        thread->dirtyBottom = 0;
+    }
+
+    pthread_mutex_unlock(&thread->mutex);
+
+    return started && IsTextureReady(*texture);
+}
+
+bool iWaitImageAsync(ImmyImage_t* im) {
+
+    hashmap_init();
+
+    const HashMapThreadData_t* ITEM = HM_GET(im->path);
+
+    if (ITEM == NULL)
+        return false;
+
+    pthread_join(ITEM->value->thread, NULL);
+
+    return iGetImageAsync(im);
+}
+
 bool iLoadImageAsync(const ImmyImage_t* im) {
 
     if (iAsyncHasImage(im))
@@ -248,8 +445,12 @@ bool iLoadImageAsync(const ImmyImage_t* im) {
 
     thread->finished    = false;
     thread->path        = iStrDup(im->path);
-    thread->im.path     = thread->path; // so we can use immyGetOrCreateThumb
-    thread->dothumbnail = im->thumb_status != IMAGE_STATUS_LOADED;
+    thread->im.path       = thread->path; // so we can use immyGetOrCreateThumb
+    thread->im.state      = &thread->state;
+    thread->im.thumb_size = im->thumb_size;
+    thread->dothumbnail   = im->state->thumb_status != IMAGE_STATUS_LOADED;
+    thread->doproxy       = im->state->status != IMAGE_STATUS_LOADED;
+    thread->key           = im->path;
 
     if (thread->path == NULL) {
 
@@ -267,7 +468,7 @@ bool iLoadImageAsync(const ImmyImage_t* im) {
         return false;
     }
 
-    HashMapThreadData_t item = {.key = im, .value = thread};
+    HashMapThreadData_t item = {.key = im->path, .value = thread};
 
     hashmap_set(asyncMap, &item);
 
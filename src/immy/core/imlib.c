@@ -4,6 +4,10 @@
 
 #include "core.h"
 
+#if defined(__unix__) && defined(IMLIB2_ENABLED) && defined(IMYLIB2_AVAILABLE)
+#    include <imylib2.h>
+#endif
+
 bool iLoadImageWithImlib2(const char* path, Image* im) {
 
 #if !defined(__unix__) || !defined(IMLIB2_ENABLED)
@@ -44,7 +48,7 @@ bool iLoadImageWithImlib2(const char* path, Image* im) {
     }
 
     // we have to copy the buffer otherwise we can't free from imlib
-    im->data = malloc(pixels * sizeof(Color));
+    im->data = RL_MALLOC(pixels * sizeof(Color));
 
     if (!im->data) {
 
@@ -53,6 +57,13 @@ bool iLoadImageWithImlib2(const char* path, Image* im) {
         return false;
     }
 
+#    ifdef IMYLIB2_H
+
+    // the copy and the swizzle are one pass
+    il2SwapRedBlue(im->data, argb, pixels);
+
+#    else
+
     Color* d = (Color*)im->data;
 
     for (size_t i = 0; i < pixels; i++) {
@@ -66,6 +77,8 @@ bool iLoadImageWithImlib2(const char* path, Image* im) {
         argb++;
     }
 
+#    endif
+
     imlib_free_image();
 
     L_I("Loaded with imlib2");
@@ -0,0 +1,742 @@
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../external/hashmap.h"
+#include "../external/sha256.h"
+#include "../config.h"
+#include "core.h"
+
+#define META_CACHE_MAGIC "IMMYMETA"
+#define META_CACHE_VERSION 1
+
+// One file in a directory cache.
+typedef struct {
+        char*       name; // key, the file name without the directory
+        ImageMeta_t meta;
+} MetaRecord_t;
+
+// Metadata of the files in one directory, kept on disk in the cache directory.
+typedef struct {
+        char*           dir; // key
+        struct hashmap* records;
+        bool            dirty;
+} MetaDir_t;
+
+// Stored after the magic and version for each record, followed by the name.
+typedef struct {
+        int64_t  mtime;
+        int64_t  size;
+        int64_t  taken;
+        int32_t  width;
+        int32_t  height;
+        uint32_t nameLength;
+        uint32_t pad;
+} MetaDiskRecord_t;
+
+_Static_assert(sizeof(MetaDiskRecord_t) == 40, "the metadata cache record size must not change");
+
+// A list of images to gather metadata for, worked on by the metadata threads.
+typedef struct {
+        size_t        count;
+        const char**  keys;  // path pointers of the images, only compared
+        char**        paths; // copies, the threads read these
+        ImageMeta_t*  metas;
+        bool*         found;
+        bool*         probe; // not cached, the header is read after every file is stat'd
+        atomic_bool   done;
+} MetaJob_t;
+
+static pthread_mutex_t dirsMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hashmap* dirs      = NULL;
+
+// owned by the main thread
+static MetaJob_t* metaJob        = NULL;
+static size_t     metaCheckedGen = (size_t)-1;
+
+static int record_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return strcmp(((const MetaRecord_t*)a)->name, ((const MetaRecord_t*)b)->name);
+}
+
+static uint64_t record_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    const char* name = ((const MetaRecord_t*)item)->name;
+
+    return hashmap_sip(name, strlen(name), seed0, seed1);
+}
+
+static void record_free(void* item) {
+
+    free(((MetaRecord_t*)item)->name);
+}
+
+static int dir_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return strcmp(((const MetaDir_t*)a)->dir, ((const MetaDir_t*)b)->dir);
+}
+
+static uint64_t dir_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    const char* dir = ((const MetaDir_t*)item)->dir;
+
+    return hashmap_sip(dir, strlen(dir), seed0, seed1);
+}
+
+bool iSortOrderNeedsMeta(StrCompare_t order) {
+
+    return order == SORT_ORDER__MTIME || order == SORT_ORDER__SIZE || order == SORT_ORDER__DIMENSIONS ||
+           order == SORT_ORDER__DATE_TAKEN;
+}
+
+StrCompare_t iGetPathOrder(StrCompare_t order) {
+
+    // metadata orders break ties by name
+    return iSortOrderNeedsMeta(order) ? SORT_ORDER__NATURAL : order;
+}
+
+int64_t iGetImageSortValue(const ImmyCatalog_t* cat, size_t i, StrCompare_t order) {
+
+    if (!iSortOrderNeedsMeta(order))
+        return 0;
+
+    if (cat->states[i].meta_status != IMAGE_STATUS_LOADED)
+        return SORT_VALUE_UNKNOWN;
+
+    const ImageMeta_t* meta = cat->metas + i;
+
+    switch (order) {
+
+    case SORT_ORDER__MTIME:
+        return meta->mtime;
+
+    case SORT_ORDER__SIZE:
+        return meta->size;
+
+    case SORT_ORDER__DIMENSIONS:
+        return (int64_t)meta->width * meta->height;
+
+    case SORT_ORDER__DATE_TAKEN:
+        // files without exif go by their mtime
+        return meta->taken != 0 ? meta->taken : meta->mtime;
+
+    default:
+        return 0;
+    }
+}
+
+// Opens the directory for stat_at, -1 if it cannot be.
+static int open_dir(const char* dir) {
+
+#ifdef _WIN32
+    (void)dir;
+
+    return -1;
+#else
+    return open(dir, O_RDONLY | O_DIRECTORY);
+#endif
+}
+
+// Stats the file by its name in the open directory, so the directory is only looked up once for all its files.
+// Without a directory the whole path is looked up.
+static bool stat_at(int dirfd, const char* path, const char* name, ImageMeta_t* meta) {
+
+    struct stat st;
+
+#ifdef _WIN32
+    (void)dirfd;
+    (void)name;
+
+    if (stat(path, &st) != 0)
+        return false;
+#else
+    if (dirfd == -1 ? stat(path, &st) != 0 : fstatat(dirfd, name, &st, 0) != 0)
+        return false;
+#endif
+
+    meta->mtime = st.st_mtime;
+    meta->size  = st.st_size;
+
+    return true;
+}
+
+// Gets the directory of the path without the trailing slash, unless it is the root.
+// Returns false if it is too long to be cached.
+static bool get_dir(const char* path, const char* name, char* dir, size_t size) {
+
+    size_t dlen = name - path;
+
+    if (dlen == 0) {
+
+        strcpy(dir, ".");
+
+        return true;
+    }
+
+    if (dlen >= size)
+        return false;
+
+    memcpy(dir, path, dlen);
+
+    dir[dlen > 1 ? dlen - 1 : dlen] = 0;
+
+    return true;
+}
+
+// Gets where the metadata of the directory is cached.
+static bool get_dir_cache_path(const char* dir, char* buf, size_t size) {
+
+    unsigned char hash[SHA256_BLOCK_SIZE];
+
+    if (!iGetPathHash(dir, hash))
+        return false;
+
+    int n = snprintf(buf, size, "%s" THUMBNAIL_CACHE_PATH "meta/", iGetCacheDirectory());
+
+    if (n < 0 || (size_t)n + SHA256_BLOCK_SIZE + 1 > size)
+        return false;
+
+    // only the first half of the hash, like the thumbnails
+    for (size_t i = 0; i < SHA256_BLOCK_SIZE / 2; i++)
+        sprintf(buf + n + i * 2, "%02x", hash[i]);
+
+    return true;
+}
+
+static void load_dir_cache(MetaDir_t* d) {
+
+    char path[IMMY_PATH_MAX];
+
+    if (!get_dir_cache_path(d->dir, path, sizeof(path)))
+        return;
+
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL)
+        return;
+
+    char     magic[8];
+    uint32_t version;
+
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, META_CACHE_MAGIC, 8) != 0 || fread(&version, 4, 1, f) != 1 ||
+        version != META_CACHE_VERSION) {
+
+        fclose(f);
+
+        return;
+    }
+
+    MetaDiskRecord_t rec;
+
+    while (fread(&rec, sizeof(rec), 1, f) == 1 && rec.nameLength < IMMY_PATH_MAX) {
+
+        char* name = malloc(rec.nameLength + 1);
+
+        if (name == NULL || fread(name, 1, rec.nameLength, f) != rec.nameLength) {
+
+            free(name);
+
+            break;
+        }
+
+        name[rec.nameLength] = 0;
+
+        MetaRecord_t r = {
+            .name = name,
+            .meta = {rec.mtime, rec.size, rec.width, rec.height, rec.taken},
+        };
+
+        const MetaRecord_t* old = hashmap_set(d->records, &r);
+
+        if (old != NULL)
+            free(old->name);
+    }
+
+    fclose(f);
+}
+
+static void save_dir_cache(MetaDir_t* d) {
+
+    char path[IMMY_PATH_MAX];
+    char tmpPath[IMMY_PATH_MAX + 32];
+
+    if (!get_dir_cache_path(d->dir, path, sizeof(path)) || !iCreateDirectory(path))
+        return;
+
+    int n = snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%d", path, (int)getpid());
+
+    if (n < 0 || (size_t)n >= sizeof(tmpPath))
+        return;
+
+    FILE* f = fopen(tmpPath, "wb");
+
+    if (f == NULL) {
+
+        L_W("%s: could not open %s: %s", __func__, tmpPath, strerror(errno));
+
+        return;
+    }
+
+    uint32_t version = META_CACHE_VERSION;
+
+    bool ok = fwrite(META_CACHE_MAGIC, 1, 8, f) == 8 && fwrite(&version, 4, 1, f) == 1;
+
+    size_t iter = 0;
+    void*  item;
+
+    while (ok && hashmap_iter(d->records, &iter, &item)) {
+
+        const MetaRecord_t* r = item;
+
+        MetaDiskRecord_t rec = {
+            .mtime      = r->meta.mtime,
+            .size       = r->meta.size,
+            .taken      = r->meta.taken,
+            .width      = r->meta.width,
+            .height     = r->meta.height,
+            .nameLength = strlen(r->name),
+        };
+
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1 && fwrite(r->name, 1, rec.nameLength, f) == rec.nameLength;
+    }
+
+    ok = fclose(f) == 0 && ok;
+
+#ifdef _WIN32
+    // rename does not replace existing files on windows
+    if (ok)
+        remove(path);
+#endif
+
+    if (!ok || rename(tmpPath, path) != 0)
+        remove(tmpPath);
+
+    d->dirty = false;
+}
+
+// Gets the cache of the directory, loading it from disk the first time.
+// Must hold dirsMutex.
+static MetaDir_t* get_dir_locked(const char* dir) {
+
+    if (dirs == NULL) {
+
+        dirs = hashmap_new(sizeof(MetaDir_t), 0, 0, 0, dir_hash, dir_cmp, NULL, NULL);
+
+        DIE_IF_NULL(dirs, "Cannot alloc a new hashmap");
+    }
+
+    MetaDir_t* d = (MetaDir_t*)hashmap_get(dirs, &(MetaDir_t){.dir = (char*)dir});
+
+    if (d != NULL)
+        return d;
+
+    MetaDir_t nd = {
+        .dir     = iStrDup(dir),
+        .records = hashmap_new(sizeof(MetaRecord_t), 0, 0, 0, record_hash, record_cmp, record_free, NULL),
+    };
+
+    if (nd.dir == NULL || nd.records == NULL) {
+
+        free(nd.dir);
+
+        if (nd.records != NULL)
+            hashmap_free(nd.records);
+
+        return NULL;
+    }
+
+#if META_DISK_CACHE
+    load_dir_cache(&nd);
+#endif
+
+    hashmap_set(dirs, &nd);
+
+    return (MetaDir_t*)hashmap_get(dirs, &nd);
+}
+
+// Gets the cached metadata of the file if it did not change since, meta already holds its mtime and size.
+static bool get_cached(const char* dir, const char* name, ImageMeta_t* meta) {
+
+    pthread_mutex_lock(&dirsMutex);
+
+    MetaDir_t*          d   = get_dir_locked(dir);
+    const MetaRecord_t* rec = d ? hashmap_get(d->records, &(MetaRecord_t){.name = (char*)name}) : NULL;
+
+    bool cached = rec != NULL && rec->meta.mtime == meta->mtime && rec->meta.size == meta->size;
+
+    if (cached)
+        *meta = rec->meta;
+
+    pthread_mutex_unlock(&dirsMutex);
+
+    return cached;
+}
+
+// Caches the metadata of the file,
+// files which cannot be probed are cached too, so they are not read again.
+static void set_cached(const char* path, const ImageMeta_t* meta) {
+
+    const char* name = GetFileName(path);
+    char        dir[IMMY_PATH_MAX];
+
+    if (!get_dir(path, name, dir, sizeof(dir)))
+        return;
+
+    pthread_mutex_lock(&dirsMutex);
+
+    MetaDir_t* d = get_dir_locked(dir);
+
+    if (d != NULL) {
+
+        MetaRecord_t r = {.name = iStrDup(name), .meta = *meta};
+
+        if (r.name != NULL) {
+
+            const MetaRecord_t* old = hashmap_set(d->records, &r);
+
+            if (old != NULL)
+                free(old->name);
+
+            d->dirty = true;
+        }
+    }
+
+    pthread_mutex_unlock(&dirsMutex);
+}
+
+bool iGetFileMeta(const char* path, ImageMeta_t* meta) {
+
+    const char* name = GetFileName(path);
+    char        dir[IMMY_PATH_MAX];
+
+    if (!stat_at(-1, path, name, meta))
+        return false;
+
+    // too long to cache
+    if (!get_dir(path, name, dir, sizeof(dir))) {
+
+        iProbeImageHeader(path, meta);
+
+        return true;
+    }
+
+    if (get_cached(dir, name, meta))
+        return true;
+
+    iProbeImageHeader(path, meta);
+    set_cached(path, meta);
+
+    return true;
+}
+
+static void save_dirty_dirs() {
+
+#if META_DISK_CACHE
+    pthread_mutex_lock(&dirsMutex);
+
+    size_t iter = 0;
+    void*  item;
+
+    while (dirs != NULL && hashmap_iter(dirs, &iter, &item)) {
+
+        MetaDir_t* d = item;
+
+        if (d->dirty)
+            save_dir_cache(d);
+    }
+
+    pthread_mutex_unlock(&dirsMutex);
+#endif
+}
+
+// Stats the files and takes what is cached, the rest are marked to be probed.
+static void meta_range(size_t begin, size_t end, void* arg) {
+
+    MetaJob_t* job = arg;
+
+    char openDir[IMMY_PATH_MAX] = "";
+    int  dirfd                  = -1;
+
+    for (size_t i = begin; i < end; i++) {
+
+        const char* path = job->paths[i];
+        const char* name = GetFileName(path);
+        char        dir[IMMY_PATH_MAX];
+        bool        cacheable = get_dir(path, name, dir, sizeof(dir));
+
+        // the files of a directory are next to each other in the list, its fd is kept while they are stat'd
+        if (cacheable && strcmp(dir, openDir) != 0) {
+
+            if (dirfd != -1)
+                close(dirfd);
+
+            dirfd = open_dir(dir);
+
+            strcpy(openDir, dir);
+        }
+
+        job->found[i] = stat_at(cacheable ? dirfd : -1, path, name, job->metas + i);
+        job->probe[i] = job->found[i] && !(cacheable && get_cached(dir, name, job->metas + i));
+    }
+
+    if (dirfd != -1)
+        close(dirfd);
+}
+
+// Reads the headers of every file which was not cached in one batch, then caches them.
+static void probe_missing(MetaJob_t* job) {
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < job->count; i++)
+        count += job->probe[i];
+
+    if (count == 0)
+        return;
+
+    const char** paths = malloc(count * sizeof(char*));
+    ImageMeta_t* metas = malloc(count * sizeof(ImageMeta_t));
+
+    // they keep their mtime and size
+    if (paths == NULL || metas == NULL) {
+
+        free(paths);
+        free(metas);
+
+        return;
+    }
+
+    for (size_t i = 0, n = 0; i < job->count; i++) {
+
+        if (!job->probe[i])
+            continue;
+
+        paths[n]   = job->paths[i];
+        metas[n++] = job->metas[i];
+    }
+
+    iProbeImageHeaders(paths, count, metas, META_THREADS);
+
+    for (size_t i = 0, n = 0; i < job->count; i++) {
+
+        if (!job->probe[i])
+            continue;
+
+        job->metas[i] = metas[n];
+
+        set_cached(paths[n++], job->metas + i);
+    }
+
+    free(paths);
+    free(metas);
+}
+
+static void* meta_thread_main(void* raw_arg) {
+
+    MetaJob_t* job = raw_arg;
+
+    double start = iGetTime();
+
+    iParallelFor(job->count, meta_range, job, META_THREADS);
+
+    probe_missing(job);
+
+    save_dirty_dirs();
+
+    L_I("Read the metadata of %zu files in %.2fs", job->count, iGetTime() - start);
+
+    atomic_store(&job->done, true);
+
+    return NULL;
+}
+
+static void free_job(MetaJob_t* job) {
+
+    for (size_t i = 0; i < job->count; i++)
+        free(job->paths[i]);
+
+    free(job->keys);
+    free(job->paths);
+    free(job->metas);
+    free(job->found);
+    free(job->probe);
+    free(job);
+}
+
+// Starts a job for every image without metadata.
+static void start_job(ImmyControl_t* ctrl) {
+
+    size_t count = 0;
+
+    ImmyCatalog_t* cat = &ctrl->image_files;
+
+    DARRAY_FOR_EACH(*cat, i) {
+
+        if (cat->states[i].meta_status == IMAGE_STATUS_NOT_LOADED)
+            count++;
+    }
+
+    if (count == 0)
+        return;
+
+    MetaJob_t* job = calloc(1, sizeof(MetaJob_t));
+
+    if (job == NULL)
+        return;
+
+    job->keys  = malloc(count * sizeof(char*));
+    job->paths = calloc(count, sizeof(char*));
+    job->metas = calloc(count, sizeof(ImageMeta_t));
+    job->found = calloc(count, sizeof(bool));
+    job->probe = calloc(count, sizeof(bool));
+
+    if (job->keys == NULL || job->paths == NULL || job->metas == NULL || job->found == NULL || job->probe == NULL) {
+
+        free_job(job);
+
+        return;
+    }
+
+    DARRAY_FOR_EACH(*cat, i) {
+
+        if (cat->states[i].meta_status != IMAGE_STATUS_NOT_LOADED)
+            continue;
+
+        if ((job->paths[job->count] = iStrDup(cat->paths[i])) == NULL)
+            continue;
+
+        job->keys[job->count++] = cat->paths[i];
+
+        cat->states[i].meta_status = IMAGE_STATUS_LOADING;
+    }
+
+    pthread_t      thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    int r = pthread_create(&thread, &attr, meta_thread_main, job);
+
+    pthread_attr_destroy(&attr);
+
+    if (r != 0) {
+
+        L_E("%s: Cannot start the metadata thread", __func__);
+
+        DARRAY_FOR_EACH(*cat, i) {
+
+            if (cat->states[i].meta_status == IMAGE_STATUS_LOADING)
+                cat->states[i].meta_status = IMAGE_STATUS_NOT_LOADED;
+        }
+
+        free_job(job);
+
+        return;
+    }
+
+    metaJob = job;
+}
+
+static int key_cmp(const void* a, const void* b) {
+
+    const char* ka = *(const char**)a;
+    const char* kb = *(const char**)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+// Copies the job results into the images.
+// The images may have moved since the job started, so they are found by their path pointer.
+static void apply_job(ImmyControl_t* ctrl, MetaJob_t* job) {
+
+    size_t* order = malloc(job->count * sizeof(size_t));
+
+    if (order == NULL)
+        return;
+
+    // sort the results by key so each image is a binary search
+    const char** keys = malloc(job->count * sizeof(char*));
+
+    if (keys == NULL) {
+
+        free(order);
+
+        return;
+    }
+
+    memcpy(keys, job->keys, job->count * sizeof(char*));
+
+    qsort(keys, job->count, sizeof(char*), key_cmp);
+
+    // keys are unique, so the original index can be found again with a search in job->keys order
+    for (size_t i = 0; i < job->count; i++) {
+
+        const char** k = bsearch(job->keys + i, keys, job->count, sizeof(char*), key_cmp);
+
+        order[k - keys] = i;
+    }
+
+    ImmyCatalog_t* cat = &ctrl->image_files;
+
+    DARRAY_FOR_EACH(*cat, i) {
+
+        if (cat->states[i].meta_status != IMAGE_STATUS_LOADING)
+            continue;
+
+        const char** k = bsearch(cat->paths + i, keys, job->count, sizeof(char*), key_cmp);
+
+        if (k == NULL)
+            continue;
+
+        size_t j = order[k - keys];
+
+        cat->metas[i]              = job->metas[j];
+        cat->states[i].meta_status = job->found[j] ? IMAGE_STATUS_LOADED : IMAGE_STATUS_FAILED;
+    }
+
+    free(keys);
+    free(order);
+}
+
+bool iGatherImageMeta(ImmyControl_t* ctrl) {
+
+    bool applied = false;
+
+    if (metaJob != NULL) {
+
+        if (!atomic_load(&metaJob->done))
+            return false;
+
+        apply_job(ctrl, metaJob);
+        free_job(metaJob);
+
+        metaJob = NULL;
+        applied = true;
+
+        // look again, files may have been added while this job ran
+        metaCheckedGen = (size_t)-1;
+    }
+
+    // only look for new images when the list changed
+    if (iSortOrderNeedsMeta(ctrl->filename_cmp) && ctrl->image_files_gen != metaCheckedGen) {
+
+        metaCheckedGen = ctrl->image_files_gen;
+
+        start_job(ctrl);
+    }
+
+    return applied;
+}
@@ -0,0 +1,103 @@
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "core.h"
+
+typedef struct {
+        pthread_t        thread;
+        iParallelFunc_t* func;
+        void*            arg;
+        size_t           begin;
+        size_t           end;
+} ParallelChunk_t;
+
+static void* parallel_thread_main(void* raw_arg) {
+
+    ParallelChunk_t* chunk = raw_arg;
+
+    chunk->func(chunk->begin, chunk->end, chunk->arg);
+
+    return NULL;
+}
+
+int iGetCPUCount() {
+
+    static int count = 0;
+
+    if (count > 0)
+        return count;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count < 1)
+        count = 1;
+
+    return count;
+}
+
+void iParallelFor(size_t count, iParallelFunc_t* func, void* arg, int maxThreads) {
+
+    if (count == 0)
+        return;
+
+    int threads = iGetCPUCount();
+
+    if (maxThreads > 0 && threads > maxThreads)
+        threads = maxThreads;
+
+    if ((size_t)threads > count)
+        threads = count;
+
+    if (threads <= 1) {
+
+        func(0, count, arg);
+
+        return;
+    }
+
+    ParallelChunk_t* chunks = calloc(threads, sizeof(ParallelChunk_t));
+
+    if (chunks == NULL) {
+
+        func(0, count, arg);
+
+        return;
+    }
+
+    for (int i = 0; i < threads; i++) {
+
+        chunks[i].func  = func;
+        chunks[i].arg   = arg;
+        chunks[i].begin = (count * i) / threads;
+        chunks[i].end   = (count * (i + 1)) / threads;
+    }
+
+    // the first chunk is done on this thread
+    // anything which fails to start is also done here
+    bool* started = calloc(threads, sizeof(bool));
+
+    for (int i = 1; i < threads; i++) {
+
+        if (started != NULL)
+            started[i] = pthread_create(&chunks[i].thread, NULL, parallel_thread_main, chunks + i) == 0;
+
+        if (started == NULL || !started[i])
+            func(chunks[i].begin, chunks[i].end, arg);
+    }
+
+    func(chunks[0].begin, chunks[0].end, arg);
+
+    for (int i = 1; i < threads; i++) {
+
+        if (started != NULL && started[i])
+            pthread_join(chunks[i].thread, NULL);
+    }
+
+    free(started);
+    free(chunks);
+}
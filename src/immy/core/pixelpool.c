@@ -0,0 +1,338 @@
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#    include <sys/mman.h>
+#endif
+
+#include "../config.h"
+#include "../external/hashmap.h"
+#include "core.h"
+
+// transparent huge page size, bigger buffers are aligned to it so every page can be huge
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// most freed buffers kept for reuse at once
+#define POOL_CACHE_SLOTS 32
+
+#ifndef _WIN32
+
+// A buffer mapped by the pool.
+typedef struct {
+        void*  ptr;
+        size_t size;    // bytes asked for
+        size_t mapped;  // bytes mapped, the size class
+        bool   zeroed;  // never written, or given back with MADV_DONTNEED
+        size_t lastUse; // when it was freed, for dropping the oldest first
+} PoolBuffer_t;
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hashmap* live      = NULL; // handed out, keyed by ptr
+static atomic_size_t   liveCount = 0;    // lets frees skip the lock when nothing is pooled
+
+static PoolBuffer_t cache[POOL_CACHE_SLOTS];
+static int          cacheCount = 0;
+static size_t       cacheBytes = 0;
+static size_t       poolClock  = 0;
+
+static uint64_t buffer_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    uintptr_t p = (uintptr_t)((const PoolBuffer_t*)item)->ptr;
+
+    return hashmap_murmur(&p, sizeof(p), seed0, seed1);
+}
+
+static int buffer_cmp(const void* a, const void* b, void* udata) {
+
+    uintptr_t pa = (uintptr_t)((const PoolBuffer_t*)a)->ptr;
+    uintptr_t pb = (uintptr_t)((const PoolBuffer_t*)b)->ptr;
+
+    return pa < pb ? -1 : pa > pb;
+}
+
+// Rounds up to one of 4 classes per power of two, so at most a quarter is wasted
+// and images of the same size always land in the same class.
+static size_t size_class(size_t size) {
+
+    size_t step = HUGE_PAGE_SIZE;
+
+    while (step * 8 < size)
+        step *= 2;
+
+    return (size + step - 1) / step * step;
+}
+
+static void* map_buffer(size_t mapped) {
+
+    // over map so the start can be moved to a huge page boundary
+    size_t total = mapped + HUGE_PAGE_SIZE;
+    char*  raw   = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (raw == MAP_FAILED)
+        return NULL;
+
+    char*  ptr  = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    size_t head = ptr - raw;
+    size_t tail = total - head - mapped;
+
+    if (head > 0)
+        munmap(raw, head);
+
+    if (tail > 0)
+        munmap(ptr + mapped, tail);
+
+#    ifdef MADV_HUGEPAGE
+    madvise(ptr, mapped, MADV_HUGEPAGE);
+#    endif
+
+    return ptr;
+}
+
+static void drop_cached(int i) {
+
+    munmap(cache[i].ptr, cache[i].mapped);
+
+    cacheBytes -= cache[i].mapped;
+    cache[i] = cache[--cacheCount];
+}
+
+// Gives the pages of every cached buffer back, the mappings stay for reuse.
+static void release_cached_pages() {
+
+    for (int i = 0; i < cacheCount; i++) {
+
+        if (cache[i].zeroed)
+            continue;
+
+        madvise(cache[i].ptr, cache[i].mapped, MADV_DONTNEED);
+
+        cache[i].zeroed = true;
+    }
+}
+
+static bool memory_is_low() {
+
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long size  = sysconf(_SC_PAGESIZE);
+
+    return pages > 0 && size > 0 && (size_t)pages * size < PIXEL_POOL_LOW_MEMORY;
+}
+
+static void* pool_alloc(size_t size, bool zero) {
+
+    size_t mapped = size_class(size);
+
+    PoolBuffer_t buf = {0};
+
+    pthread_mutex_lock(&poolMutex);
+
+    if (live == NULL) {
+
+        live = hashmap_new(sizeof(PoolBuffer_t), 0, 0, 0, buffer_hash, buffer_cmp, NULL, NULL);
+
+        if (live == NULL) {
+
+            pthread_mutex_unlock(&poolMutex);
+
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < cacheCount; i++) {
+
+        if (cache[i].mapped == mapped) {
+
+            buf = cache[i];
+
+            cacheBytes -= cache[i].mapped;
+            cache[i] = cache[--cacheCount];
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    if (buf.ptr == NULL) {
+
+        buf.ptr    = map_buffer(mapped);
+        buf.mapped = mapped;
+        buf.zeroed = true;
+
+        if (buf.ptr == NULL)
+            return NULL;
+    }
+
+    if (zero && !buf.zeroed)
+        memset(buf.ptr, 0, size);
+
+    buf.size   = size;
+    buf.zeroed = false;
+
+    pthread_mutex_lock(&poolMutex);
+
+    hashmap_set(live, &buf);
+
+    bool oom = hashmap_oom(live);
+
+    pthread_mutex_unlock(&poolMutex);
+
+    if (oom) {
+
+        munmap(buf.ptr, buf.mapped);
+
+        return NULL;
+    }
+
+    atomic_fetch_add(&liveCount, 1);
+
+    return buf.ptr;
+}
+
+// Returns true if the buffer belonged to the pool, it is kept for the next decode of the same size.
+static bool pool_free(void* ptr) {
+
+    if (atomic_load(&liveCount) == 0)
+        return false;
+
+    pthread_mutex_lock(&poolMutex);
+
+    const PoolBuffer_t* found = hashmap_delete(live, &(PoolBuffer_t){.ptr = ptr});
+
+    if (found == NULL) {
+
+        pthread_mutex_unlock(&poolMutex);
+
+        return false;
+    }
+
+    PoolBuffer_t buf = *found;
+
+    atomic_fetch_sub(&liveCount, 1);
+
+    if (buf.mapped > PIXEL_POOL_CACHE_SIZE) {
+
+        munmap(buf.ptr, buf.mapped);
+
+    } else {
+
+        // make room by dropping the buffers freed longest ago
+        while (cacheCount == POOL_CACHE_SLOTS || cacheBytes + buf.mapped > PIXEL_POOL_CACHE_SIZE) {
+
+            int oldest = 0;
+
+            for (int i = 1; i < cacheCount; i++) {
+
+                if (cache[i].lastUse < cache[oldest].lastUse)
+                    oldest = i;
+            }
+
+            drop_cached(oldest);
+        }
+
+        buf.lastUse = ++poolClock;
+
+        cache[cacheCount++] = buf;
+        cacheBytes += buf.mapped;
+    }
+
+    if (memory_is_low())
+        release_cached_pages();
+
+    pthread_mutex_unlock(&poolMutex);
+
+    return true;
+}
+
+void* iPixelAlloc(size_t size) {
+
+    if (size < PIXEL_POOL_MIN_SIZE)
+        return malloc(size);
+
+    return pool_alloc(size, false);
+}
+
+void* iPixelCalloc(size_t count, size_t size) {
+
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+
+    if (count * size < PIXEL_POOL_MIN_SIZE)
+        return calloc(count, size);
+
+    return pool_alloc(count * size, true);
+}
+
+void* iPixelRealloc(void* ptr, size_t size) {
+
+    if (ptr == NULL)
+        return iPixelAlloc(size);
+
+    size_t old = 0;
+
+    pthread_mutex_lock(&poolMutex);
+
+    const PoolBuffer_t* found = atomic_load(&liveCount) > 0 ? hashmap_get(live, &(PoolBuffer_t){.ptr = ptr}) : NULL;
+
+    if (found != NULL)
+        old = found->size;
+
+    pthread_mutex_unlock(&poolMutex);
+
+    if (found == NULL)
+        return realloc(ptr, size);
+
+    void* moved = iPixelAlloc(size);
+
+    if (moved == NULL)
+        return NULL;
+
+    memcpy(moved, ptr, old < size ? old : size);
+
+    pool_free(ptr);
+
+    return moved;
+}
+
+void iPixelFree(void* ptr) {
+
+    if (ptr != NULL && !pool_free(ptr))
+        free(ptr);
+}
+
+#else
+
+// no mmap, everything goes to the c allocator
+
+void* iPixelAlloc(size_t size) {
+    return malloc(size);
+}
+
+void* iPixelCalloc(size_t count, size_t size) {
+    return calloc(count, size);
+}
+
+void* iPixelRealloc(void* ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void iPixelFree(void* ptr) {
+    free(ptr);
+}
+
+#endif
+
+void* iPixelDataMemory(void* ptr, size_t size) {
+
+    if (ptr == NULL)
+        return iPixelAlloc(size);
+
+    iPixelFree(ptr);
+
+    return NULL;
+}
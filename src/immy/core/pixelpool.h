@@ -0,0 +1,31 @@
+
+#ifndef IMMY_PIXELPOOL_H
+#define IMMY_PIXELPOOL_H
+
+// This header is force included into every raylib and immy source by CMake,
+// so it has to stand on its own and come before raylib.h.
+
+#include <stddef.h>
+
+// Allocates like malloc, big buffers come from the pixel pool.
+void* iPixelAlloc(size_t size);
+
+// Allocates like calloc, big buffers come from the pixel pool.
+void* iPixelCalloc(size_t count, size_t size);
+
+// Reallocates like realloc, pooled buffers are moved with a copy.
+void* iPixelRealloc(void* ptr, size_t size);
+
+// Frees anything from the functions above, or from malloc.
+void iPixelFree(void* ptr);
+
+// The imlib2 data memory hook, allocates size bytes when ptr is NULL and frees ptr otherwise.
+void* iPixelDataMemory(void* ptr, size_t size);
+
+// raylib frees image data itself, so everything it allocates goes through the pool
+#define RL_MALLOC(sz) iPixelAlloc(sz)
+#define RL_CALLOC(n, sz) iPixelCalloc(n, sz)
+#define RL_REALLOC(ptr, sz) iPixelRealloc(ptr, sz)
+#define RL_FREE(ptr) iPixelFree(ptr)
+
+#endif
@@ -0,0 +1,220 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../config.h"
+#include "core.h"
+
+typedef struct {
+        char**        paths;
+        size_t        count;
+        atomic_size_t next;    // index of the next path to take
+        atomic_size_t made;    // thumbnails written
+        atomic_size_t skipped; // cache was already valid
+        atomic_size_t failed;  // could not decode or save
+        atomic_size_t bytes;   // bytes of source images decoded
+} PregenState_t;
+
+// true if every level is already cached
+static bool is_cached(const char* path, char** cachePaths) {
+
+    for (int i = 0; i < THUMB_LEVEL_COUNT; i++) {
+
+        if (!iIsThumbCacheValid(path, cachePaths[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static void pregen_one(PregenState_t* state, const char* path) {
+
+    char* cachePaths[THUMB_LEVEL_COUNT] = {0};
+
+    bool ok = true;
+
+    for (int i = 0; i < THUMB_LEVEL_COUNT && ok; i++)
+        ok = (cachePaths[i] = iGetCachedPath(path, iGetThumbLevelSize(i))) != NULL;
+
+    if (ok && is_cached(path, cachePaths)) {
+
+        atomic_fetch_add(&state->skipped, 1);
+
+        goto done;
+    }
+
+    struct stat st;
+
+    if (ok && stat(path, &st) == 0)
+        atomic_fetch_add(&state->bytes, st.st_size);
+
+    Image image;
+    Image levels[THUMB_LEVEL_COUNT];
+
+    ok = ok && iLoadImageThreadSafe(path, &image);
+
+    if (ok) {
+
+        ok = iCreateThumbLevels(&image, levels);
+
+        UnloadImage(image);
+    }
+
+    if (ok) {
+
+        // saved right here, a queue would only hold more thumbnails in memory
+        for (int i = 0; i < THUMB_LEVEL_COUNT; i++) {
+
+            ImmyImage_t im = {
+                .path         = (char*)path,
+                .thumb        = levels[i],
+                .thumb_size   = iGetThumbLevelSize(i),
+                .state        = &(ImmyImageState_t){.thumb_status = IMAGE_STATUS_LOADED},
+            };
+
+            ok = iSaveThumbnailAt(&im, cachePaths[i]) && ok;
+
+            UnloadImage(levels[i]);
+        }
+    }
+
+    if (ok) {
+        atomic_fetch_add(&state->made, 1);
+    } else {
+        L_W("Could not create a thumbnail for %s", path);
+        atomic_fetch_add(&state->failed, 1);
+    }
+
+done:
+    for (int i = 0; i < THUMB_LEVEL_COUNT; i++)
+        free(cachePaths[i]);
+}
+
+static void* pregen_thread_main(void* raw_arg) {
+
+    PregenState_t* state = raw_arg;
+
+    for (;;) {
+
+        size_t i = atomic_fetch_add(&state->next, 1);
+
+        if (i >= state->count)
+            break;
+
+        pregen_one(state, state->paths[i]);
+    }
+
+    return NULL;
+}
+
+static void add_path(PregenState_t* state, size_t* cap, const char* path) {
+
+    if (state->count == *cap) {
+
+        size_t newCap   = *cap == 0 ? 256 : *cap * 2;
+        char** newPaths = realloc(state->paths, newCap * sizeof(char*));
+
+        DIE_IF_NULL(newPaths, "%s: Cannot grow the path list", __func__);
+
+        state->paths = newPaths;
+        *cap         = newCap;
+    }
+
+    state->paths[state->count++] = ieStrDup(path);
+}
+
+int iPregenThumbnails(int argc, char* argv[]) {
+
+    PregenState_t state = {0};
+    size_t        cap   = 0;
+
+    for (int i = 0; i < argc; i++) {
+
+        if (!FileExists(argv[i])) {
+
+            L_W("%s does not exist", argv[i]);
+
+            continue;
+        }
+
+        if (!DirectoryExists(argv[i])) {
+
+            add_path(&state, &cap, argv[i]);
+
+            continue;
+        }
+
+        L_I("Scanning directory %s for files", argv[i]);
+
+        FilePathList fpl = LoadDirectoryFilesEx(argv[i], IMAGE_FILE_FILTER, SEARCH_DIRS_RECURSIVE);
+
+        for (size_t j = 0; j < fpl.count; j++)
+            add_path(&state, &cap, fpl.paths[j]);
+
+        UnloadDirectoryFiles(fpl);
+    }
+
+    if (state.count == 0) {
+
+        L_E("No images to make thumbnails for\n\n" CLI_HELP);
+
+        return 1;
+    }
+
+    int threadCount = iGetCPUCount();
+
+    if (PREGEN_THUMBS_MAX_THREADS > 0 && threadCount > PREGEN_THUMBS_MAX_THREADS)
+        threadCount = PREGEN_THUMBS_MAX_THREADS;
+
+    if ((size_t)threadCount > state.count)
+        threadCount = state.count;
+
+    L_I("Making thumbnails for %zu images using %d threads", state.count, threadCount);
+
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    bool*      started = calloc(threadCount, sizeof(bool));
+
+    DIE_IF_NULL(threads, "%s: Cannot allocate threads", __func__);
+    DIE_IF_NULL(started, "%s: Cannot allocate threads", __func__);
+
+    double start = iGetTime();
+
+    // this thread is the first worker
+    for (int i = 1; i < threadCount; i++)
+        started[i] = pthread_create(threads + i, NULL, pregen_thread_main, &state) == 0;
+
+    pregen_thread_main(&state);
+
+    for (int i = 1; i < threadCount; i++) {
+
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    double elapsed = iGetTime() - start;
+
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    size_t made    = atomic_load(&state.made);
+    size_t skipped = atomic_load(&state.skipped);
+    size_t failed  = atomic_load(&state.failed);
+    size_t bytes   = atomic_load(&state.bytes);
+
+    printf("%zu made, %zu already cached, %zu failed in %.2fs\n", made, skipped, failed, elapsed);
+    printf("%.1f images/s, %.1f MB/s\n", (made + failed) / elapsed, BYTES_TO_MB(bytes) / elapsed);
+
+    for (size_t i = 0; i < state.count; i++)
+        free(state.paths[i]);
+
+    free(state.paths);
+    free(started);
+    free(threads);
+
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,284 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+#if defined(IMYLIB2_AVAILABLE) && USE_IMYLIB2
+#    include <imylib2.h>
+#endif
+
+static inline uint16_t be16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Days since 1970-01-01 of a date in the proleptic gregorian calendar.
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+
+    y -= m <= 2;
+
+    const int64_t  era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+// Parses an exif date, "YYYY:MM:DD HH:MM:SS".
+// There is no time zone, so it is read as UTC, which is fine for ordering.
+static int64_t parse_exif_date(const uint8_t* s, size_t n) {
+
+    int y, mo, d, h, mi, sec;
+    char buf[20];
+
+    if (n < 19)
+        return 0;
+
+    memcpy(buf, s, 19);
+
+    buf[19] = 0;
+
+    if (sscanf(buf, "%4d:%2d:%2d %2d:%2d:%2d", &y, &mo, &d, &h, &mi, &sec) != 6 || mo < 1 || mo > 12 || d < 1 ||
+        d > 31)
+        return 0;
+
+    return days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+}
+
+typedef struct {
+        const uint8_t* tiff;
+        size_t         size;
+        bool           le;
+} Exif_t;
+
+static inline uint16_t exif16(const Exif_t* e, size_t off) {
+    return e->le ? le16(e->tiff + off) : be16(e->tiff + off);
+}
+
+static inline uint32_t exif32(const Exif_t* e, size_t off) {
+    return e->le ? le32(e->tiff + off) : be32(e->tiff + off);
+}
+
+// Finds the tag in the IFD at ifd, returns the offset of its entry or 0.
+static size_t exif_find(const Exif_t* e, size_t ifd, uint16_t tag) {
+
+    if (ifd == 0 || ifd + 2 > e->size)
+        return 0;
+
+    uint16_t count = exif16(e, ifd);
+
+    for (size_t i = 0; i < count; i++) {
+
+        size_t entry = ifd + 2 + i * 12;
+
+        if (entry + 12 > e->size)
+            return 0;
+
+        if (exif16(e, entry) == tag)
+            return entry;
+    }
+
+    return 0;
+}
+
+static int64_t exif_date(const Exif_t* e, size_t entry) {
+
+    if (entry == 0)
+        return 0;
+
+    size_t count = exif32(e, entry + 4);
+    size_t off   = exif32(e, entry + 8);
+
+    if (count < 19 || off + 19 > e->size)
+        return 0;
+
+    return parse_exif_date(e->tiff + off, e->size - off);
+}
+
+// Reads the capture date from the tiff structure inside an APP1 segment.
+static void parse_exif(const uint8_t* tiff, size_t size, ImageMeta_t* meta) {
+
+    if (size < 8 || (memcmp(tiff, "II", 2) != 0 && memcmp(tiff, "MM", 2) != 0))
+        return;
+
+    Exif_t e = {.tiff = tiff, .size = size, .le = tiff[0] == 'I'};
+
+    size_t ifd0    = exif32(&e, 4);
+    size_t exifPtr = exif_find(&e, ifd0, 0x8769);
+
+    // DateTimeOriginal, then DateTime which is when the file was last changed
+    if (exifPtr != 0)
+        meta->taken = exif_date(&e, exif_find(&e, exif32(&e, exifPtr + 8), 0x9003));
+
+    if (meta->taken == 0)
+        meta->taken = exif_date(&e, exif_find(&e, ifd0, 0x0132));
+}
+
+static inline bool is_sof(int marker) {
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// Walks the jpeg segments until the frame header for the exif capture date, 0 if there is none.
+// Only the segment headers and the exif segment are read, the size comes from the loader.
+static int64_t read_jpeg_taken(const char* path) {
+
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL)
+        return 0;
+
+    ImageMeta_t meta = {0};
+    uint8_t     soi[3];
+
+    bool ok = fread(soi, 1, 3, f) == 3 && soi[0] == 0xFF && soi[1] == 0xD8 && soi[2] == 0xFF &&
+              fseek(f, 2, SEEK_SET) == 0;
+
+    while (ok && meta.taken == 0) {
+
+        if (fgetc(f) != 0xFF)
+            break;
+
+        int marker;
+
+        do {
+            marker = fgetc(f);
+        } while (marker == 0xFF);
+
+        // the exif segment comes before the image data
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA || is_sof(marker))
+            break;
+
+        // markers without a length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+            continue;
+
+        uint8_t lenb[2];
+
+        if (fread(lenb, 1, 2, f) != 2 || be16(lenb) < 2)
+            break;
+
+        size_t len = be16(lenb) - 2;
+
+        if (marker == 0xE1 && len > 6) {
+
+            uint8_t* seg = malloc(len);
+
+            if (seg == NULL || fread(seg, 1, len, f) != len) {
+
+                free(seg);
+
+                break;
+            }
+
+            if (memcmp(seg, "Exif\0\0", 6) == 0)
+                parse_exif(seg + 6, len - 6, &meta);
+
+            free(seg);
+
+            continue;
+        }
+
+        if (fseek(f, len, SEEK_CUR) != 0)
+            break;
+    }
+
+    fclose(f);
+
+    return meta.taken;
+}
+
+typedef struct {
+        const char* const* paths;
+        const char**       formats; // the loader which read each file, NULL without imylib2
+        ImageMeta_t*       metas;
+} TakenJob_t;
+
+static void taken_range(size_t begin, size_t end, void* arg) {
+
+    TakenJob_t* job = arg;
+
+    for (size_t i = begin; i < end; i++) {
+
+        const char* path = job->paths[i];
+
+        // only jpegs carry exif here
+        bool jpeg = job->formats != NULL ? job->formats[i] != NULL && strcmp(job->formats[i], "jpeg") == 0
+                                         : iEndsWith(path, ".jpg", true) || iEndsWith(path, ".jpeg", true);
+
+        if (jpeg)
+            job->metas[i].taken = read_jpeg_taken(path);
+    }
+}
+
+size_t iProbeImageHeaders(const char* const* paths, size_t count, ImageMeta_t* metas, int threads) {
+
+    TakenJob_t job   = {.paths = paths, .metas = metas};
+    size_t     found = 0;
+
+    for (size_t i = 0; i < count; i++) {
+
+        metas[i].width  = 0;
+        metas[i].height = 0;
+        metas[i].taken  = 0;
+    }
+
+#if defined(IMYLIB2_AVAILABLE) && USE_IMYLIB2
+
+    ImlibImageInfo* infos = malloc(MAX(1, count) * sizeof(ImlibImageInfo));
+
+    job.formats = malloc(MAX(1, count) * sizeof(char*));
+
+    if (infos == NULL || job.formats == NULL) {
+
+        free(infos);
+        free(job.formats);
+
+        return 0;
+    }
+
+    // the loaders read the headers, every format they know is probed the same way
+    il2ProbeBatch(paths, count, infos, threads);
+
+    for (size_t i = 0; i < count; i++) {
+
+        job.formats[i] = infos[i].format;
+
+        if (infos[i].format == NULL || infos[i].w <= 0 || infos[i].h <= 0)
+            continue;
+
+        metas[i].width  = infos[i].w;
+        metas[i].height = infos[i].h;
+
+        found++;
+    }
+
+    free(infos);
+#endif
+
+    iParallelFor(count, taken_range, &job, threads);
+
+    free(job.formats);
+
+    return found;
+}
+
+bool iProbeImageHeader(const char* path, ImageMeta_t* meta) {
+
+    return iProbeImageHeaders(&path, 1, meta, 1) == 1;
+}
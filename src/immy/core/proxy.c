@@ -0,0 +1,117 @@
+
+#include <raylib.h>
+#include <stdatomic.h>
+
+#include "../config.h"
+#include "core.h"
+
+// set from the main thread, read by the loading threads
+static atomic_int proxySize = 0;
+
+void iSetProxySize(int size) {
+
+    atomic_store(&proxySize, USE_PROXY_IMAGES ? MAX(0, size) : 0);
+}
+
+bool iWantsProxy(int width, int height) {
+
+    int size = atomic_load(&proxySize);
+
+    return size > 0 && MAX(width, height) > size * PROXY_MIN_RATIO;
+}
+
+bool iMakeProxy(ImmyImage_t* im) {
+
+    if (im->isProxy || im->isEdited || !iWantsProxy(im->rayim.width, im->rayim.height))
+        return false;
+
+    int size = atomic_load(&proxySize);
+    int w    = size;
+    int h    = size;
+
+    // keep the aspect ratio, but never go below 1 pixel
+    if (im->rayim.width > im->rayim.height) {
+
+        h = MAX(1, (double)im->rayim.height / im->rayim.width * size);
+
+    } else {
+
+        w = MAX(1, (double)im->rayim.width / im->rayim.height * size);
+    }
+
+    Image proxy;
+
+    // not gamma correct, this is what the mipmaps it replaces looked like
+    if (!iCopyAndResizeImageBox(&im->rayim, &proxy, w, h, false))
+        return false;
+
+    L_D("%s: %dx%d is shown as %dx%d", __func__, im->rayim.width, im->rayim.height, w, h);
+
+    UnloadImage(im->rayim);
+
+    im->rayim   = proxy;
+    im->isProxy = true;
+
+    return true;
+}
+
+// Decodes the full image on this thread.
+static bool promote_now(ImmyImage_t* im) {
+
+    // the thumbnail is loaded so it is not made again
+    ImmyImage_t full = {.path = im->path, .state = &(ImmyImageState_t){.thumb_status = IMAGE_STATUS_LOADED}};
+
+    if (!iLoadImage(&full) || full.rayim.width != im->srcRect.width || full.rayim.height != im->srcRect.height) {
+
+        L_W("%s: Could not load the full image %s, keeping the proxy", __func__, im->path);
+
+        UnloadImage(full.rayim);
+
+        // still a proxy, but don't try again every frame
+        im->promoteFailed = true;
+
+        return false;
+    }
+
+    UnloadImage(im->rayim);
+
+    im->rayim   = full.rayim;
+    im->isProxy = false;
+
+    return true;
+}
+
+bool iPromoteImage(ImmyImage_t* im, bool wait) {
+
+    if (!im->isProxy || im->promoteFailed || im->state->status != IMAGE_STATUS_LOADED)
+        return false;
+
+#if ASYNC_IMAGE_LOADING
+
+    if (iAsyncHasImage(im)) {
+
+        if (!(wait ? iWaitImageAsync(im) : iGetImageAsync(im)))
+            return false;
+
+        return !im->isProxy;
+    }
+
+    if (!wait) {
+
+        if (!iLoadImageAsync(im))
+            L_W("%s: Unable to start loading the full image", __func__);
+
+        return false;
+    }
+#endif
+
+    return promote_now(im);
+}
+
+bool iDemoteImage(ImmyImage_t* im) {
+
+    if (im->state->status != IMAGE_STATUS_LOADED || im->rebuildBuff)
+        return false;
+
+    return iMakeProxy(im);
+}
@@ -0,0 +1,508 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "../external/hashmap.h"
+#include "core.h"
+#include "external/qoi.h" // from raylib
+
+// What is kept of an image once its pixels leave RAM.
+typedef struct {
+        const char* path;      // interned, the key
+        size_t      lastShown; // residency clock when it was last selected, 0 if never
+
+        void*     qoi;      // compressed pixels, NULL if there are none
+        int       qoiSize;
+        Image     raw;      // the pixels as they were, only when compressing them failed
+        Rectangle srcRect;  // the full size, the pixels may be a proxy
+        int       width;    // size of the pixels the copy was made from
+        int       height;
+        bool      isProxy;
+        bool      isEdited;
+        bool      pending;  // queued or being compressed
+        int       readers;  // threads decoding qoi right now, it cannot be freed until they are done
+
+} PackedImage_t;
+
+typedef struct {
+        const char*    path;
+        PackedImage_t* packed;
+} PackedItem_t;
+
+// Pixels waiting to be compressed, the image gave them up already.
+typedef struct PackJob {
+        PackedImage_t*  packed;
+        Image           raw;
+        struct PackJob* next;
+} PackJob_t;
+
+// images in the list are selected here, so only the main thread writes entries
+// but the loading threads read them, everything below is under packMutex
+static pthread_mutex_t packMutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  packDoneCond  = PTHREAD_COND_INITIALIZER; // signaled when a job finishes
+static pthread_cond_t  packWakeCond  = PTHREAD_COND_INITIALIZER; // signaled when a job is queued
+static struct hashmap* packedImages  = NULL;
+static PackJob_t*      packHead      = NULL;
+static PackJob_t*      packTail      = NULL;
+static pthread_t       packThread;
+static bool            packThreadOk  = false;
+static bool            packThreadRun = false;
+static size_t          packedBytes   = 0;
+
+// main thread only
+static size_t      residencyClock = 0;
+static const char* lastSelected   = NULL;
+
+static uint64_t packed_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    const char* path = ((const PackedItem_t*)item)->path;
+
+    return hashmap_sip(&path, sizeof(path), seed0, seed1);
+}
+
+static int packed_cmp(const void* a, const void* b, void* udata) {
+
+    const char* pa = ((const PackedItem_t*)a)->path;
+    const char* pb = ((const PackedItem_t*)b)->path;
+
+    return (pa > pb) - (pa < pb);
+}
+
+// Must hold packMutex.
+static PackedImage_t* find_packed(const char* path) {
+
+    if (packedImages == NULL)
+        return NULL;
+
+    const PackedItem_t* item = hashmap_get(packedImages, &(PackedItem_t){.path = path});
+
+    return item != NULL ? item->packed : NULL;
+}
+
+// Must hold packMutex.
+static PackedImage_t* get_or_add_packed(const char* path) {
+
+    PackedImage_t* p = find_packed(path);
+
+    if (p != NULL)
+        return p;
+
+    if (packedImages == NULL) {
+
+        packedImages = hashmap_new(sizeof(PackedItem_t), 0, 0, 0, packed_hash, packed_cmp, NULL, NULL);
+
+        if (packedImages == NULL)
+            return NULL;
+    }
+
+    p = calloc(1, sizeof(PackedImage_t));
+
+    if (p == NULL)
+        return NULL;
+
+    p->path = path;
+
+    hashmap_set(packedImages, &(PackedItem_t){.path = path, .packed = p});
+
+    if (hashmap_oom(packedImages)) {
+
+        free(p);
+
+        return NULL;
+    }
+
+    return p;
+}
+
+// Must hold packMutex, and nothing may be reading it.
+static void drop_qoi(PackedImage_t* p) {
+
+    RL_FREE(p->qoi);
+
+    packedBytes -= p->qoiSize;
+
+    p->qoi     = NULL;
+    p->qoiSize = 0;
+}
+
+static void* compress(Image* raw, int* size) {
+
+    // qoi only knows rgb and rgba, gray is packed again when it is decoded
+    if (raw->format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE)
+        ImageFormat(raw, PIXELFORMAT_UNCOMPRESSED_R8G8B8);
+
+    else if (raw->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8)
+        ImageFormat(raw, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    qoi_desc desc = {
+        .width      = raw->width,
+        .height     = raw->height,
+        .channels   = raw->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8 ? 3 : 4,
+        .colorspace = QOI_SRGB,
+    };
+
+    void* qoi = raw->data != NULL ? qoi_encode(raw->data, &desc, size) : NULL;
+
+    if (qoi == NULL)
+        return NULL;
+
+    // the encoder allocates for the worst case
+    void* shrunk = RL_REALLOC(qoi, *size);
+
+    return shrunk != NULL ? shrunk : qoi;
+}
+
+static void* pack_thread_main(void* arg) {
+
+    (void)arg;
+
+    pthread_mutex_lock(&packMutex);
+
+    while (packThreadRun) {
+
+        if (packHead == NULL) {
+
+            pthread_cond_wait(&packWakeCond, &packMutex);
+
+            continue;
+        }
+
+        PackJob_t* job = packHead;
+
+        packHead = job->next;
+
+        if (packHead == NULL)
+            packTail = NULL;
+
+        pthread_mutex_unlock(&packMutex);
+
+        int   size = 0;
+        void* qoi  = compress(&job->raw, &size);
+
+        pthread_mutex_lock(&packMutex);
+
+        PackedImage_t* p = job->packed;
+
+        if (qoi != NULL) {
+
+            p->qoi      = qoi;
+            p->qoiSize  = size;
+            packedBytes += size;
+
+            UnloadImage(job->raw);
+
+        } else {
+
+            L_W("%s: Could not compress %s, keeping it as is", __func__, p->path);
+
+            p->raw = job->raw;
+        }
+
+        p->pending = false;
+
+        free(job);
+
+        pthread_cond_broadcast(&packDoneCond);
+    }
+
+    pthread_mutex_unlock(&packMutex);
+
+    return NULL;
+}
+
+// Must hold packMutex.
+static bool queue_pack(PackedImage_t* p, Image raw) {
+
+    if (!packThreadOk) {
+
+        packThreadRun = true;
+        packThreadOk  = pthread_create(&packThread, NULL, pack_thread_main, NULL) == 0;
+
+        if (!packThreadOk) {
+
+            L_E("%s: Could not start the compression thread", __func__);
+
+            return false;
+        }
+    }
+
+    PackJob_t* job = calloc(1, sizeof(PackJob_t));
+
+    if (job == NULL)
+        return false;
+
+    job->packed = p;
+    job->raw    = raw;
+    p->pending  = true;
+    p->width    = raw.width;
+    p->height   = raw.height;
+
+    if (packTail == NULL) {
+        packHead = job;
+    } else {
+        packTail->next = job;
+    }
+
+    packTail = job;
+
+    pthread_cond_signal(&packWakeCond);
+
+    return true;
+}
+
+bool iUnpackImage(const char* path, ImmyImage_t* im) {
+
+    pthread_mutex_lock(&packMutex);
+
+    PackedImage_t* p = find_packed(path);
+
+    // an edited image would lose its edits if it was decoded from its file now
+    while (p != NULL && p->pending)
+        pthread_cond_wait(&packDoneCond, &packMutex);
+
+    if (p == NULL || (p->qoi == NULL && !IsImageReady(p->raw))) {
+
+        pthread_mutex_unlock(&packMutex);
+
+        return false;
+    }
+
+    im->srcRect  = p->srcRect;
+    im->isProxy  = p->isProxy;
+    im->isEdited = p->isEdited;
+
+    if (IsImageReady(p->raw)) {
+
+        im->rayim = p->raw;
+        p->raw    = (Image){0};
+
+        pthread_mutex_unlock(&packMutex);
+
+        return true;
+    }
+
+    const void* qoi  = p->qoi;
+    int         size = p->qoiSize;
+
+    p->readers++;
+
+    pthread_mutex_unlock(&packMutex);
+
+    qoi_desc desc;
+    void*    pixels = qoi_decode(qoi, size, &desc, 0);
+
+    pthread_mutex_lock(&packMutex);
+
+    p->readers--;
+
+    pthread_mutex_unlock(&packMutex);
+
+    if (pixels == NULL)
+        return false;
+
+    im->rayim = (Image){
+        .data    = pixels,
+        .width   = desc.width,
+        .height  = desc.height,
+        .mipmaps = 1,
+        .format  = desc.channels == 3 ? PIXELFORMAT_UNCOMPRESSED_R8G8B8 : PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+#if PACK_IMAGE_CHANNELS
+    iPackImageChannels(&im->rayim, desc.channels == 4);
+#endif
+
+    return true;
+}
+
+typedef struct {
+        ImmyImage_t* im;
+        size_t       lastShown;
+} ResidencyCandidate_t;
+
+static int candidate_cmp(const void* a, const void* b) {
+
+    size_t la = ((const ResidencyCandidate_t*)a)->lastShown;
+    size_t lb = ((const ResidencyCandidate_t*)b)->lastShown;
+
+    return (la > lb) - (la < lb);
+}
+
+// Moves the pixels of the image to its compressed copy, making it when there is none.
+// Must hold packMutex.
+static bool demote(ImmyImage_t* im) {
+
+    PackedImage_t* p = get_or_add_packed(im->path);
+
+    if (p == NULL || p->pending || p->readers > 0)
+        return false;
+
+    // the pixels are the ones the copy was made from, unless the image was promoted or demoted since
+    bool same = (p->qoi != NULL || IsImageReady(p->raw)) && !im->isEdited && p->isProxy == im->isProxy &&
+                p->width == im->rayim.width && p->height == im->rayim.height;
+
+    if (same) {
+
+        UnloadImage(im->rayim);
+
+    } else {
+
+        if (p->qoi != NULL)
+            drop_qoi(p);
+
+        UnloadImage(p->raw);
+
+        p->raw = (Image){0};
+
+        if (!queue_pack(p, im->rayim))
+            return false;
+    }
+
+    p->srcRect  = im->srcRect;
+    p->isProxy  = im->isProxy;
+    p->isEdited = im->isEdited;
+
+    im->rayim         = (Image){0};
+    im->state->status = IMAGE_STATUS_NOT_LOADED;
+
+    return true;
+}
+
+void iUpdateResidency(ImmyControl_t* ctrl) {
+
+    const char* selected = ctrl->selected_image != NULL ? ctrl->selected_image->path : NULL;
+
+    // nothing new is shown between selections, so checking every so often is enough
+    if (selected == lastSelected && ctrl->frame % RESIDENCY_CHECK_FRAMES != 0)
+        return;
+
+    pthread_mutex_lock(&packMutex);
+
+    if (selected != lastSelected && selected != NULL) {
+
+        PackedImage_t* p = get_or_add_packed(selected);
+
+        if (p != NULL)
+            p->lastShown = ++residencyClock;
+    }
+
+    lastSelected = selected;
+
+    size_t rawBytes = 0;
+    size_t count    = 0;
+
+    ResidencyCandidate_t* candidates = malloc(ctrl->image_files.size * sizeof(ResidencyCandidate_t));
+
+    // only the states column is walked for the many images which are not loaded
+    DARRAY_FOR_EACH(ctrl->image_files, i) {
+
+        if (ctrl->image_files.states[i].status != IMAGE_STATUS_LOADED)
+            continue;
+
+        ImmyImage_t* im = ctrl->image_files.images + i;
+
+        rawBytes += GetPixelDataSize(im->rayim.width, im->rayim.height, im->rayim.format);
+
+        // the shown image, images which are busy, and images only loaded for their thumbnail are left alone
+        if (candidates == NULL || im == ctrl->selected_image || im->isLoadingForThumbOnly || im->rebuildBuff ||
+            iAsyncHasImage(im) || iDitherProgress(im) >= 0)
+            continue;
+
+        PackedImage_t* p = find_packed(im->path);
+
+        candidates[count++] = (ResidencyCandidate_t){im, p != NULL ? p->lastShown : 0};
+    }
+
+    if (rawBytes > RESIDENT_RAW_BUDGET && count > 0) {
+
+        qsort(candidates, count, sizeof(ResidencyCandidate_t), candidate_cmp);
+
+        for (size_t i = 0; i < count && rawBytes > RESIDENT_RAW_BUDGET; i++) {
+
+            ImmyImage_t* im   = candidates[i].im;
+            size_t       size = GetPixelDataSize(im->rayim.width, im->rayim.height, im->rayim.format);
+
+            L_D("%s: Compressing %s, it was last shown at %zu", __func__, im->path, candidates[i].lastShown);
+
+            if (demote(im))
+                rawBytes -= size;
+        }
+    }
+
+    free(candidates);
+
+    // past the compressed budget the least recently shown copies go, their files are still there
+    while (packedBytes > RESIDENT_PACKED_BUDGET) {
+
+        PackedImage_t* oldest = NULL;
+        size_t         iter   = 0;
+        void*          item;
+
+        while (hashmap_iter(packedImages, &iter, &item)) {
+
+            PackedImage_t* p = ((PackedItem_t*)item)->packed;
+
+            // edits only live here, so they are never dropped
+            if (p->qoi == NULL || p->isEdited || p->readers > 0)
+                continue;
+
+            if (oldest == NULL || p->lastShown < oldest->lastShown)
+                oldest = p;
+        }
+
+        if (oldest == NULL)
+            break;
+
+        drop_qoi(oldest);
+    }
+
+    pthread_mutex_unlock(&packMutex);
+}
+
+void iResidencyDeinit() {
+
+    pthread_mutex_lock(&packMutex);
+
+    packThreadRun = false;
+
+    pthread_cond_signal(&packWakeCond);
+    pthread_mutex_unlock(&packMutex);
+
+    if (packThreadOk)
+        pthread_join(packThread, NULL);
+
+    for (PackJob_t* job = packHead; job != NULL;) {
+
+        PackJob_t* next = job->next;
+
+        UnloadImage(job->raw);
+        free(job);
+
+        job = next;
+    }
+
+    packHead = NULL;
+    packTail = NULL;
+
+    if (packedImages == NULL)
+        return;
+
+    size_t iter = 0;
+    void*  item;
+
+    while (hashmap_iter(packedImages, &iter, &item)) {
+
+        PackedImage_t* p = ((PackedItem_t*)item)->packed;
+
+        RL_FREE(p->qoi);
+        UnloadImage(p->raw);
+        free(p);
+    }
+
+    hashmap_free(packedImages);
+
+    packedImages = NULL;
+}
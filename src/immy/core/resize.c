@@ -0,0 +1,351 @@
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raylib.h"
+
+#include "../config.h"
+#include "core.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define RESIZE_X86 1
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    define RESIZE_NEON 1
+#    include <arm_neon.h>
+#endif
+
+// Adds n bytes of a source row into a row of 32 bit sums.
+typedef void (*AccumulateRowFunc_t)(uint32_t* restrict acc, const uint8_t* restrict src, size_t n);
+
+// gamma tables, srgb -> 12 bit linear and back
+#define LINEAR_BITS 12
+#define LINEAR_MAX ((1 << LINEAR_BITS) - 1)
+
+static uint16_t toLinear[256];
+static uint8_t  toSRGB[LINEAR_MAX + 1];
+
+static pthread_once_t      resizeInitOnce = PTHREAD_ONCE_INIT;
+static AccumulateRowFunc_t accumulateRow  = NULL;
+
+static void accumulate_row_scalar(uint32_t* restrict acc, const uint8_t* restrict src, size_t n) {
+
+    for (size_t i = 0; i < n; i++)
+        acc[i] += src[i];
+}
+
+#ifdef RESIZE_X86
+
+__attribute__((target("sse2"))) static void
+accumulate_row_sse2(uint32_t* restrict acc, const uint8_t* restrict src, size_t n) {
+
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+
+        __m128i px = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+        __m128i* a = (__m128i*)(acc + i);
+
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+
+    accumulate_row_scalar(acc + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+accumulate_row_avx2(uint32_t* restrict acc, const uint8_t* restrict src, size_t n) {
+
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+
+        __m256i* a = (__m256i*)(acc + i);
+
+        for (int k = 0; k < 4; k++) {
+
+            __m256i px = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + k * 8)));
+
+            _mm256_storeu_si256(a + k, _mm256_add_epi32(_mm256_loadu_si256(a + k), px));
+        }
+    }
+
+    accumulate_row_scalar(acc + i, src + i, n - i);
+}
+
+#endif
+
+#ifdef RESIZE_NEON
+
+static void accumulate_row_neon(uint32_t* restrict acc, const uint8_t* restrict src, size_t n) {
+
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+
+        uint8x16_t px = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(px));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(px));
+
+        vst1q_u32(acc + i + 0, vaddw_u16(vld1q_u32(acc + i + 0), vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8, vaddw_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+    }
+
+    accumulate_row_scalar(acc + i, src + i, n - i);
+}
+
+#endif
+
+static void resize_init() {
+
+    accumulateRow = accumulate_row_scalar;
+
+#if defined(RESIZE_X86)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+
+        accumulateRow = accumulate_row_avx2;
+
+    } else if (__builtin_cpu_supports("sse2")) {
+
+        accumulateRow = accumulate_row_sse2;
+    }
+
+#elif defined(RESIZE_NEON)
+
+    accumulateRow = accumulate_row_neon;
+#endif
+
+    for (int i = 0; i < 256; i++) {
+
+        double c = i / 255.0;
+        double l = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+
+        toLinear[i] = (uint16_t)(l * LINEAR_MAX + 0.5);
+    }
+
+    for (int i = 0; i <= LINEAR_MAX; i++) {
+
+        double l = (double)i / LINEAR_MAX;
+        double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1 / 2.4) - 0.055;
+
+        toSRGB[i] = (uint8_t)(c * 255 + 0.5);
+    }
+}
+
+// the alpha channel is never gamma corrected
+static void accumulate_row_linear(uint32_t* restrict acc, const uint8_t* restrict src, size_t n, int channels) {
+
+    bool hasAlpha = channels == 2 || channels == 4;
+
+    for (size_t i = 0; i < n; i += channels) {
+
+        for (int c = 0; c < channels; c++) {
+
+            if (hasAlpha && c == channels - 1) {
+                acc[i + c] += src[i + c];
+            } else {
+                acc[i + c] += toLinear[src[i + c]];
+            }
+        }
+    }
+}
+
+static int channels_for_format(int format) {
+
+    switch (format) {
+
+    case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE:
+        return 1;
+
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA:
+        return 2;
+
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8:
+        return 3;
+
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8:
+        return 4;
+    }
+
+    return 0;
+}
+
+typedef struct {
+        const uint8_t* src;
+        uint8_t*       dst;
+        int            srcW;
+        int            srcH;
+        int            dstW;
+        int            dstH;
+        int            channels;
+        bool           gamma;
+        atomic_bool    failed; // a worker could not get its row, its output rows are not written
+} BoxResizeJob_t;
+
+// Resizes the output rows [begin, end).
+// Every source row is read once, in order, and summed into a single row
+// before being reduced horizontally into the output.
+static void box_resize_rows(size_t begin, size_t end, void* arg) {
+
+    BoxResizeJob_t* job = arg;
+
+    const int    C      = job->channels;
+    const size_t rowLen = (size_t)job->srcW * C;
+
+    bool hasAlpha = C == 2 || C == 4;
+
+    uint32_t* acc = malloc(rowLen * sizeof(uint32_t));
+
+    if (acc == NULL) {
+
+        atomic_store(&job->failed, true);
+
+        return;
+    }
+
+    for (size_t oy = begin; oy < end; oy++) {
+
+        int sy0 = (oy * job->srcH) / job->dstH;
+        int sy1 = ((oy + 1) * job->srcH) / job->dstH;
+
+        if (sy1 <= sy0)
+            sy1 = sy0 + 1;
+
+        memset(acc, 0, rowLen * sizeof(uint32_t));
+
+        for (int sy = sy0; sy < sy1; sy++) {
+
+            const uint8_t* row = job->src + rowLen * sy;
+
+            if (job->gamma) {
+                accumulate_row_linear(acc, row, rowLen, C);
+            } else {
+                accumulateRow(acc, row, rowLen);
+            }
+        }
+
+        uint8_t* out = job->dst + (size_t)job->dstW * C * oy;
+
+        for (int ox = 0; ox < job->dstW; ox++) {
+
+            int sx0 = ((int64_t)ox * job->srcW) / job->dstW;
+            int sx1 = ((int64_t)(ox + 1) * job->srcW) / job->dstW;
+
+            if (sx1 <= sx0)
+                sx1 = sx0 + 1;
+
+            uint64_t area = (uint64_t)(sx1 - sx0) * (sy1 - sy0);
+
+            for (int c = 0; c < C; c++) {
+
+                uint64_t sum = 0;
+
+                for (int sx = sx0; sx < sx1; sx++)
+                    sum += acc[sx * C + c];
+
+                uint32_t v = (sum + area / 2) / area;
+
+                if (job->gamma && !(hasAlpha && c == C - 1)) {
+                    out[ox * C + c] = toSRGB[v > LINEAR_MAX ? LINEAR_MAX : v];
+                } else {
+                    out[ox * C + c] = v > 255 ? 255 : v;
+                }
+            }
+        }
+    }
+
+    free(acc);
+}
+
+bool iCopyAndResizeImageBox(const Image* im, Image* newim, int newW, int newH, bool gamma) {
+
+    if ((im->data == NULL) || (im->width <= 0) || (im->height <= 0) || newW <= 0 || newH <= 0)
+        return false;
+
+    pthread_once(&resizeInitOnce, resize_init);
+
+    int   format   = im->format;
+    int   channels = channels_for_format(format);
+    void* pixels   = im->data;
+
+    // anything we don't understand is resized as rgba
+    if (channels == 0) {
+
+        pixels   = LoadImageColors(*im);
+        format   = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+        channels = 4;
+
+        if (pixels == NULL)
+            return false;
+    }
+
+    uint8_t* output = RL_MALLOC((size_t)newW * newH * channels);
+
+    if (output == NULL) {
+
+        if (pixels != im->data)
+            UnloadImageColors(pixels);
+
+        return false;
+    }
+
+    BoxResizeJob_t job = {
+        .src      = pixels,
+        .dst      = output,
+        .srcW     = im->width,
+        .srcH     = im->height,
+        .dstW     = newW,
+        .dstH     = newH,
+        .channels = channels,
+        .gamma    = gamma,
+    };
+
+    // only split very large images, threads are not free
+    if ((size_t)im->width * im->height >= THUMB_RESIZE_PARALLEL_PIXELS) {
+
+        iParallelFor(newH, box_resize_rows, &job, THUMB_RESIZE_MAX_THREADS);
+
+    } else {
+
+        box_resize_rows(0, newH, &job);
+    }
+
+    if (atomic_load(&job.failed)) {
+
+        L_E("%s: Out of memory resizing to %dx%d", __func__, newW, newH);
+
+        RL_FREE(output);
+
+        if (pixels != im->data)
+            UnloadImageColors(pixels);
+
+        return false;
+    }
+
+    newim->data    = output;
+    newim->width   = newW;
+    newim->height  = newH;
+    newim->mipmaps = 1;
+    newim->format  = format;
+
+    if (pixels != im->data)
+        UnloadImageColors(pixels);
+
+    return true;
+}
@@ -0,0 +1,431 @@
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#    include <sys/syscall.h>
+#endif
+
+#include "../config.h"
+#include "core.h"
+
+#ifndef DT_UNKNOWN
+#    define DT_UNKNOWN 0
+#    define DT_DIR 4
+#    define DT_REG 8
+#    define DT_LNK 10
+#endif
+
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__) || defined(__FreeBSD__)
+#    define ENTRY_TYPE(e) ((e)->d_type)
+#else
+#    define ENTRY_TYPE(e) DT_UNKNOWN
+#endif
+
+#define MAX_EXTENSIONS 64
+
+// A directory waiting to be walked.
+typedef struct ScanDir {
+        char*           path;
+        int             group;
+        bool            recursive;
+        struct ScanDir* next;
+} ScanDir_t;
+
+static pthread_mutex_t scanMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  scanCond  = PTHREAD_COND_INITIALIZER;
+
+static ScanDir_t*   dirHead     = NULL; // directories waiting for a thread
+static ScanDir_t*   dirTail     = NULL;
+static ScanBatch_t* batchHead   = NULL; // batches waiting for the main thread
+static ScanBatch_t* batchTail   = NULL;
+static int          scanThreads = 0; // threads alive
+static int          scanBusy    = 0; // threads walking a directory, they may queue more
+
+// IsFileExtension uses a static buffer, so the filter is parsed once instead
+static pthread_once_t extOnce = PTHREAD_ONCE_INIT;
+static char           extBuf[sizeof(IMAGE_FILE_FILTER)];
+static const char*    extensions[MAX_EXTENSIONS];
+static int            extensionCount = 0;
+
+static void parse_extensions() {
+
+    memcpy(extBuf, IMAGE_FILE_FILTER, sizeof(extBuf));
+
+    char* save = NULL;
+
+    for (char* ext = strtok_r(extBuf, ";", &save); ext != NULL && extensionCount < MAX_EXTENSIONS;
+         ext       = strtok_r(NULL, ";", &save)) {
+
+        extensions[extensionCount++] = ext;
+    }
+}
+
+static bool is_image_file(const char* name) {
+
+    for (int i = 0; i < extensionCount; i++) {
+
+        if (iEndsWith(name, extensions[i], true))
+            return true;
+    }
+
+    return false;
+}
+
+// Must hold scanMutex.
+static void push_dir_locked(char* path, int group, bool recursive) {
+
+    ScanDir_t* dir = malloc(sizeof(ScanDir_t));
+
+    if (dir == NULL) {
+
+        L_E("%s: Cannot allocate, skipping %s", __func__, path);
+
+        free(path);
+
+        return;
+    }
+
+    *dir = (ScanDir_t){.path = path, .group = group, .recursive = recursive};
+
+    if (dirTail == NULL) {
+        dirHead = dir;
+    } else {
+        dirTail->next = dir;
+    }
+
+    dirTail = dir;
+
+    pthread_cond_signal(&scanCond);
+}
+
+static void push_batch(ScanBatch_t* batch) {
+
+    if (batch->count == 0) {
+
+        iScanFreeBatch(batch);
+
+        return;
+    }
+
+    pthread_mutex_lock(&scanMutex);
+
+    if (batchTail == NULL) {
+        batchHead = batch;
+    } else {
+        batchTail->next = batch;
+    }
+
+    batchTail = batch;
+
+    pthread_mutex_unlock(&scanMutex);
+}
+
+static ScanBatch_t* new_batch(int group) {
+
+    ScanBatch_t* batch = calloc(1, sizeof(ScanBatch_t));
+
+    if (batch == NULL)
+        return NULL;
+
+    batch->group = group;
+    batch->paths = malloc(SCAN_BATCH_SIZE * sizeof(char*));
+
+    if (batch->paths == NULL) {
+
+        free(batch);
+
+        return NULL;
+    }
+
+    return batch;
+}
+
+// Looks at a single directory entry.
+// The type from the directory entry is used when there is one,
+// only links and filesystems which do not give a type need a stat.
+static void handle_entry(const ScanDir_t* dir, int dirfd, const char* name, int type, ScanBatch_t** batch) {
+
+    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+        return;
+
+    bool isLink = type == DT_LNK;
+
+    if (type != DT_DIR && type != DT_REG) {
+
+        struct stat st;
+        int         r;
+
+#ifdef __linux__
+        r = fstatat(dirfd, name, &st, 0);
+#else
+        (void)dirfd;
+
+        char* full = iStrJoin(dir->path, name, "/");
+
+        r = full == NULL ? -1 : stat(full, &st);
+
+        free(full);
+#endif
+
+        if (r != 0)
+            return;
+
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR) {
+
+        // links to directories could loop forever
+        if (!dir->recursive || isLink)
+            return;
+
+        char* path = iStrJoin(dir->path, name, "/");
+
+        if (path == NULL)
+            return;
+
+        pthread_mutex_lock(&scanMutex);
+        push_dir_locked(path, dir->group, true);
+        pthread_mutex_unlock(&scanMutex);
+
+        return;
+    }
+
+    if (type != DT_REG || !is_image_file(name))
+        return;
+
+    if (*batch == NULL && (*batch = new_batch(dir->group)) == NULL)
+        return;
+
+    char* path = iStrJoin(dir->path, name, "/");
+
+    if (path == NULL)
+        return;
+
+    (*batch)->paths[(*batch)->count++] = path;
+
+    if ((*batch)->count == SCAN_BATCH_SIZE) {
+
+        push_batch(*batch);
+
+        *batch = NULL;
+    }
+}
+
+#ifdef __linux__
+
+// The glibc wrapper is fairly new, so the syscall is used directly.
+struct linux_dirent64 {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+};
+
+static void scan_directory(const ScanDir_t* dir, char* buf) {
+
+    int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd == -1) {
+
+        L_W("Cannot open directory %s: %s", dir->path, strerror(errno));
+
+        return;
+    }
+
+    ScanBatch_t* batch = NULL;
+
+    for (;;) {
+
+        long n = syscall(SYS_getdents64, fd, buf, SCAN_DIRENT_BUFFER);
+
+        if (n <= 0) {
+
+            if (n < 0)
+                L_W("Cannot read directory %s: %s", dir->path, strerror(errno));
+
+            break;
+        }
+
+        for (long off = 0; off < n;) {
+
+            struct linux_dirent64* e = (struct linux_dirent64*)(buf + off);
+
+            handle_entry(dir, fd, e->d_name, e->d_type, &batch);
+
+            off += e->d_reclen;
+        }
+    }
+
+    close(fd);
+
+    if (batch != NULL)
+        push_batch(batch);
+}
+
+#else
+
+static void scan_directory(const ScanDir_t* dir, char* buf) {
+
+    (void)buf;
+
+    DIR* d = opendir(dir->path);
+
+    if (d == NULL) {
+
+        L_W("Cannot open directory %s: %s", dir->path, strerror(errno));
+
+        return;
+    }
+
+    ScanBatch_t*   batch = NULL;
+    struct dirent* e;
+
+    while ((e = readdir(d)) != NULL)
+        handle_entry(dir, -1, e->d_name, ENTRY_TYPE(e), &batch);
+
+    closedir(d);
+
+    if (batch != NULL)
+        push_batch(batch);
+}
+
+#endif
+
+static void* scan_thread_main(void* raw_arg) {
+
+    (void)raw_arg;
+
+    char* buf = malloc(SCAN_DIRENT_BUFFER);
+
+    pthread_mutex_lock(&scanMutex);
+
+    for (;;) {
+
+        // a busy thread can still find more directories
+        while (dirHead == NULL && scanBusy > 0)
+            pthread_cond_wait(&scanCond, &scanMutex);
+
+        if (dirHead == NULL || buf == NULL)
+            break;
+
+        ScanDir_t* dir = dirHead;
+
+        dirHead = dir->next;
+
+        if (dirHead == NULL)
+            dirTail = NULL;
+
+        scanBusy++;
+
+        pthread_mutex_unlock(&scanMutex);
+
+        scan_directory(dir, buf);
+
+        free(dir->path);
+        free(dir);
+
+        pthread_mutex_lock(&scanMutex);
+
+        scanBusy--;
+
+        // wake everyone so they can exit
+        if (scanBusy == 0 && dirHead == NULL)
+            pthread_cond_broadcast(&scanCond);
+    }
+
+    scanThreads--;
+
+    pthread_mutex_unlock(&scanMutex);
+
+    free(buf);
+
+    L_D("%s: Scan thread is done", __func__);
+
+    return NULL;
+}
+
+bool iScanDirectory(const char* path_, int group, bool recursive) {
+
+    pthread_once(&extOnce, parse_extensions);
+
+    char* path = iStrDup(path_);
+
+    if (path == NULL)
+        return false;
+
+    // so joined paths do not get a double slash
+    for (size_t len = strlen(path); len > 1 && path[len - 1] == '/'; len--)
+        path[len - 1] = 0;
+
+    pthread_mutex_lock(&scanMutex);
+
+    push_dir_locked(path, group, recursive);
+
+    while (scanThreads < SCAN_THREADS) {
+
+        pthread_t      thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+        int r = pthread_create(&thread, &attr, scan_thread_main, NULL);
+
+        pthread_attr_destroy(&attr);
+
+        if (r != 0)
+            break;
+
+        scanThreads++;
+    }
+
+    bool ok = scanThreads > 0;
+
+    pthread_mutex_unlock(&scanMutex);
+
+    if (!ok)
+        L_E("%s: Cannot start a scan thread for %s", __func__, path_);
+
+    return ok;
+}
+
+bool iScanIsRunning() {
+
+    pthread_mutex_lock(&scanMutex);
+
+    bool running = scanThreads > 0 || dirHead != NULL || batchHead != NULL;
+
+    pthread_mutex_unlock(&scanMutex);
+
+    return running;
+}
+
+ScanBatch_t* iScanTakeBatches() {
+
+    pthread_mutex_lock(&scanMutex);
+
+    ScanBatch_t* batches = batchHead;
+
+    batchHead = NULL;
+    batchTail = NULL;
+
+    pthread_mutex_unlock(&scanMutex);
+
+    return batches;
+}
+
+void iScanFreeBatch(ScanBatch_t* batch) {
+
+    free(batch->paths);
+    free(batch);
+}
@@ -0,0 +1,786 @@
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../external/hashmap.h"
+#include "../config.h"
+#include "core.h"
+
+// Files added to the index before the lock is let go, so a query is never held up for long.
+#define INDEX_BATCH 4096
+
+// Trigrams taken from a name at most, longer names are only matched on their start.
+#define MAX_NAME_TRIGRAMS 256
+
+#define NO_DOC UINT32_MAX
+
+// Base scores of each kind of match, see score_name.
+#define SCORE_SUBSTRING   3000000
+#define SCORE_SUBSEQUENCE 2000000
+#define SCORE_TRIGRAMS    1000000
+
+// The lowest score a name with every letter of the query in order can get.
+#define SCORE_SUBSEQUENCE_MIN (SCORE_SUBSEQUENCE - 900 * 1000 - 9 * 100 - 99)
+
+// The documents of one trigram.
+typedef struct {
+        uint32_t  trigram; // key, three lowercase bytes
+        uint32_t  count;
+        uint32_t  cap;
+        uint32_t* docs; // ascending, documents are only ever appended
+} Posting_t;
+
+typedef struct {
+        const char* path; // key, the path pointer of the image
+        uint32_t    doc;
+} DocKey_t;
+
+// The images in their current order, indexed by the search thread.
+typedef struct {
+        size_t       count;
+        const char** paths; // path pointers, they live until exit
+        const char** names;
+} IndexJob_t;
+
+// A candidate while ranking.
+typedef struct {
+        int64_t  score;
+        int      index;
+        uint32_t doc;
+} Match_t;
+
+// Every file name seen is a document, image paths live until exit so documents are never removed.
+static pthread_mutex_t indexMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// guarded by indexMutex
+static struct hashmap* postings      = NULL;
+static char*           names         = NULL; // lowercase file names of every document, one after another
+static size_t          namesSize     = 0;
+static size_t          namesCap      = 0;
+static uint32_t*       docNames      = NULL; // where each name starts in names, one past the last document too
+static const char**    docPaths      = NULL;
+static size_t          docCount      = 0;
+static size_t          docCap        = 0;
+static int*            docIndex      = NULL; // image index of each document in the last snapshot, -1 if not in it
+static size_t          docIndexCount = 0;
+static size_t          indexVersion  = 1;
+
+// only used by the search thread
+static struct hashmap* docKeys = NULL;
+
+// owned by the main thread
+static pthread_t   indexThread;
+static IndexJob_t* indexJob    = NULL;
+static atomic_bool indexDone   = false;
+static size_t      indexedGen  = (size_t)-1;
+static size_t      indexedSize = 0;
+
+// scratch for queries, owned by the main thread
+static uint16_t* hits     = NULL; // query trigrams in each document
+static uint32_t* touched  = NULL; // documents with hits
+static size_t    hitsCap  = 0;
+static Match_t*  heap     = NULL;
+static size_t    heapSize = 0;
+
+static uint64_t posting_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+    return hashmap_murmur(&((const Posting_t*)item)->trigram, sizeof(uint32_t), seed0, seed1);
+}
+
+static int posting_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return ((const Posting_t*)a)->trigram != ((const Posting_t*)b)->trigram;
+}
+
+static uint64_t dockey_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+    return hashmap_murmur(&((const DocKey_t*)item)->path, sizeof(char*), seed0, seed1);
+}
+
+static int dockey_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return ((const DocKey_t*)a)->path != ((const DocKey_t*)b)->path;
+}
+
+static inline char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t trigram_at(const char* s) {
+    return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+// Adds the document to the posting of the trigram, once.
+static bool post(uint32_t trigram, uint32_t doc) {
+
+    Posting_t* p = (Posting_t*)hashmap_get(postings, &(Posting_t){.trigram = trigram});
+
+    if (p == NULL) {
+
+        if (hashmap_set(postings, &(Posting_t){.trigram = trigram}) == NULL && hashmap_oom(postings))
+            return false;
+
+        p = (Posting_t*)hashmap_get(postings, &(Posting_t){.trigram = trigram});
+    }
+
+    // the name had this trigram already
+    if (p->count > 0 && p->docs[p->count - 1] == doc)
+        return true;
+
+    if (p->count == p->cap) {
+
+        uint32_t  cap  = MAX(4, p->cap * 2);
+        uint32_t* docs = realloc(p->docs, cap * sizeof(uint32_t));
+
+        if (docs == NULL)
+            return false;
+
+        p->docs = docs;
+        p->cap  = cap;
+    }
+
+    p->docs[p->count++] = doc;
+
+    return true;
+}
+
+// Adds a document for the file name, needs indexMutex.
+static uint32_t add_doc(const char* path, const char* name) {
+
+    if (docCount + 1 >= docCap) {
+
+        size_t       cap    = MAX(1024, docCap * 2);
+        uint32_t*    starts = realloc(docNames, cap * sizeof(uint32_t));
+        const char** paths  = NULL;
+
+        if (starts != NULL) {
+
+            docNames = starts;
+            paths    = realloc(docPaths, cap * sizeof(char*));
+        }
+
+        if (paths == NULL)
+            return NO_DOC;
+
+        docPaths = paths;
+        docCap   = cap;
+    }
+
+    size_t len = strlen(name);
+
+    // names are kept together so a query reads them in one sweep
+    if (namesSize + len + 1 > namesCap) {
+
+        size_t cap = MAX(namesCap * 2, namesSize + len + 1 + 65536);
+        char*  n   = realloc(names, cap);
+
+        if (n == NULL || cap > UINT32_MAX)
+            return NO_DOC;
+
+        names    = n;
+        namesCap = cap;
+    }
+
+    char* lowered = names + namesSize;
+
+    for (size_t i = 0; i <= len; i++)
+        lowered[i] = lower(name[i]);
+
+    uint32_t doc = docCount;
+
+    for (size_t i = 0; i + 3 <= len && i < MAX_NAME_TRIGRAMS; i++)
+        post(trigram_at(lowered + i), doc);
+
+    docPaths[doc] = path;
+    docNames[doc] = namesSize;
+
+    namesSize += len + 1;
+    docCount++;
+
+    docNames[docCount] = namesSize;
+
+    return doc;
+}
+
+static void free_job(IndexJob_t* job) {
+
+    free(job->paths);
+    free(job->names);
+    free(job);
+}
+
+static void* index_thread_main(void* raw_arg) {
+
+    IndexJob_t* job  = raw_arg;
+    uint32_t*   docs = malloc(MAX(1, job->count) * sizeof(uint32_t));
+
+    if (docs == NULL) {
+
+        atomic_store(&indexDone, true);
+
+        return NULL;
+    }
+
+    double start = iGetTime();
+    size_t added = 0;
+
+    for (size_t i = 0; i < job->count;) {
+
+        size_t end = MIN(job->count, i + INDEX_BATCH);
+
+        pthread_mutex_lock(&indexMutex);
+
+        for (; i < end; i++) {
+
+            const DocKey_t* key = hashmap_get(docKeys, &(DocKey_t){.path = job->paths[i]});
+
+            if (key != NULL) {
+
+                docs[i] = key->doc;
+
+                continue;
+            }
+
+            docs[i] = add_doc(job->paths[i], job->names[i]);
+
+            if (docs[i] == NO_DOC)
+                continue;
+
+            hashmap_set(docKeys, &(DocKey_t){.path = job->paths[i], .doc = docs[i]});
+
+            added++;
+        }
+
+        pthread_mutex_unlock(&indexMutex);
+    }
+
+    // where each document is in this snapshot, so results can be turned into image indices
+    int* index = malloc(MAX(1, docCount) * sizeof(int));
+
+    if (index != NULL) {
+
+        for (size_t d = 0; d < docCount; d++)
+            index[d] = -1;
+
+        for (size_t i = 0; i < job->count; i++) {
+
+            if (docs[i] != NO_DOC)
+                index[docs[i]] = i;
+        }
+    }
+
+    pthread_mutex_lock(&indexMutex);
+
+    if (index != NULL) {
+
+        free(docIndex);
+
+        docIndex      = index;
+        docIndexCount = docCount;
+    }
+
+    indexVersion++;
+
+    pthread_mutex_unlock(&indexMutex);
+
+    free(docs);
+
+    if (added > 0)
+        L_D("%s: Indexed %zu new files in %.2fms", __func__, added, (iGetTime() - start) * 1000);
+
+    atomic_store(&indexDone, true);
+
+    return NULL;
+}
+
+void iUpdateSearchIndex(const ImmyControl_t* ctrl) {
+
+    if (indexJob != NULL) {
+
+        if (!atomic_load(&indexDone))
+            return;
+
+        pthread_join(indexThread, NULL);
+        free_job(indexJob);
+
+        indexJob = NULL;
+    }
+
+    if (ctrl->image_files_gen == indexedGen && ctrl->image_files.size == indexedSize)
+        return;
+
+    if (postings == NULL) {
+
+        postings = hashmap_new(sizeof(Posting_t), 0, 0, 0, posting_hash, posting_cmp, NULL, NULL);
+        docKeys  = hashmap_new(sizeof(DocKey_t), 0, 0, 0, dockey_hash, dockey_cmp, NULL, NULL);
+
+        DIE_IF_NULL(postings, "Cannot alloc a new hashmap");
+        DIE_IF_NULL(docKeys, "Cannot alloc a new hashmap");
+    }
+
+    IndexJob_t* job = calloc(1, sizeof(IndexJob_t));
+
+    if (job == NULL)
+        return;
+
+    job->count = ctrl->image_files.size;
+    job->paths = malloc(MAX(1, job->count) * sizeof(char*));
+    job->names = malloc(MAX(1, job->count) * sizeof(char*));
+
+    if (job->paths == NULL || job->names == NULL) {
+
+        free_job(job);
+
+        return;
+    }
+
+    // both columns are copied whole, the list may change while the thread reads them
+    memcpy(job->paths, ctrl->image_files.paths, job->count * sizeof(char*));
+    memcpy(job->names, ctrl->image_files.names, job->count * sizeof(char*));
+
+    atomic_store(&indexDone, false);
+
+    if (pthread_create(&indexThread, NULL, index_thread_main, job) != 0) {
+
+        L_E("%s: Cannot start the search index thread", __func__);
+
+        free_job(job);
+
+        return;
+    }
+
+    indexJob    = job;
+    indexedGen  = ctrl->image_files_gen;
+    indexedSize = ctrl->image_files.size;
+}
+
+size_t iSearchVersion() {
+
+    pthread_mutex_lock(&indexMutex);
+
+    size_t version = indexVersion;
+
+    pthread_mutex_unlock(&indexMutex);
+
+    return version;
+}
+
+// Scores the name against the query, 0 if it does not match.
+// Substrings beat scattered letters, earlier and tighter matches beat later ones.
+static int64_t score_name(const char* name, size_t len, const char* query, size_t qlen, int trigramHits, int needHits) {
+
+    int64_t     score = 0;
+    const char* at    = strstr(name, query);
+
+    if (at != NULL) {
+
+        score = SCORE_SUBSTRING - MIN(1000, at - name) * 100;
+
+        if (at == name)
+            score += 1000000;
+
+    } else {
+
+        // every letter in order, with gaps
+        const char* n     = name;
+        const char* first = name;
+        size_t      found = 0;
+        int         gaps  = 0;
+
+        for (const char* q = query; *q && *n; n++) {
+
+            if (*n == *q) {
+
+                if (found++ == 0)
+                    first = n;
+
+                q++;
+
+            } else if (found > 0) {
+
+                gaps++;
+            }
+        }
+
+        if (found == qlen)
+            score = SCORE_SUBSEQUENCE - MIN(900, gaps) * 1000 - MIN(9, first - name) * 100;
+
+        // close enough, typos and swapped letters land here
+        else if (trigramHits >= needHits && trigramHits > 0)
+            score = SCORE_TRIGRAMS + trigramHits * 1000;
+
+        else
+            return 0;
+    }
+
+    // shorter names are closer to what was typed
+    return score - MIN(99, (int64_t)len);
+}
+
+static inline bool match_worse(const Match_t* a, const Match_t* b) {
+    return a->score < b->score || (a->score == b->score && a->index > b->index);
+}
+
+// Keeps the best max matches in a heap with the worst at the top.
+static void heap_push(Match_t m, size_t max) {
+
+    if (heapSize == max) {
+
+        if (!match_worse(heap, &m))
+            return;
+
+        // replace the worst and sift it down
+        size_t i = 0;
+
+        heap[0] = m;
+
+        for (;;) {
+
+            size_t l = i * 2 + 1;
+            size_t r = l + 1;
+            size_t w = i;
+
+            if (l < heapSize && match_worse(heap + l, heap + w))
+                w = l;
+
+            if (r < heapSize && match_worse(heap + r, heap + w))
+                w = r;
+
+            if (w == i)
+                break;
+
+            Match_t t = heap[i];
+            heap[i]   = heap[w];
+            heap[w]   = t;
+            i         = w;
+        }
+
+        return;
+    }
+
+    size_t i = heapSize++;
+
+    heap[i] = m;
+
+    while (i > 0 && match_worse(heap + i, heap + (i - 1) / 2)) {
+
+        Match_t t         = heap[i];
+        heap[i]           = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = t;
+        i                 = (i - 1) / 2;
+    }
+}
+
+static int match_cmp(const void* a, const void* b) {
+
+    const Match_t* ma = a;
+    const Match_t* mb = b;
+
+    return match_worse(ma, mb) ? 1 : match_worse(mb, ma) ? -1 : 0;
+}
+
+// Scores the document and keeps it if it is one of the best so far.
+static inline bool consider(size_t doc, const char* query, size_t qlen, int h, int need, size_t max) {
+
+    int index = docIndex[doc];
+
+    if (index < 0)
+        return false;
+
+    int64_t score =
+        score_name(names + docNames[doc], docNames[doc + 1] - docNames[doc] - 1, query, qlen, h, need);
+
+    if (score <= 0)
+        return false;
+
+    heap_push((Match_t){.score = score, .index = index, .doc = doc}, max);
+
+    return true;
+}
+
+size_t iSearchImages(const ImmyControl_t* ctrl, const char* query_, dIntArr_t* results, size_t max) {
+
+    results->size = 0;
+
+    char   query[SEARCH_QUERY_SIZE];
+    size_t qlen = 0;
+
+    for (const char* c = query_; *c && qlen < sizeof(query) - 1; c++)
+        query[qlen++] = lower(*c);
+
+    query[qlen] = 0;
+
+    if (qlen == 0 || max == 0)
+        return 0;
+
+    if (heap == NULL && (heap = malloc(SEARCH_MAX_RESULTS * sizeof(Match_t))) == NULL)
+        return 0;
+
+    max      = MIN(max, SEARCH_MAX_RESULTS);
+    heapSize = 0;
+
+    size_t matches = 0;
+    double start   = iGetTime();
+
+    pthread_mutex_lock(&indexMutex);
+
+    if (qlen < 3) {
+
+        // too short for trigrams, the names are short enough to just look through
+        for (size_t d = 0; d < docIndexCount; d++)
+            matches += consider(d, query, qlen, 0, 1, max);
+
+    } else {
+
+        if (hitsCap < docIndexCount) {
+
+            uint16_t* h = realloc(hits, docIndexCount * sizeof(uint16_t));
+            uint32_t* t = h != NULL ? realloc(touched, docIndexCount * sizeof(uint32_t)) : NULL;
+
+            if (h != NULL)
+                hits = h;
+
+            if (t == NULL) {
+
+                pthread_mutex_unlock(&indexMutex);
+
+                return 0;
+            }
+
+            memset(h + hitsCap, 0, (docIndexCount - hitsCap) * sizeof(uint16_t));
+
+            touched = t;
+            hitsCap = docIndexCount;
+        }
+
+        size_t touchedCount = 0;
+
+        // count how many of the query's trigrams each name has
+        int trigrams = 0;
+
+        for (size_t i = 0; i + 3 <= qlen; i++) {
+
+            uint32_t t = trigram_at(query + i);
+
+            // repeated trigrams count once
+            bool seen = false;
+
+            for (size_t j = 0; j < i && !seen; j++)
+                seen = trigram_at(query + j) == t;
+
+            if (seen)
+                continue;
+
+            trigrams++;
+
+            const Posting_t* p = hashmap_get(postings, &(Posting_t){.trigram = t});
+
+            if (p == NULL)
+                continue;
+
+            for (uint32_t k = 0; k < p->count && p->docs[k] < docIndexCount; k++) {
+
+                if (hits[p->docs[k]]++ == 0)
+                    touched[touchedCount++] = p->docs[k];
+            }
+        }
+
+        // half the trigrams is enough for a typo or two
+        int need = MAX(1, (trigrams + 1) / 2);
+
+        for (size_t i = 0; i < touchedCount; i++) {
+
+            uint32_t d = touched[i];
+
+            if (hits[d] >= need)
+                matches += consider(d, query, qlen, hits[d], need, max);
+        }
+
+        // the letters of the query spread through a name share few of its trigrams,
+        // so the names are swept for those too unless every result already beats them
+        if (heapSize < max || heap[0].score < SCORE_SUBSEQUENCE_MIN) {
+
+            for (size_t d = 0; d < docIndexCount; d++) {
+
+                if (hits[d] < need)
+                    matches += consider(d, query, qlen, 0, need, max);
+            }
+        }
+
+        for (size_t i = 0; i < touchedCount; i++)
+            hits[touched[i]] = 0;
+    }
+
+    qsort(heap, heapSize, sizeof(Match_t), match_cmp);
+
+    // the images moved since the index was told where they are, the next version will have them
+    for (size_t i = 0; i < heapSize; i++) {
+
+        int index = heap[i].index;
+
+        if ((size_t)index < ctrl->image_files.size && ctrl->image_files.paths[index] == docPaths[heap[i].doc])
+            dIntArrAppend(results, index);
+    }
+
+    pthread_mutex_unlock(&indexMutex);
+
+    L_D("%s: %zu matches for '%s' in %.3fms", __func__, matches, query, (iGetTime() - start) * 1000);
+
+    return matches;
+}
+
+void iSearchDeinit() {
+
+    if (indexJob != NULL) {
+
+        pthread_join(indexThread, NULL);
+        free_job(indexJob);
+
+        indexJob = NULL;
+    }
+
+    if (postings != NULL) {
+
+        size_t iter = 0;
+        void*  item;
+
+        while (hashmap_iter(postings, &iter, &item))
+            free(((Posting_t*)item)->docs);
+
+        hashmap_free(postings);
+        hashmap_free(docKeys);
+
+        postings = NULL;
+        docKeys  = NULL;
+    }
+
+    free(names);
+    free(docNames);
+    free(docPaths);
+    free(docIndex);
+    free(hits);
+    free(heap);
+    free(touched);
+
+    names    = NULL;
+    touched  = NULL;
+    docNames = NULL;
+    docPaths = NULL;
+    docIndex = NULL;
+    hits     = NULL;
+    heap     = NULL;
+
+    docCount = docCap = docIndexCount = hitsCap = namesSize = namesCap = 0;
+}
+
+///
+/// The search prompt
+///
+
+// Runs the query again, keeping the selected result if it still matches.
+static void run_query(ImmyControl_t* ctrl, bool selectBest) {
+
+    ImmySearch_t* s = &ctrl->search;
+
+    // the selection follows the cursor, so it is the selected result
+    const char* selected = ctrl->selected_image != NULL ? ctrl->selected_image->path : NULL;
+
+    s->version = iSearchVersion();
+    s->matches = iSearchImages(ctrl, s->query, &s->results, SEARCH_MAX_RESULTS);
+    s->cursor  = 0;
+
+    if (!selectBest && selected != NULL) {
+
+        DARRAY_FOR_EACH(s->results, i) {
+
+            if (ctrl->image_files.paths[s->results.buffer[i]] == selected) {
+
+                s->cursor = i;
+
+                break;
+            }
+        }
+    }
+
+    if (s->results.size > 0)
+        iSetImage(ctrl, s->results.buffer[s->cursor]);
+}
+
+void iSearchOpen(ImmyControl_t* ctrl) {
+
+    ImmySearch_t* s = &ctrl->search;
+
+    if (s->results.buffer == NULL)
+        dIntArrInit(&s->results, 64);
+
+    s->active          = true;
+    s->query[0]        = 0;
+    s->length          = 0;
+    s->results.size    = 0;
+    s->matches         = 0;
+    s->cursor          = 0;
+    s->startPath       = ctrl->selected_image != NULL ? ctrl->selected_image->path : NULL;
+    ctrl->renderFrames = RENDER_FRAMES;
+
+    // the prompt takes every key, including the one that quits
+    SetExitKey(KEY_NULL);
+}
+
+void iSearchClose(ImmyControl_t* ctrl, bool keepSelection) {
+
+    ImmySearch_t* s = &ctrl->search;
+
+    s->active          = false;
+    ctrl->renderFrames = RENDER_FRAMES;
+
+    SetExitKey(RAYLIB_QUIT_KEY);
+
+    if (keepSelection || s->startPath == NULL)
+        return;
+
+    DARRAY_FOR_EACH(ctrl->image_files, i) {
+
+        if (ctrl->image_files.paths[i] == s->startPath) {
+
+            iSetImage(ctrl, i);
+
+            break;
+        }
+    }
+}
+
+void iSearchSetQuery(ImmyControl_t* ctrl, const char* query) {
+
+    ImmySearch_t* s = &ctrl->search;
+
+    s->length = MIN(strlen(query), sizeof(s->query) - 1);
+
+    memmove(s->query, query, s->length);
+
+    s->query[s->length] = 0;
+
+    run_query(ctrl, true);
+}
+
+void iSearchRefresh(ImmyControl_t* ctrl) {
+
+    if (ctrl->search.active && ctrl->search.length > 0 && ctrl->search.version != iSearchVersion())
+        run_query(ctrl, false);
+}
+
+void iSearchMove(ImmyControl_t* ctrl, int by) {
+
+    ImmySearch_t* s = &ctrl->search;
+
+    if (s->results.size == 0)
+        return;
+
+    s->cursor = (s->cursor + s->results.size + by % (int)s->results.size) % s->results.size;
+
+    iSetImage(ctrl, s->results.buffer[s->cursor]);
+}
@@ -0,0 +1,587 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "core.h"
+
+// Natural sort keys are built so a plain memcmp gives the natural order.
+// Every run of digits becomes a marker, the length of the run without leading zeros, then the digits.
+// A longer run is a bigger number, runs of the same length compare digit by digit.
+// The marker is '0' so digits still sort the same against every other character.
+#define DIGIT_MARK '0'
+
+// Runs at least this long store their length in 4 more bytes.
+#define LONG_RUN 0xFF
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+// What is moved around while sorting.
+// Everything but the tie break is here, so a compare only touches the key itself.
+typedef struct {
+        uint64_t             prefix; // first bytes of the key, big endian, most compares end here
+        const unsigned char* key;
+        int64_t              value; // metadata like the mtime, compared after the group
+        uint32_t             len;
+        int32_t              group; // compared before the key
+        uint32_t             index; // path the item came from
+} SortItem_t;
+
+typedef struct {
+        SortItem_t*        items;
+        const char* const* paths;
+        const int*         groups;
+        const int64_t*     values;
+        unsigned char*     keys;
+        size_t*            offsets;
+        size_t             skip; // every key starts with these bytes, so they are never compared
+        StrCompare_t       order;
+} SortKeys_t;
+
+typedef struct {
+        SortItem_t*        src;
+        SortItem_t*        dst;
+        const char* const* paths;
+        size_t*            bounds; // run i is [bounds[i], bounds[i + 1])
+        size_t             runs;
+} SortMerge_t;
+
+// Sorted with insertion sort before merging.
+#define SORT_BLOCK 16
+
+// Skips leading zeros and returns the number of digits left in the run.
+static inline size_t digit_run(const char** s) {
+
+    while (**s == '0')
+        (*s)++;
+
+    size_t run = 0;
+
+    while (IS_DIGIT((*s)[run]))
+        run++;
+
+    return run;
+}
+
+static size_t natural_key_len(const char* s) {
+
+    size_t len = 0;
+
+    while (*s) {
+
+        if (!IS_DIGIT(*s)) {
+
+            len++;
+            s++;
+
+            continue;
+        }
+
+        size_t run = digit_run(&s);
+
+        len += 2 + (run >= LONG_RUN ? 4 : 0) + run;
+        s   += run;
+    }
+
+    return len;
+}
+
+static void natural_key(const char* s, unsigned char* key) {
+
+    while (*s) {
+
+        if (!IS_DIGIT(*s)) {
+
+            *key++ = *s++;
+
+            continue;
+        }
+
+        size_t run = digit_run(&s);
+
+        *key++ = DIGIT_MARK;
+
+        if (run < LONG_RUN) {
+
+            *key++ = run;
+
+        } else {
+
+            *key++ = LONG_RUN;
+            *key++ = run >> 24;
+            *key++ = run >> 16;
+            *key++ = run >> 8;
+            *key++ = run;
+        }
+
+        memcpy(key, s, run);
+
+        key += run;
+        s   += run;
+    }
+}
+
+// paths is only used to break ties, like 01 and 1
+static inline int item_cmp(const SortItem_t* a, const SortItem_t* b, const char* const* paths) {
+
+    if (a->group != b->group)
+        return a->group < b->group ? -1 : 1;
+
+    if (a->value != b->value)
+        return a->value < b->value ? -1 : 1;
+
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+
+    size_t len = MIN(a->len, b->len);
+
+    if (len > sizeof(a->prefix)) {
+
+        int r = memcmp(a->key + sizeof(a->prefix), b->key + sizeof(b->prefix), len - sizeof(a->prefix));
+
+        if (r != 0)
+            return r;
+    }
+
+    if (a->len != b->len)
+        return a->len < b->len ? -1 : 1;
+
+    return strcmp(paths[a->index], paths[b->index]);
+}
+
+static void measure_keys(size_t begin, size_t end, void* arg) {
+
+    SortKeys_t* k = arg;
+
+    for (size_t i = begin; i < end; i++) {
+
+        if (k->order == SORT_ORDER__NATURAL) {
+            k->offsets[i] = natural_key_len(k->paths[i]);
+        } else {
+            k->offsets[i] = strlen(k->paths[i]);
+        }
+    }
+}
+
+static void build_keys(size_t begin, size_t end, void* arg) {
+
+    SortKeys_t* k = arg;
+
+    for (size_t i = begin; i < end; i++) {
+
+        SortItem_t* item = k->items + i;
+
+        item->len = k->offsets[i + 1] - k->offsets[i] - k->skip;
+
+        // strcmp order is just the path itself
+        if (k->order == SORT_ORDER__NATURAL) {
+
+            unsigned char* key = k->keys + k->offsets[i];
+
+            natural_key(k->paths[i], key);
+
+            item->key = key + k->skip;
+
+        } else {
+
+            item->key = (const unsigned char*)k->paths[i] + k->skip;
+        }
+
+        item->group  = k->groups != NULL ? k->groups[i] : 0;
+        item->value  = k->values != NULL ? k->values[i] : 0;
+        item->index  = i;
+        item->prefix = 0;
+
+        for (size_t b = 0; b < sizeof(item->prefix); b++)
+            item->prefix = (item->prefix << 8) | (b < item->len ? item->key[b] : 0);
+    }
+}
+
+// Merges the sorted ranges [lo, mid) and [mid, hi) of src into dst.
+static void merge(const SortItem_t* src, SortItem_t* dst, size_t lo, size_t mid, size_t hi, const char* const* e) {
+
+    size_t i = lo, j = mid, k = lo;
+
+    while (i < mid && j < hi) {
+
+        // take from the left on ties so the merge is stable
+        if (item_cmp(src + j, src + i, e) < 0) {
+            dst[k++] = src[j++];
+        } else {
+            dst[k++] = src[i++];
+        }
+    }
+
+    memcpy(dst + k, src + i, (mid - i) * sizeof(SortItem_t));
+    k += mid - i;
+    memcpy(dst + k, src + j, (hi - j) * sizeof(SortItem_t));
+}
+
+// Merge sort, tmp must hold n items.
+static void sort_range(SortItem_t* items, SortItem_t* tmp, size_t n, const char* const* e) {
+
+    for (size_t b = 0; b < n; b += SORT_BLOCK) {
+
+        size_t end = MIN(b + SORT_BLOCK, n);
+
+        for (size_t i = b + 1; i < end; i++) {
+
+            SortItem_t item = items[i];
+            size_t     j    = i;
+
+            for (; j > b && item_cmp(&item, items + j - 1, e) < 0; j--)
+                items[j] = items[j - 1];
+
+            items[j] = item;
+        }
+    }
+
+    SortItem_t* src = items;
+    SortItem_t* dst = tmp;
+
+    for (size_t w = SORT_BLOCK; w < n; w *= 2) {
+
+        for (size_t lo = 0; lo < n; lo += w * 2)
+            merge(src, dst, lo, MIN(lo + w, n), MIN(lo + w * 2, n), e);
+
+        SortItem_t* swap = src;
+
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != items)
+        memcpy(items, src, n * sizeof(SortItem_t));
+}
+
+static void sort_runs(size_t begin, size_t end, void* arg) {
+
+    SortMerge_t* m = arg;
+
+    for (size_t r = begin; r < end; r++) {
+
+        size_t lo = m->bounds[r];
+
+        sort_range(m->src + lo, m->dst + lo, m->bounds[r + 1] - lo, m->paths);
+    }
+}
+
+// Merges run pairs (2p, 2p + 1) from src into dst.
+static void merge_runs(size_t begin, size_t end, void* arg) {
+
+    SortMerge_t* m = arg;
+
+    for (size_t p = begin; p < end; p++) {
+
+        size_t lo  = m->bounds[p * 2];
+        size_t mid = m->bounds[MIN(p * 2 + 1, m->runs)];
+        size_t hi  = m->bounds[MIN(p * 2 + 2, m->runs)];
+
+        merge(m->src, m->dst, lo, mid, hi, m->paths);
+    }
+}
+
+static int sort_threads(size_t count) {
+
+    int threads = iGetCPUCount();
+
+    if (SORT_MAX_THREADS > 0 && threads > SORT_MAX_THREADS)
+        threads = SORT_MAX_THREADS;
+
+    return count < SORT_PARALLEL_MIN ? 1 : threads;
+}
+
+// Sorts the items, splitting them across threads when there are enough of them.
+// Each thread sorts a run, then runs are merged in pairs until one is left.
+static bool sort_items(SortItem_t* items, const char* const* paths, size_t count) {
+
+    int threads = sort_threads(count);
+
+    SortItem_t* tmp    = malloc(count * sizeof(SortItem_t));
+    size_t*     bounds = malloc((threads + 1) * sizeof(size_t));
+
+    if (tmp == NULL || bounds == NULL) {
+
+        free(tmp);
+        free(bounds);
+
+        return false;
+    }
+
+    for (int i = 0; i <= threads; i++)
+        bounds[i] = count * i / threads;
+
+    SortMerge_t m = {.src = items, .dst = tmp, .paths = paths, .bounds = bounds, .runs = threads};
+
+    iParallelFor(m.runs, sort_runs, &m, threads);
+
+    while (m.runs > 1) {
+
+        size_t pairs = (m.runs + 1) / 2;
+
+        iParallelFor(pairs, merge_runs, &m, threads);
+
+        // the merged runs start at every other bound
+        for (size_t p = 0; p < pairs; p++)
+            m.bounds[p] = m.bounds[p * 2];
+
+        m.bounds[pairs] = count;
+        m.runs          = pairs;
+
+        SortItem_t* swap = m.src;
+
+        m.src = m.dst;
+        m.dst = swap;
+    }
+
+    // hand back whichever buffer has the result
+    if (m.src != items)
+        memcpy(items, m.src, count * sizeof(SortItem_t));
+
+    free(tmp);
+    free(bounds);
+
+    return true;
+}
+
+// Gets the length of the key part every path shares.
+// Paths in a list usually share a long directory, skipping it lets the prefix hold the file names.
+static size_t common_key_len(const char* const* paths, size_t count, StrCompare_t order) {
+
+    const char* first = paths[0];
+    size_t      lcp   = strlen(first);
+
+    for (size_t i = 1; i < count && lcp > 0; i++) {
+
+        size_t l = 0;
+
+        while (l < lcp && paths[i][l] == first[l])
+            l++;
+
+        lcp = l;
+    }
+
+    if (order != SORT_ORDER__NATURAL)
+        return lcp;
+
+    // a digit run cut in half would not have the same key in every path
+    while (lcp > 0 && IS_DIGIT(first[lcp - 1]))
+        lcp--;
+
+    char* common = malloc(lcp + 1);
+
+    if (common == NULL)
+        return 0;
+
+    memcpy(common, first, lcp);
+
+    common[lcp] = 0;
+
+    size_t len = natural_key_len(common);
+
+    free(common);
+
+    return len;
+}
+
+// Building keys is not worth a thread for small lists like a few dropped files.
+static inline int key_threads(size_t count) {
+
+    return count < SORT_PARALLEL_MIN ? 1 : SORT_MAX_THREADS;
+}
+
+// Returns the order of the paths, or NULL if there is no memory.
+// groups and values may be NULL, otherwise they are compared before the path.
+static size_t* sort_order(const char* const* paths, const int* groups, const int64_t* values, size_t count,
+                          StrCompare_t order) {
+
+    if (count > UINT32_MAX)
+        return NULL;
+
+    SortKeys_t k = {
+        .paths   = paths,
+        .groups  = groups,
+        .values  = values,
+        .order   = order,
+        .items   = malloc(count * sizeof(SortItem_t)),
+        .offsets = malloc((count + 1) * sizeof(size_t)),
+    };
+
+    size_t* result = malloc(count * sizeof(size_t));
+
+    if (k.items == NULL || k.offsets == NULL || result == NULL)
+        goto fail;
+
+    // every key goes in one buffer, measured first so the keys can be built in parallel
+    iParallelFor(count, measure_keys, &k, key_threads(count));
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+
+        size_t len = k.offsets[i];
+
+        k.offsets[i]  = total;
+        total        += len;
+    }
+
+    k.offsets[count] = total;
+    k.skip           = common_key_len(paths, count, order);
+
+    if (order == SORT_ORDER__NATURAL && (k.keys = malloc(MAX(total, 1))) == NULL)
+        goto fail;
+
+    iParallelFor(count, build_keys, &k, key_threads(count));
+
+    if (!sort_items(k.items, paths, count))
+        goto fail;
+
+    for (size_t i = 0; i < count; i++)
+        result[i] = k.items[i].index;
+
+    free(k.keys);
+    free(k.offsets);
+    free(k.items);
+
+    return result;
+
+fail:
+    free(k.keys);
+    free(k.offsets);
+    free(k.items);
+    free(result);
+
+    return NULL;
+}
+
+int iComparePaths(const char* a, const char* b, StrCompare_t order) {
+
+    if (order != SORT_ORDER__NATURAL)
+        return strcmp(a, b);
+
+    // same as comparing the natural keys, without making them
+    const char* pa = a;
+    const char* pb = b;
+
+    while (*pa && *pb) {
+
+        if (IS_DIGIT(*pa) && IS_DIGIT(*pb)) {
+
+            size_t ra = digit_run(&pa);
+            size_t rb = digit_run(&pb);
+
+            if (ra != rb)
+                return ra < rb ? -1 : 1;
+
+            int r = memcmp(pa, pb, ra);
+
+            if (r != 0)
+                return r;
+
+            pa += ra;
+            pb += rb;
+
+            continue;
+        }
+
+        unsigned char ca = IS_DIGIT(*pa) ? DIGIT_MARK : *pa;
+        unsigned char cb = IS_DIGIT(*pb) ? DIGIT_MARK : *pb;
+
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+
+        pa++;
+        pb++;
+    }
+
+    if (*pa != *pb)
+        return *pa == 0 ? -1 : 1;
+
+    return strcmp(a, b);
+}
+
+bool iSortPaths(char** paths, size_t count, StrCompare_t order) {
+
+    if (count < 2)
+        return true;
+
+    // strcmp order on one thread gains nothing from keys, the key is the path itself
+    if (order == SORT_ORDER__DEFAULT && sort_threads(count) == 1) {
+
+        qsort(paths, count, sizeof(paths[0]), iqStrCmp);
+
+        return true;
+    }
+
+    size_t* result = sort_order((const char* const*)paths, NULL, NULL, count, order);
+    char**  sorted = malloc(count * sizeof(char*));
+
+    if (result == NULL || sorted == NULL) {
+
+        free(result);
+        free(sorted);
+
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        sorted[i] = paths[result[i]];
+
+    memcpy(paths, sorted, count * sizeof(char*));
+
+    free(sorted);
+    free(result);
+
+    return true;
+}
+
+bool iSortImages(ImmyControl_t* ctrl) {
+
+    size_t count = ctrl->image_files.size;
+
+    if (count < 2)
+        return true;
+
+    ImmyCatalog_t* cat    = &ctrl->image_files;
+    int64_t*       values = NULL;
+
+    // the metadata orders compare a value from each image first
+    if (iSortOrderNeedsMeta(ctrl->filename_cmp)) {
+
+        if ((values = malloc(count * sizeof(int64_t))) == NULL)
+            return false;
+
+        for (size_t i = 0; i < count; i++)
+            values[i] = iGetImageSortValue(cat, i, ctrl->filename_cmp);
+    }
+
+    // the paths and groups are read straight from their columns
+    StrCompare_t order  = iGetPathOrder(ctrl->filename_cmp);
+    size_t*      result = sort_order((const char* const*)cat->paths, cat->groups, values, count, order);
+    bool         sorted = result != NULL && iCatalogPermute(cat, result);
+
+    if (sorted) {
+
+        for (size_t i = 0; i < count; i++) {
+
+            if (result[i] == (size_t)ctrl->selected_index) {
+
+                ctrl->selected_index = i;
+
+                break;
+            }
+        }
+
+        if (ctrl->selected_image != NULL)
+            ctrl->selected_image = cat->images + ctrl->selected_index;
+
+        ctrl->image_files_gen++;
+        ctrl->renderFrames = RENDER_FRAMES;
+    }
+
+    free(values);
+    free(result);
+
+    return sorted;
+}
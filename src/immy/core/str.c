@@ -20,6 +20,18 @@
 #include "../config.h"
 #include "core.h"
 
+// paths are copied into chunks this big, a million paths fit in about a hundred
+#define PATH_POOL_CHUNK_SIZE (1024 * 1024)
+
+// A block of interned paths, strings never move once written.
+typedef struct PathChunk {
+        struct PathChunk* next;
+        size_t            used;
+        size_t            size;
+        char              data[];
+} PathChunk_t;
+
+static PathChunk_t* pathPool = NULL;
 
 
 int iqStrCmp(const void* a, const void* b) {
@@ -139,34 +151,51 @@ const char* iGetCacheDirectory() {
 #endif
 }
 
-char* iGetCachedPath(const char* path) {
+bool iGetPathHash(const char* path, unsigned char* hash) {
 
     char buf[IMMY_PATH_MAX + 1];
 
     char* ptr = realpath(path, buf);
 
-    // hash the absolute path for a 'unique' 
-    // short name for the cache
-    // we know IMMY_PATH_MAX can ALWAYS fit SHA256_BLOCK_SIZE * 3
+    if (ptr == NULL)
+        return false;
+
     SHA256_CTX sha256;
     sha256_init(&sha256);
     sha256_update(&sha256, (BYTE*)ptr, strlen(ptr));
-    sha256_final(&sha256, (BYTE*)buf);
+    sha256_final(&sha256, (BYTE*)hash);
 
-    // 0 - 31  contains the sha256 hash bytes
-    // 32 - 96 contains the sha256 hex string
-    ptr += SHA256_BLOCK_SIZE;
+    return true;
+}
+
+char* iGetCachedPath(const char* path, int size) {
+
+    unsigned char hash[SHA256_BLOCK_SIZE];
+    char          hex[SHA256_BLOCK_SIZE * 2 + 1];
+
+    // hash the absolute path for a 'unique'
+    // short name for the cache
+    if (!iGetPathHash(path, hash))
+        return NULL;
 
     for (size_t i = 0; i < SHA256_BLOCK_SIZE; ++i) {
-        sprintf(ptr + i * 2, "%02x", (unsigned char)buf[i]);
+        sprintf(hex + i * 2, "%02x", hash[i]);
     }
 
-    // end the hex string
-    ptr[SHA256_BLOCK_SIZE] = 0;
+    // only the first half of the hex string is used
+    hex[SHA256_BLOCK_SIZE] = 0;
 
     const char* cacheDir = iGetCacheDirectory();
 
-    char* cachedPath = iStrJoin( cacheDir, ptr, THUMBNAIL_CACHE_PATH);
+    // each level has its own directory
+    char levelDir[IMMY_PATH_MAX];
+
+    int n = snprintf(levelDir, sizeof(levelDir), "%s" THUMBNAIL_CACHE_PATH "%d", cacheDir, size);
+
+    if (n < 0 || (size_t)n >= sizeof(levelDir))
+        return NULL;
+
+    char* cachedPath = iStrJoin(levelDir, hex, "/");
 
     return cachedPath;
 }
@@ -221,3 +250,46 @@ bool iCreateDirectory(const char* path_){
 
     return r;
 }
+
+char* iInternPath(const char* path) {
+
+    size_t len = strlen(path) + 1;
+
+    if (pathPool == NULL || pathPool->size - pathPool->used < len) {
+
+        size_t       size  = MAX(PATH_POOL_CHUNK_SIZE, len);
+        PathChunk_t* chunk = malloc(sizeof(PathChunk_t) + size);
+
+        if (chunk == NULL) {
+
+            L_E("%s: Cannot grow the path pool: %s", __func__, strerror(errno));
+
+            return NULL;
+        }
+
+        chunk->next = pathPool;
+        chunk->used = 0;
+        chunk->size = size;
+        pathPool    = chunk;
+    }
+
+    char* str = pathPool->data + pathPool->used;
+
+    memcpy(str, path, len);
+
+    pathPool->used += len;
+
+    return str;
+}
+
+void iFreePathPool() {
+
+    while (pathPool != NULL) {
+
+        PathChunk_t* next = pathPool->next;
+
+        free(pathPool);
+
+        pathPool = next;
+    }
+}
@@ -0,0 +1,217 @@
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#    include <sys/resource.h>
+#    include <sys/syscall.h>
+#endif
+
+#include "../config.h"
+#include "core.h"
+
+// A thumbnail waiting to be written to the cache.
+typedef struct ThumbSaveJob {
+        char*                path;      // the source image path
+        char*                cachePath; // where the thumbnail is written
+        Image                thumb;     // our own copy of the thumbnail
+        int                  size;      // the thumbnail level
+        struct ThumbSaveJob* next;
+} ThumbSaveJob_t;
+
+static pthread_once_t  saveThreadOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t saveMutex      = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  saveWakeCond   = PTHREAD_COND_INITIALIZER; // signaled when a job is queued
+static pthread_cond_t  saveIdleCond   = PTHREAD_COND_INITIALIZER; // signaled when the queue is drained
+static pthread_t       saveThread;
+static bool            saveThreadOk   = false;
+static bool            saveThreadBusy = false;
+static ThumbSaveJob_t* saveHead       = NULL;
+static ThumbSaveJob_t* saveTail       = NULL;
+static size_t          saveCount      = 0; // jobs in the queue, at most THUMB_SAVE_QUEUE_MAX
+
+static void free_job(ThumbSaveJob_t* job) {
+
+    UnloadImage(job->thumb);
+    free(job->cachePath);
+    free(job->path);
+    free(job);
+}
+
+// the job is skipped if the cache is already newer than the image
+static void save_job(ThumbSaveJob_t* job) {
+
+    if (iIsThumbCacheValid(job->path, job->cachePath)) {
+
+        L_D("%s: cache is up to date for %s", __func__, job->path);
+
+        return;
+    }
+
+    ImmyImage_t im = {
+        .path         = job->path,
+        .thumb        = job->thumb,
+        .thumb_size   = job->size,
+        .state        = &(ImmyImageState_t){.thumb_status = IMAGE_STATUS_LOADED},
+    };
+
+    if (!iSaveThumbnailAt(&im, job->cachePath))
+        L_W("%s: could not save thumbnail for %s", __func__, job->path);
+}
+
+static void* thumb_save_thread_main(void* arg) {
+
+    (void)arg;
+
+#if defined(__linux__) && THUMB_SAVE_THREAD_NICE != 0
+
+    // on linux the nice value is per thread,
+    // so this only lowers the priority of the writer
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), THUMB_SAVE_THREAD_NICE) != 0)
+        L_D("%s: could not lower the thread priority", __func__);
+#endif
+
+    pthread_mutex_lock(&saveMutex);
+
+    for (;;) {
+
+        while (saveHead == NULL) {
+
+            saveThreadBusy = false;
+
+            pthread_cond_broadcast(&saveIdleCond);
+            pthread_cond_wait(&saveWakeCond, &saveMutex);
+        }
+
+        ThumbSaveJob_t* job = saveHead;
+
+        saveHead = job->next;
+        saveCount--;
+
+        if (saveHead == NULL)
+            saveTail = NULL;
+
+        saveThreadBusy = true;
+
+        pthread_mutex_unlock(&saveMutex);
+
+        save_job(job);
+        free_job(job);
+
+        pthread_mutex_lock(&saveMutex);
+    }
+
+    return NULL;
+}
+
+static void start_save_thread() {
+
+    saveThreadOk = pthread_create(&saveThread, NULL, thumb_save_thread_main, NULL) == 0;
+
+    if (!saveThreadOk) {
+        L_E("%s: Could not start the thumbnail save thread", __func__);
+        return;
+    }
+
+    pthread_detach(saveThread);
+}
+
+bool iQueueThumbnailSave(const ImmyImage_t* im) {
+
+    if (im->state->thumb_status != IMAGE_STATUS_LOADED || !IsImageReady(im->thumb))
+        return false;
+
+    pthread_once(&saveThreadOnce, start_save_thread);
+
+    // without a writer we can still save, just not in the background
+    if (!saveThreadOk)
+        return iSaveThumbnail(im);
+
+    pthread_mutex_lock(&saveMutex);
+
+    bool full = saveCount >= THUMB_SAVE_QUEUE_MAX;
+
+    pthread_mutex_unlock(&saveMutex);
+
+    // checked again below, this only saves copying the pixels
+    if (full) {
+
+        L_D("%s: save queue is full, dropping %s", __func__, im->path);
+
+        return false;
+    }
+
+    ThumbSaveJob_t* job = calloc(1, sizeof(ThumbSaveJob_t));
+
+    if (job == NULL)
+        return false;
+
+    job->size      = iGetImageThumbLevel(im);
+    job->path      = iStrDup(im->path);
+    job->cachePath = iGetCachedPath(im->path, job->size);
+    job->thumb     = ImageCopy(im->thumb);
+
+    if (job->path == NULL || job->cachePath == NULL || !IsImageReady(job->thumb)) {
+
+        free_job(job);
+
+        return false;
+    }
+
+    pthread_mutex_lock(&saveMutex);
+
+    ThumbSaveJob_t* queued = saveHead;
+
+    while (queued != NULL && strcmp(queued->cachePath, job->cachePath) != 0)
+        queued = queued->next;
+
+    bool added = queued == NULL && saveCount < THUMB_SAVE_QUEUE_MAX;
+
+    if (queued != NULL) {
+
+        // the same file is still waiting, only the newest pixels are written
+        Image old = queued->thumb;
+
+        queued->thumb = job->thumb;
+        job->thumb    = old;
+
+    } else if (added) {
+
+        if (saveTail == NULL) {
+            saveHead = job;
+        } else {
+            saveTail->next = job;
+        }
+
+        saveTail       = job;
+        saveThreadBusy = true;
+
+        saveCount++;
+
+        pthread_cond_signal(&saveWakeCond);
+    }
+
+    pthread_mutex_unlock(&saveMutex);
+
+    if (!added)
+        free_job(job);
+
+    return added || queued != NULL;
+}
+
+void iFlushThumbnailSaves() {
+
+    if (!saveThreadOk)
+        return;
+
+    pthread_mutex_lock(&saveMutex);
+
+    while (saveHead != NULL || saveThreadBusy)
+        pthread_cond_wait(&saveIdleCond, &saveMutex);
+
+    pthread_mutex_unlock(&saveMutex);
+}
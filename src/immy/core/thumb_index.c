@@ -0,0 +1,595 @@
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <raylib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../external/hashmap.h"
+#include "../external/sha256.h"
+#include "../config.h"
+#include "core.h"
+
+#define INDEX_VERSION 1
+
+#define GRID_CELLS (THUMB_PLACEHOLDER_GRID * THUMB_PLACEHOLDER_GRID)
+
+// failed lookups remembered at once, the oldest is forgotten and asked for again if it is still shown
+#define FAILED_LOOKUPS_MAX 1024
+
+// One entry in the cache index.
+// The index is append only, a later record for the same hash replaces an earlier one.
+typedef struct {
+        uint8_t  hash[SHA256_BLOCK_SIZE]; // sha256 of the absolute image path
+        int64_t  mtime;                   // mtime of the image when the record was made
+        uint16_t width;                   // size of the smallest thumbnail level
+        uint16_t height;
+        uint8_t  version;
+        uint8_t  avg[3];
+        uint8_t  grid[GRID_CELLS][3];
+} ThumbIndexRecord_t;
+
+_Static_assert(sizeof(ThumbIndexRecord_t) == 96, "the cache index record size must not change");
+
+// A lookup asked for by the thumbnail page, keyed on the interned image path.
+typedef struct {
+        const char*        path;
+        ImageLoadStatus_t  status;
+        ThumbPlaceholder_t ph;
+} PlaceholderLookup_t;
+
+// A failed lookup keyed on the path hash, so adding that record can let the page ask again.
+typedef struct {
+        uint8_t     hash[SHA256_BLOCK_SIZE];
+        const char* path;
+} FailedLookup_t;
+
+// A path waiting for the index thread.
+typedef struct PlaceholderJob {
+        const char*            path;
+        struct PlaceholderJob* next;
+} PlaceholderJob_t;
+
+static pthread_once_t  indexOnce  = PTHREAD_ONCE_INIT;
+static pthread_mutex_t indexMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hashmap* indexMap   = NULL;  // guarded by indexMutex
+static atomic_bool     indexReady = false; // the index file has been read into indexMap
+static atomic_uint     indexGen   = 0;     // bumped whenever records are added
+
+// the index is read and the thumbnail page's lookups are done on this thread,
+// hashing the path and the stat stay off the main thread
+static pthread_t         indexThread;
+static bool              indexThreadOk = false;
+static pthread_mutex_t   lookupMutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    lookupCond    = PTHREAD_COND_INITIALIZER; // signaled when a job is queued
+static struct hashmap*   lookups       = NULL;                     // guarded by lookupMutex
+static PlaceholderJob_t* lookupHead    = NULL;
+static PlaceholderJob_t* lookupTail    = NULL;
+
+// the failed lookups by hash, and the order they failed in to forget the oldest, guarded by lookupMutex
+static struct hashmap* failedLookups = NULL;
+static FailedLookup_t  failedRing[FAILED_LOOKUPS_MAX];
+static size_t          failedNext  = 0;
+static size_t          failedCount = 0;
+
+static int record_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return memcmp(((const ThumbIndexRecord_t*)a)->hash, ((const ThumbIndexRecord_t*)b)->hash, SHA256_BLOCK_SIZE);
+}
+
+static uint64_t record_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    return hashmap_sip(((const ThumbIndexRecord_t*)item)->hash, SHA256_BLOCK_SIZE, seed0, seed1);
+}
+
+static int lookup_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return ((const PlaceholderLookup_t*)a)->path != ((const PlaceholderLookup_t*)b)->path;
+}
+
+static uint64_t lookup_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    return hashmap_murmur(&((const PlaceholderLookup_t*)item)->path, sizeof(char*), seed0, seed1);
+}
+
+static int failed_cmp(const void* a, const void* b, void* udata) {
+
+    (void)udata;
+
+    return memcmp(((const FailedLookup_t*)a)->hash, ((const FailedLookup_t*)b)->hash, SHA256_BLOCK_SIZE);
+}
+
+static uint64_t failed_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    return hashmap_sip(((const FailedLookup_t*)item)->hash, SHA256_BLOCK_SIZE, seed0, seed1);
+}
+
+static bool get_index_path(char* buf, size_t size) {
+
+    int n = snprintf(buf, size, "%s" THUMBNAIL_CACHE_PATH "index", iGetCacheDirectory());
+
+    return n > 0 && (size_t)n < size;
+}
+
+// Rewrites the index with only the newest record of each image.
+// Anything another process appends while this runs may be lost,
+// which is fine since it is only a cache.
+static void compact_index(const char* path, struct hashmap* map) {
+
+    char tmpPath[IMMY_PATH_MAX + 32];
+
+    int n = snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%d", path, (int)getpid());
+
+    if (n < 0 || (size_t)n >= sizeof(tmpPath))
+        return;
+
+    FILE* f = fopen(tmpPath, "wb");
+
+    if (f == NULL)
+        return;
+
+    size_t iter = 0;
+    void*  item;
+    bool   ok = true;
+
+    while (ok && hashmap_iter(map, &iter, &item))
+        ok = fwrite(item, sizeof(ThumbIndexRecord_t), 1, f) == 1;
+
+    ok = fclose(f) == 0 && ok;
+
+#ifdef _WIN32
+    // rename does not replace existing files on windows
+    if (ok)
+        remove(path);
+#endif
+
+    if (!ok || rename(tmpPath, path) != 0)
+        remove(tmpPath);
+}
+
+// Reads the index file into a map of its own, so lookups are not held up while it is read.
+static void load_index() {
+
+    struct hashmap* loaded = hashmap_new(sizeof(ThumbIndexRecord_t), 0, 0, 0, record_hash, record_cmp, NULL, NULL);
+
+    DIE_IF_NULL(loaded, "Cannot alloc a new hashmap");
+
+    char  path[IMMY_PATH_MAX];
+    FILE* f = get_index_path(path, sizeof(path)) ? fopen(path, "rb") : NULL;
+
+    if (f != NULL) {
+
+        ThumbIndexRecord_t records[256];
+        size_t             total = 0;
+        size_t             read;
+
+        while ((read = fread(records, sizeof(records[0]), 256, f)) > 0) {
+
+            for (size_t i = 0; i < read; i++) {
+
+                if (records[i].version == INDEX_VERSION)
+                    hashmap_set(loaded, records + i);
+            }
+
+            total += read;
+        }
+
+        fclose(f);
+
+        L_D("%s: read %zu records, %zu unique", __func__, total, hashmap_count(loaded));
+
+        if (total > THUMB_INDEX_COMPACT_RECORDS && total > hashmap_count(loaded) * 2)
+            compact_index(path, loaded);
+    }
+
+    pthread_mutex_lock(&indexMutex);
+
+    // records added while the file was read are newer than it
+    size_t iter = 0;
+    void*  item;
+
+    while (hashmap_iter(indexMap, &iter, &item))
+        hashmap_set(loaded, item);
+
+    hashmap_free(indexMap);
+
+    indexMap = loaded;
+
+    pthread_mutex_unlock(&indexMutex);
+
+    atomic_store(&indexReady, true);
+    atomic_fetch_add(&indexGen, 1);
+}
+
+// Finds the record of the image, this hashes the path and stats the image.
+// hash is filled in whenever the path could be hashed.
+static bool lookup(const char* path, ThumbPlaceholder_t* ph, uint8_t* hash) {
+
+    ThumbIndexRecord_t key;
+    struct stat        st;
+
+    if (!iGetPathHash(path, key.hash))
+        return false;
+
+    memcpy(hash, key.hash, SHA256_BLOCK_SIZE);
+
+    if (stat(path, &st) != 0)
+        return false;
+
+    pthread_mutex_lock(&indexMutex);
+
+    const ThumbIndexRecord_t* rec = hashmap_get(indexMap, &key);
+
+    bool found = rec != NULL && rec->mtime == (int64_t)st.st_mtime;
+
+    if (found) {
+
+        ph->avg    = (Color){rec->avg[0], rec->avg[1], rec->avg[2], 255};
+        ph->width  = rec->width;
+        ph->height = rec->height;
+
+        for (int i = 0; i < GRID_CELLS; i++)
+            ph->grid[i] = (Color){rec->grid[i][0], rec->grid[i][1], rec->grid[i][2], 255};
+    }
+
+    pthread_mutex_unlock(&indexMutex);
+
+    return found;
+}
+
+// Remembers a failed lookup, forgetting the oldest once there are FAILED_LOOKUPS_MAX.
+// Must hold lookupMutex.
+static void add_failed(const char* path, const uint8_t* hash) {
+
+    FailedLookup_t* slot = failedRing + failedNext;
+
+    if (failedCount == FAILED_LOOKUPS_MAX) {
+
+        const FailedLookup_t* old = hashmap_get(failedLookups, slot);
+
+        // the same hash may have failed again since, under a newer slot
+        if (old != NULL && old->path == slot->path) {
+
+            hashmap_delete(failedLookups, slot);
+            hashmap_delete(lookups, &(PlaceholderLookup_t){.path = slot->path});
+        }
+
+    } else {
+
+        failedCount++;
+    }
+
+    memcpy(slot->hash, hash, SHA256_BLOCK_SIZE);
+    slot->path = path;
+
+    hashmap_set(failedLookups, slot);
+
+    failedNext = (failedNext + 1) % FAILED_LOOKUPS_MAX;
+}
+
+// Does the lookup and stores the result for iPollThumbPlaceholder.
+static void answer(const char* path) {
+
+    ThumbPlaceholder_t ph;
+    uint8_t            hash[SHA256_BLOCK_SIZE] = {0};
+
+    // read first, a record added during the lookup might have been missed
+    unsigned gen   = atomic_load(&indexGen);
+    bool     found = lookup(path, &ph, hash);
+
+    pthread_mutex_lock(&lookupMutex);
+
+    // checked under the lock, iAddThumbPlaceholder bumps it before it looks at the failures
+    bool missed = !found && gen != atomic_load(&indexGen);
+
+    PlaceholderLookup_t* l = (PlaceholderLookup_t*)hashmap_get(lookups, &(PlaceholderLookup_t){.path = path});
+
+    if (l != NULL && missed) {
+
+        // asked for again on the next poll
+        hashmap_delete(lookups, l);
+
+    } else if (l != NULL) {
+
+        l->status = found ? IMAGE_STATUS_LOADED : IMAGE_STATUS_FAILED;
+        l->ph     = ph;
+
+        if (!found)
+            add_failed(path, hash);
+    }
+
+    pthread_mutex_unlock(&lookupMutex);
+}
+
+static void* index_thread_main(void* arg) {
+
+    (void)arg;
+
+    load_index();
+
+    pthread_mutex_lock(&lookupMutex);
+
+    for (;;) {
+
+        while (lookupHead == NULL)
+            pthread_cond_wait(&lookupCond, &lookupMutex);
+
+        PlaceholderJob_t* job = lookupHead;
+
+        lookupHead = job->next;
+
+        if (lookupHead == NULL)
+            lookupTail = NULL;
+
+        pthread_mutex_unlock(&lookupMutex);
+
+        answer(job->path);
+        free(job);
+
+        pthread_mutex_lock(&lookupMutex);
+    }
+
+    return NULL;
+}
+
+static void start_index_thread() {
+
+    indexMap = hashmap_new(sizeof(ThumbIndexRecord_t), 0, 0, 0, record_hash, record_cmp, NULL, NULL);
+    lookups  = hashmap_new(sizeof(PlaceholderLookup_t), 0, 0, 0, lookup_hash, lookup_cmp, NULL, NULL);
+
+    failedLookups = hashmap_new(sizeof(FailedLookup_t), 0, 0, 0, failed_hash, failed_cmp, NULL, NULL);
+
+    DIE_IF_NULL(indexMap, "Cannot alloc a new hashmap");
+    DIE_IF_NULL(lookups, "Cannot alloc a new hashmap");
+    DIE_IF_NULL(failedLookups, "Cannot alloc a new hashmap");
+
+    indexThreadOk = pthread_create(&indexThread, NULL, index_thread_main, NULL) == 0;
+
+    if (!indexThreadOk) {
+
+        L_E("%s: Could not start the thumbnail index thread", __func__);
+
+        // without the thread everything happens on the caller
+        load_index();
+
+        return;
+    }
+
+    pthread_detach(indexThread);
+}
+
+bool iMakeThumbPlaceholder(const Image* thumb, ThumbPlaceholder_t* ph) {
+
+    if (!IsImageReady(*thumb))
+        return false;
+
+    Color* pixels = LoadImageColors(*thumb);
+
+    if (pixels == NULL)
+        return false;
+
+    const int w = thumb->width;
+    const int h = thumb->height;
+    const int G = THUMB_PLACEHOLDER_GRID;
+
+    // alpha weighted, so transparent pixels do not darken the colors
+    uint64_t sums[GRID_CELLS][4] = {0};
+
+    for (int y = 0; y < h; y++) {
+
+        int gy = y * G / h;
+
+        for (int x = 0; x < w; x++) {
+
+            Color     c = pixels[y * w + x];
+            uint64_t* s = sums[gy * G + x * G / w];
+
+            s[0] += c.r * c.a;
+            s[1] += c.g * c.a;
+            s[2] += c.b * c.a;
+            s[3] += c.a;
+        }
+    }
+
+    UnloadImageColors(pixels);
+
+    uint64_t total[4] = {0};
+
+    for (int i = 0; i < GRID_CELLS; i++) {
+
+        for (int c = 0; c < 4; c++)
+            total[c] += sums[i][c];
+
+        if (sums[i][3] == 0) {
+
+            ph->grid[i] = THUMB_BACKGROUND_COLOR;
+
+            continue;
+        }
+
+        ph->grid[i] = (Color){
+            sums[i][0] / sums[i][3],
+            sums[i][1] / sums[i][3],
+            sums[i][2] / sums[i][3],
+            255,
+        };
+    }
+
+    if (total[3] == 0) {
+
+        ph->avg = THUMB_BACKGROUND_COLOR;
+
+    } else {
+
+        ph->avg = (Color){
+            total[0] / total[3],
+            total[1] / total[3],
+            total[2] / total[3],
+            255,
+        };
+    }
+
+    ph->width  = w;
+    ph->height = h;
+
+    return true;
+}
+
+bool iAddThumbPlaceholder(const char* path, const Image* thumb) {
+
+    ThumbPlaceholder_t ph;
+    ThumbIndexRecord_t rec = {.version = INDEX_VERSION};
+    struct stat        st;
+
+    if (!iMakeThumbPlaceholder(thumb, &ph) || !iGetPathHash(path, rec.hash) || stat(path, &st) != 0)
+        return false;
+
+    rec.mtime  = st.st_mtime;
+    rec.width  = ph.width;
+    rec.height = ph.height;
+    rec.avg[0] = ph.avg.r;
+    rec.avg[1] = ph.avg.g;
+    rec.avg[2] = ph.avg.b;
+
+    for (int i = 0; i < GRID_CELLS; i++) {
+        rec.grid[i][0] = ph.grid[i].r;
+        rec.grid[i][1] = ph.grid[i].g;
+        rec.grid[i][2] = ph.grid[i].b;
+    }
+
+    pthread_once(&indexOnce, start_index_thread);
+
+    char indexPath[IMMY_PATH_MAX];
+
+    if (!get_index_path(indexPath, sizeof(indexPath)) || !iCreateDirectory(indexPath))
+        return false;
+
+    pthread_mutex_lock(&indexMutex);
+
+    hashmap_set(indexMap, &rec);
+
+    pthread_mutex_unlock(&indexMutex);
+
+    // bumped before the failures are checked, so a lookup running right now sees it
+    atomic_fetch_add(&indexGen, 1);
+
+    pthread_mutex_lock(&lookupMutex);
+
+    FailedLookup_t key = {0};
+
+    memcpy(key.hash, rec.hash, SHA256_BLOCK_SIZE);
+
+    const FailedLookup_t* failed = hashmap_get(failedLookups, &key);
+    const char*           retry  = failed != NULL ? failed->path : NULL;
+
+    // only the image this record is for is asked for again, its ring slot is skipped once it comes around
+    if (retry != NULL) {
+
+        hashmap_delete(failedLookups, &key);
+        hashmap_delete(lookups, &(PlaceholderLookup_t){.path = retry});
+    }
+
+    pthread_mutex_unlock(&lookupMutex);
+
+    // a single small append is not split, even with several writers
+    int fd = open(indexPath, O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+    if (fd == -1) {
+
+        L_W("%s: could not open %s: %s", __func__, indexPath, strerror(errno));
+
+        return false;
+    }
+
+    bool ok = write(fd, &rec, sizeof(rec)) == sizeof(rec);
+
+    close(fd);
+
+    return ok;
+}
+
+bool iGetThumbPlaceholder(const char* path, ThumbPlaceholder_t* ph) {
+
+    pthread_once(&indexOnce, start_index_thread);
+
+    uint8_t hash[SHA256_BLOCK_SIZE];
+
+    return atomic_load(&indexReady) && lookup(path, ph, hash);
+}
+
+void iRequestThumbPlaceholder(const char* path) {
+
+    pthread_once(&indexOnce, start_index_thread);
+
+    PlaceholderJob_t* job = indexThreadOk ? malloc(sizeof(PlaceholderJob_t)) : NULL;
+
+    pthread_mutex_lock(&lookupMutex);
+
+    const PlaceholderLookup_t* l = hashmap_get(lookups, &(PlaceholderLookup_t){.path = path});
+
+    // already on its way
+    if (l != NULL && l->status == IMAGE_STATUS_LOADING) {
+
+        pthread_mutex_unlock(&lookupMutex);
+
+        free(job);
+
+        return;
+    }
+
+    hashmap_set(lookups, &(PlaceholderLookup_t){.path = path, .status = IMAGE_STATUS_LOADING});
+
+    if (job != NULL) {
+
+        *job = (PlaceholderJob_t){.path = path};
+
+        if (lookupTail == NULL) {
+            lookupHead = job;
+        } else {
+            lookupTail->next = job;
+        }
+
+        lookupTail = job;
+
+        pthread_cond_signal(&lookupCond);
+    }
+
+    pthread_mutex_unlock(&lookupMutex);
+
+    // no thread to hand it to
+    if (job == NULL)
+        answer(path);
+}
+
+ImageLoadStatus_t iPollThumbPlaceholder(const char* path, ThumbPlaceholder_t* ph) {
+
+    pthread_once(&indexOnce, start_index_thread);
+
+    pthread_mutex_lock(&lookupMutex);
+
+    PlaceholderLookup_t* l = (PlaceholderLookup_t*)hashmap_get(lookups, &(PlaceholderLookup_t){.path = path});
+
+    ImageLoadStatus_t status = l != NULL ? l->status : IMAGE_STATUS_NOT_LOADED;
+
+    // the caller keeps it from here
+    if (status == IMAGE_STATUS_LOADED) {
+
+        *ph = l->ph;
+
+        hashmap_delete(lookups, l);
+    }
+
+    pthread_mutex_unlock(&lookupMutex);
+
+    return status;
+}
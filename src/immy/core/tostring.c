@@ -60,6 +60,49 @@ const char* iInterpolationToStr(TextureFilter tf){
     }
 }
 
+const char* iSortOrderToStr(StrCompare_t order) {
+
+    switch (order) {
+
+    case SORT_ORDER__DEFAULT:
+        return "SORT_BY_NAME";
+
+    case SORT_ORDER__NATURAL:
+        return "SORT_BY_NAME_NATURAL";
+
+    case SORT_ORDER__MTIME:
+        return "SORT_BY_MTIME";
+
+    case SORT_ORDER__SIZE:
+        return "SORT_BY_SIZE";
+
+    case SORT_ORDER__DIMENSIONS:
+        return "SORT_BY_DIMENSIONS";
+
+    case SORT_ORDER__DATE_TAKEN:
+        return "SORT_BY_DATE_TAKEN";
+    }
+
+    return "SORT_UNKNOWN";
+}
+
+const char* iDitherKernelToStr(DitherKernel_t kernel) {
+
+    switch (kernel) {
+
+    case DITHER_FLOYD_STEINBERG:
+        return "DITHER_FLOYD_STEINBERG";
+
+    case DITHER_ATKINSON:
+        return "DITHER_ATKINSON";
+
+    case DITHER_STUCKI:
+        return "DITHER_STUCKI";
+    }
+
+    return "DITHER_UNKNOWN";
+}
+
 
 
 const char* iKeyToStr(int key) {
@@ -1,19 +1,51 @@
 
 #ifdef __unix__
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+// the child closes its end once the first image is loaded, the parent waits for that
+static int readyFd = -1;
+
 bool uDetachFromTerminal() {
 
+    int ready[2];
+
+    if (pipe(ready) != 0)
+        return false;
+
+    // so programs started later do not keep the parent waiting
+    fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ready[1], F_SETFD, FD_CLOEXEC);
+
     int pid = fork();
 
-    if (pid > 0)
+    if (pid > 0) {
+
+        close(ready[1]);
+
+        // returns on EOF, when the child signals or dies
+        char c;
+
+        while (read(ready[0], &c, 1) < 0 && errno == EINTR)
+            ;
+
         exit(EXIT_SUCCESS);
+    }
+
+    close(ready[0]);
+
+    if (pid < 0) {
+
+        close(ready[1]);
 
-    if (pid < 0)
         return false;
+    }
+
+    readyFd = ready[1];
 
     freopen("/dev/null", "r", stdin);
     freopen("/dev/null", "w", stdout);
@@ -22,6 +54,15 @@ bool uDetachFromTerminal() {
     return true;
 }
 
+void uSignalStartupDone() {
 
-#endif
+    if (readyFd == -1)
+        return;
+
+    close(readyFd);
 
+    readyFd = -1;
+}
+
+
+#endif
@@ -83,23 +83,34 @@ bool dArrayInit(DArray_t* darray, size_t item_size, size_t size_initial) {
     return darray->buffer == NULL;
 }
 
-bool dArrayGrowSize(DArray_t* darray, size_t item_size, size_t size_) {
+// Grows the buffer to at least length items, the old buffer is kept if it cannot.
+static bool darray_reserve(DArray_t* darray, size_t item_size, size_t length) {
 
-    if (size_ > darray->length) {
+    size_t newLength = darray->length == 0 ? 32 : darray->length;
+
+    while (length > newLength)
+        newLength *= 2;
+
+    void* buffer = realloc(darray->buffer, item_size * newLength);
 
-        if (darray->length == 0)
-            darray->length = 32;
+    if (buffer == NULL)
+        return false;
+
+    darray->buffer = buffer;
+    darray->length = newLength;
+
+    return true;
+}
 
-        while (size_ > darray->length)
-            darray->length *= 2;
+bool dArrayGrowSize(DArray_t* darray, size_t item_size, size_t size_) {
 
-        darray->buffer = realloc(darray->buffer, item_size * darray->length);
+    if (size_ > darray->length) {
 
-        if (darray->buffer == NULL)
+        if (!darray_reserve(darray, item_size, size_))
             return false;
 
-        /* you have to zero out when using realloc */
-        memset((char*)darray->buffer + (item_size * darray->size), 0, item_size * (darray->length - darray->size));
+        /* you have to zero out when using realloc, only the new items are read */
+        memset((char*)darray->buffer + (item_size * darray->size), 0, item_size * (size_ - darray->size));
 
         darray->size = size_;
     }
@@ -109,23 +120,10 @@ bool dArrayGrowSize(DArray_t* darray, size_t item_size, size_t size_) {
 
 bool dArrayAppend(DArray_t* restrict darray, size_t item_size, void* restrict item) {
 
-    if (darray->size >= darray->length) {
-
-        if (darray->length == 0)
-            darray->length = 32;
-
-        darray->length *= 2;
+    // the tail is not zeroed, every slot is written before size covers it
+    if (darray->size >= darray->length && !darray_reserve(darray, item_size, darray->size + 1))
+        return false;
 
-        darray->buffer = realloc(darray->buffer, item_size * darray->length);
-
-        if (darray->buffer == NULL) {
-            return false;
-        } 
-
-        /* you have to zero out when using realloc */
-        memset((char*)darray->buffer + (item_size * darray->size), 0, item_size * (darray->length - darray->size));
-    }
-    
     memcpy((char*)darray->buffer + (item_size * darray->size), item, item_size);
 
     darray->size++;
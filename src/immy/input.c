@@ -22,6 +22,13 @@
         return;                                                                                                        \
     }
 
+// edits and copies need every pixel, not the proxy shown in their place
+#define _FULL_IMAGE(c)                                                                                                 \
+    if ((c)->selected_image->isProxy && !iPromoteImage((c)->selected_image, true)) {                                   \
+        L_W("The full image could not be loaded!");                                                                    \
+        return;                                                                                                        \
+    }
+
 #define I_X(i) (i)->selected_image->dstPos.x
 #define I_Y(i) (i)->selected_image->dstPos.y
 #define I_WIDTH(i) (i)->selected_image->srcRect.width
@@ -140,16 +147,12 @@ void kb_Jump_Image_End(ImmyControl_t* ctrl) {
 
 void kb_Print_Debug_Info(ImmyControl_t* ctrl) {
 
-    ImmyImage_t* im;
-
     DARRAY_FOR_EACH(ctrl->image_files, i) {
 
-        im = ctrl->image_files.buffer + i;
-
-        L_I("%zu: %s\n", i, im->path);
+        L_I("%zu: %s\n", i, ctrl->image_files.paths[i]);
     }
 
-    im = ctrl->selected_image;
+    ImmyImage_t* im = ctrl->selected_image;
 
     _NO_IMAGE_WARN(ctrl);
 
@@ -227,6 +230,7 @@ void kb_Fit_Center_Image(ImmyControl_t* ctrl) {
 void kb_Flip_Vertical(ImmyControl_t* ctrl) {
 
     _NO_IMAGE_WARN(ctrl);
+    _FULL_IMAGE(ctrl);
 
     float hh = GetScreenHeight() / 2.0;
 
@@ -240,6 +244,7 @@ void kb_Flip_Vertical(ImmyControl_t* ctrl) {
 void kb_Flip_Horizontal(ImmyControl_t* ctrl) {
 
     _NO_IMAGE_WARN(ctrl);
+    _FULL_IMAGE(ctrl);
 
     float hw = GetScreenWidth() / 2.0;
 
@@ -253,42 +258,47 @@ void kb_Flip_Horizontal(ImmyControl_t* ctrl) {
 void kb_Color_Invert(ImmyControl_t* ctrl) {
 
     _NO_IMAGE_WARN(ctrl);
+    _FULL_IMAGE(ctrl);
 
     ctrl->selected_image->rebuildBuff = true;
 
-    int bytes = 4;
+    // bytes per pixel, and how many of them are color
+    int bytes  = 4;
+    int colors = 3;
 
     switch (ctrl->selected_image->rayim.format) {
 
     default:
         ImageColorInvert(&ctrl->selected_image->rayim);
-        break;
+        return;
 
     // the raylib ImageColorInvert is not optimal for these formats
     case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE:
-    case PIXELFORMAT_UNCOMPRESSED_R8G8B8:
+        bytes  = 1;
+        colors = 1;
+        break;
 
-        bytes = 3;
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA:
+        bytes  = 2;
+        colors = 1;
+        break;
 
-        FALLTHROUGH;
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8:
+        bytes = 3;
+        break;
 
     case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8:
-    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA:
+        break;
+    }
 
-        unsigned char* pixels = ctrl->selected_image->rayim.data;
+    unsigned char* pixels = ctrl->selected_image->rayim.data;
 
-        size_t size = bytes * ctrl->selected_image->rayim.width * ctrl->selected_image->rayim.height;
+    size_t size = (size_t)bytes * ctrl->selected_image->rayim.width * ctrl->selected_image->rayim.height;
 
-        for (size_t i = 0; i < size; i += (bytes == 4)) {
+    for (size_t i = 0; i < size; i += bytes) {
 
-            pixels[i] = 255 - pixels[i];
-            ++i;
-            pixels[i] = 255 - pixels[i];
-            ++i;
-            pixels[i] = 255 - pixels[i];
-            ++i;
-        }
-        break;
+        for (int c = 0; c < colors; c++)
+            pixels[i + c] = 255 - pixels[i + c];
     }
 }
 
@@ -308,6 +318,14 @@ void kb_Color_Grayscale_Shader(ImmyControl_t* ctrl) {
     ctrl->selected_image->updateShaders = true;
 }
 
+void kb_Bayer_Dither_Shader(ImmyControl_t* ctrl) {
+
+    _NO_IMAGE_WARN(ctrl);
+
+    ctrl->selected_image->applyBayerShader = !ctrl->selected_image->applyBayerShader;
+    ctrl->selected_image->updateShaders = true;
+}
+
 void kb_Increase_FPS(ImmyControl_t* ctrl) {
 
     SetTargetFPS(GetFPS() + 1);
@@ -406,11 +424,12 @@ void kb_Scroll_Keybind_List_Down(ImmyControl_t* ctrl) {
 void kb_Copy_Image_To_Clipboard(ImmyControl_t* ctrl) {
 
     _NO_IMAGE_WARN(ctrl);
+    _FULL_IMAGE(ctrl);
 
     if (iCopyImageToClipboard(ctrl->selected_image)) {
 
         ctrl->message = (ImmyMessage_t){
-            .message         = (char*)TextFormat("Copied %s to clipboard", ctrl->selected_image->name),
+            .message         = (char*)TextFormat("Copied %s to clipboard", ctrl->image_files.names[ctrl->selected_index]),
             .free_when_done  = false,
             .show_for_frames = WINDOW_FPS * 2,
         };
@@ -460,23 +479,96 @@ void kb_Cycle_Image_Interpolation(ImmyControl_t* ctrl) {
     };
 }
 
+void kb_Cycle_Sort_Order(ImmyControl_t* ctrl) {
+
+    ctrl->filename_cmp++;
+
+    if (ctrl->filename_cmp > SORT_ORDER__END) {
+        ctrl->filename_cmp = SORT_ORDER__START;
+    }
+
+    iSortImages(ctrl);
+
+    // sorted again once the metadata is read
+    iGatherImageMeta(ctrl);
+
+    ctrl->message = (ImmyMessage_t){
+        .message         = (char*)iSortOrderToStr(ctrl->filename_cmp),
+        .free_when_done  = false,
+        .show_for_frames = WINDOW_FPS * 0.75,
+    };
+}
+
+void kb_Search_Files(ImmyControl_t* ctrl) {
+
+    iSearchOpen(ctrl);
+
+    // the key that opened the prompt is not part of the query
+    while (GetCharPressed() != 0)
+        ;
+}
+
 void kb_Dither(ImmyControl_t* ctrl) {
 
+    _NO_IMAGE_WARN(ctrl);
+    _FULL_IMAGE(ctrl);
+
+    if (!iDitherImageAsync(ctrl->selected_image, ctrl->ditherKernel))
+        return;
+
+    ctrl->message = (ImmyMessage_t){
+        .message         = (char*)iDitherKernelToStr(ctrl->ditherKernel),
+        .free_when_done  = false,
+        .show_for_frames = WINDOW_FPS * 0.75,
+    };
+}
+
+void kb_Cycle_Dither_Kernel(ImmyControl_t* ctrl) {
+
+    ctrl->ditherKernel++;
+
+    if (ctrl->ditherKernel > DITHER__END) {
+        ctrl->ditherKernel = DITHER__START;
+    }
+
+    ctrl->message = (ImmyMessage_t){
+        .message         = (char*)iDitherKernelToStr(ctrl->ditherKernel),
+        .free_when_done  = false,
+        .show_for_frames = WINDOW_FPS * 0.75,
+    };
+}
+
+void kb_Toggle_Flipbook(ImmyControl_t* ctrl) {
+
+    if (iFlipbookPlaying()) {
+
+        iStopFlipbook(ctrl);
+
+        return;
+    }
+
     _NO_IMAGE_WARN(ctrl);
 
-    iDitherImage(ctrl->selected_image);
+    if (iStartFlipbook(ctrl))
+        return;
+
+    ctrl->message = (ImmyMessage_t){
+        .message         = "Not part of a numbered sequence",
+        .free_when_done  = false,
+        .show_for_frames = WINDOW_FPS * 0.75,
+    };
 }
 
 void kb_Thumb_Page_Down(ImmyControl_t* ctrl) {
 
-    int cols = GetScreenWidth() / THUMB_SIZE;
+    int cols = MAX(1, GetScreenWidth() / ctrl->thumbCellSize);
 
     iSetImage(ctrl, ctrl->selected_index + cols);
 }
 
 void kb_Thumb_Page_Up(ImmyControl_t* ctrl) {
 
-    int cols = GetScreenWidth() / THUMB_SIZE;
+    int cols = MAX(1, GetScreenWidth() / ctrl->thumbCellSize);
 
     if (ctrl->selected_index >= cols)
         iSetImage(ctrl, ctrl->selected_index - cols);
@@ -492,3 +584,32 @@ void kb_Thumb_Page_Right(ImmyControl_t* ctrl) {
 
     iSetImage(ctrl, ctrl->selected_index + 1);
 }
+
+static void set_thumb_cell_size(ImmyControl_t* ctrl, int size) {
+
+    size = MAX(THUMB_CELL_SIZE_MIN, MIN(THUMB_CELL_SIZE_MAX, size));
+
+    if (size == ctrl->thumbCellSize)
+        return;
+
+    ctrl->thumbCellSize = size;
+
+    int level = iGetThumbLevel(size);
+
+    // every thumbnail texture is for the old level
+    if (level != ctrl->thumbLevel) {
+
+        iSetThumbLevel(ctrl, level);
+        uiThumbPageClearState();
+    }
+}
+
+void kb_Thumb_Zoom_In(ImmyControl_t* ctrl) {
+
+    set_thumb_cell_size(ctrl, ctrl->thumbCellSize + THUMB_CELL_SIZE_STEP);
+}
+
+void kb_Thumb_Zoom_Out(ImmyControl_t* ctrl) {
+
+    set_thumb_cell_size(ctrl, ctrl->thumbCellSize - THUMB_CELL_SIZE_STEP);
+}
@@ -68,6 +68,7 @@ void kb_Flip_Horizontal(ImmyControl_t* ctrl);
 void kb_Color_Invert(ImmyControl_t* ctrl);
 void kb_Color_Invert_Shader(ImmyControl_t* ctrl);
 void kb_Color_Grayscale_Shader(ImmyControl_t* ctrl);
+void kb_Bayer_Dither_Shader(ImmyControl_t* ctrl);
 
 void kb_Increase_FPS(ImmyControl_t* ctrl);
 void kb_Decrease_FPS(ImmyControl_t* ctrl);
@@ -90,12 +91,19 @@ void kb_Copy_Image_To_Clipboard(ImmyControl_t* ctrl);
 void kb_Paste_Image_From_Clipboard(ImmyControl_t* ctrl);
 
 void kb_Dither(ImmyControl_t* ctrl);
+void kb_Cycle_Dither_Kernel(ImmyControl_t* ctrl);
+
+void kb_Toggle_Flipbook(ImmyControl_t* ctrl);
 
 void kb_Cycle_Image_Interpolation(ImmyControl_t* ctrl);
+void kb_Cycle_Sort_Order(ImmyControl_t* ctrl);
+void kb_Search_Files(ImmyControl_t* ctrl);
 
 void kb_Thumb_Page_Down(ImmyControl_t* ctrl);
 void kb_Thumb_Page_Up(ImmyControl_t* ctrl);
 void kb_Thumb_Page_Left(ImmyControl_t* ctrl);
 void kb_Thumb_Page_Right(ImmyControl_t* ctrl);
+void kb_Thumb_Zoom_In(ImmyControl_t* ctrl);
+void kb_Thumb_Zoom_Out(ImmyControl_t* ctrl);
 
 #endif
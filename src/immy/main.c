@@ -13,22 +13,23 @@
 #include "ui/ui.h"
 #include "core/core.h"
 
-struct ImmyControl this;
-
-static inline void sort_file_list(FilePathList fpl) {
+// must come after config.h
+#if defined(IMYLIB2_AVAILABLE) && USE_IMYLIB2
+#include <imylib2.h>
+#endif
 
-    switch (this.filename_cmp) {
+struct ImmyControl this;
 
-    case SORT_ORDER__DEFAULT:
-        qsort(fpl.paths, fpl.count, sizeof(fpl.paths[0]), iqStrCmp);
-        break;
+static double lastScanMerge = 0;
 
-    case SORT_ORDER__NATURAL:
-        qsort(fpl.paths, fpl.count, sizeof(fpl.paths[0]), iqNatStrCmp);
-        break;
-    }
-}
+// Directories from the start arguments, walked once the process has detached.
+typedef struct {
+        const char* path;
+        int         group;
+} PendingScan_t;
 
+static PendingScan_t* pendingScans     = NULL;
+static int            pendingScanCount = 0;
 
 void add_file(const char* path_) {
 
@@ -43,13 +44,63 @@ void handle_dropped_files() {
 
     FilePathList fpl = LoadDroppedFiles();
 
-    sort_file_list(fpl);
+    if (fpl.count == 0) {
+
+        UnloadDroppedFiles(fpl);
+
+        return;
+    }
+
+    char** paths = malloc(fpl.count * sizeof(char*));
+    size_t count = 0;
+
+    DIE_IF_NULL(paths, "%s: Cannot allocate the dropped files", __func__);
 
     for (size_t i = 0; i < fpl.count; i++) {
-        add_file(fpl.paths[i]);
+
+        if ((paths[count] = iStrDup(fpl.paths[i])) != NULL)
+            count++;
     }
 
     UnloadDroppedFiles(fpl);
+
+    iAddImages(&this, paths, count, ++this.image_group);
+
+    free(paths);
+
+    if (this.selected_image == NULL)
+        iSetImage(&this, 0);
+}
+
+// Moves files found by the directory scanner into the image list.
+void merge_scanned_files() {
+
+    // the first images are merged right away so something shows up
+    if (this.image_files.size > 0 && GetTime() - lastScanMerge < SCAN_MERGE_INTERVAL)
+        return;
+
+    ScanBatch_t* batch = iScanTakeBatches();
+
+    if (batch == NULL)
+        return;
+
+    lastScanMerge = GetTime();
+
+    while (batch != NULL) {
+
+        ScanBatch_t* next = batch->next;
+
+        iAddImages(&this, batch->paths, batch->count, batch->group);
+
+        iScanFreeBatch(batch);
+
+        batch = next;
+    }
+
+    if (this.selected_image == NULL)
+        iSetImage(&this, 0);
+
+    this.renderFrames = RENDER_FRAMES;
 }
 
 void do_mouse_input() {
@@ -130,6 +181,71 @@ void do_keyboard_input() {
     }
 }
 
+// The search prompt takes the keyboard while it is open.
+void do_search_input() {
+
+    char   query[SEARCH_QUERY_SIZE];
+    size_t length = this.search.length;
+    bool   typed  = false;
+    int    c;
+
+    memcpy(query, this.search.query, length);
+
+    while ((c = GetCharPressed()) != 0) {
+
+        int         n;
+        const char* utf8 = CodepointToUTF8(c, &n);
+
+        if (length + n >= sizeof(query))
+            continue;
+
+        memcpy(query + length, utf8, n);
+
+        length += n;
+        typed   = true;
+    }
+
+    if ((IsKeyPressed(KEY_BACKSPACE) || IsKeyPressedRepeat(KEY_BACKSPACE)) && length > 0) {
+
+        // drop the whole last codepoint
+        do {
+            length--;
+        } while (length > 0 && (query[length] & 0xC0) == 0x80);
+
+        typed = true;
+    }
+
+    query[length] = 0;
+
+    if (typed)
+        iSearchSetQuery(&this, query);
+
+    int s = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+
+    if (IsKeyPressed(KEY_ESCAPE)) {
+
+        iSearchClose(&this, false);
+
+    } else if (IsKeyPressed(KEY_ENTER)) {
+
+        iSearchClose(&this, true);
+
+    } else if (IsKeyPressed(KEY_DOWN) || IsKeyPressedRepeat(KEY_DOWN) || (!s && IsKeyPressed(KEY_TAB))) {
+
+        iSearchMove(&this, 1);
+
+    } else if (IsKeyPressed(KEY_UP) || IsKeyPressedRepeat(KEY_UP) || (s && IsKeyPressed(KEY_TAB))) {
+
+        iSearchMove(&this, -1);
+
+    } else if (!typed) {
+
+        return;
+    }
+
+    this.renderFrames = RENDER_FRAMES;
+}
+
 // returns the number of arguments to skip
 int handle_flags(
     ImmyConfig_t* config, const char* flag_str, const char* flag_value
@@ -237,6 +353,10 @@ int handle_flags(
 
 void handle_start_args(ImmyConfig_t* config, int argc, char* argv[]) {
 
+    pendingScans = malloc(argc * sizeof(PendingScan_t));
+
+    DIE_IF_NULL(pendingScans, "%s: Cannot allocate the directory list", __func__);
+
     for (int i = 1; i < argc; i++) {
 
         if (!FileExists(argv[i])) {
@@ -250,34 +370,54 @@ void handle_start_args(ImmyConfig_t* config, int argc, char* argv[]) {
             continue;
         }
 
+        // later arguments always sort after earlier ones,
+        // even when a directory is still being scanned
+        this.image_group++;
+
         if (!DirectoryExists(argv[i])) {
 
             add_file(argv[i]);
             continue;
         }
 
-        L_I("Scanning directory %s for files", argv[i]);
+        pendingScans[pendingScanCount++] = (PendingScan_t){argv[i], this.image_group};
+    }
+}
 
-        FilePathList fpl = LoadDirectoryFilesEx(
-            argv[i], IMAGE_FILE_FILTER, SEARCH_DIRS_RECURSIVE
-        );
+// Starts walking the directories from the start arguments.
+// Threads do not survive the fork when detaching, so this waits until after it.
+void start_pending_scans() {
 
-        sort_file_list(fpl);
+    for (int i = 0; i < pendingScanCount; i++) {
 
-        for (size_t j = 0; j < fpl.count; j++) {
-            add_file(fpl.paths[j]);
-        }
+        // the window opens while this runs, files show up as they are found
+        L_I("Scanning directory %s for files", pendingScans[i].path);
 
-        UnloadDirectoryFiles(fpl);
+        iScanDirectory(pendingScans[i].path, pendingScans[i].group, SEARCH_DIRS_RECURSIVE);
     }
+
+    free(pendingScans);
+
+    pendingScans = NULL;
 }
 
 
 int main(int argc, char* argv[]) {
 
+    double startupStart = iGetTime();
+
     // repalce raylib logging with our own
 	SetTraceLogCallback(iLogRaylib);
 
+#ifdef IMYLIB2_H
+    // decoded pixels are handed to raylib, so they come from the same pool it frees into
+    il2SetDataMemoryFunction(iPixelDataMemory);
+#endif
+
+    // headless mode, no window is ever made
+    if (argc > 1 && strcmp(argv[1], CLI_PREGEN_THUMBS_FLAG) == 0)
+        return iPregenThumbnails(argc - 2, argv + 2);
+
     memset(&this, 0, sizeof(this));
 
     this.config.window_title          = WINDOW_TITLE;
@@ -293,7 +433,10 @@ int main(int argc, char* argv[]) {
     this.config.terminal              = !DETACH_FROM_TERMINAL;
     this.config.show_bar              = true;
 
-    this.filename_cmp = DEFAULT_SORT_ORDER;
+    this.filename_cmp  = DEFAULT_SORT_ORDER;
+    this.thumbCellSize = THUMB_SIZE;
+    this.thumbLevel    = iGetThumbLevel(THUMB_SIZE);
+    this.ditherKernel  = DITHER_KERNEL;
 
     handle_start_args(&this.config, argc, argv);
 
@@ -301,24 +444,54 @@ int main(int argc, char* argv[]) {
         uiSetScreenPaddingBottom(INFO_BAR_HEIGHT);
 
 #if DIE_IF_NO_IMAGE
-    if (this.image_files.size <= 0)
+    if (this.image_files.size <= 0 && pendingScanCount == 0)
         DIE("no arguments given\n\n" CLI_HELP);
 #endif
 
-    this.selected_image = this.image_files.buffer;
+    this.selected_image = this.image_files.images;
     this.renderFrames   = RENDER_FRAMES;
 
-    // we want to load the image before we lose the terminal
-    // so that scripts know we have the image and can remove it
-    if (this.selected_image != NULL)
-        iLoadImage(this.selected_image);
-
+    // the parent process waits for iSignalStartupDone,
+    // so scripts still know we have the image and can remove it
     if (!this.config.terminal)
         iDetachFromTerminal();
 
+    start_pending_scans();
+
+    // the monitor is not known until the window exists, but the first image already wants its proxy
+    iSetProxySize(PROXY_IMAGE_SIZE > 0 ? PROXY_IMAGE_SIZE : PROXY_STARTUP_SIZE);
+
+    // the first image decodes while the window is made,
+    // the first frame waits for whichever is slowest
+    bool firstImageAsync = false;
+
+#if ASYNC_IMAGE_LOADING
+    if (this.selected_image != NULL && iLoadImageAsync(this.selected_image)) {
+
+        this.selected_image->state->status = IMAGE_STATUS_LOADING;
+
+        firstImageAsync = true;
+    }
+#endif
+
+    if (this.selected_image != NULL && !firstImageAsync)
+        iLoadImage(this.selected_image);
+
     uiInit(&this.config);
 
-    uiLoadCodepointsFromFileList(&this);
+    // this needs the window, the first image keeps the proxy it was made with
+    int monitor = GetCurrentMonitor();
+
+    iSetProxySize(PROXY_IMAGE_SIZE > 0 ? PROXY_IMAGE_SIZE : MAX(GetMonitorWidth(monitor), GetMonitorHeight(monitor)));
+
+    double windowReady = iGetTime();
+
+    if (firstImageAsync)
+        iWaitImageAsync(this.selected_image);
+
+    double imageReady = iGetTime();
+
+    iSignalStartupDone();
 
     // this loads the image and makes sure it is actually center
     // since my tiling wm spawns the window floating and then unfloats it
@@ -331,10 +504,34 @@ int main(int argc, char* argv[]) {
             EndDrawing();
         }
 
+    L_I("Startup: window %.1fms, first image %.1fms, first frame %.1fms", (windowReady - startupStart) * 1000,
+        (imageReady - startupStart) * 1000, (iGetTime() - startupStart) * 1000);
+
     while (!WindowShouldClose()) {
 
         ++this.frame;
 
+        merge_scanned_files();
+
+        // images got their metadata, they may be out of order now
+        if (iGatherImageMeta(&this))
+            iSortImages(&this);
+
+        // new or moved images are indexed in the background, the results follow the index
+        iUpdateSearchIndex(&this);
+        iSearchRefresh(&this);
+
+        iUpdateDither(&this);
+
+        // decoded frames of an animated image are uploaded when they are due
+        iUpdateAnimation(&this);
+
+        // a playing sequence shows the frame which is due, or counts it late
+        iUpdateFlipbook(&this);
+
+        // compress images which were not shown for a while, once their budget runs out
+        iUpdateResidency(&this);
+
 #ifdef ENABLE_FILE_DROP
         if (IsFileDropped()) {
 
@@ -343,7 +540,10 @@ int main(int argc, char* argv[]) {
 #endif
 
 #ifdef ENABLE_KEYBOARD_INPUT
-        do_keyboard_input();
+        if (this.search.active)
+            do_search_input();
+        else
+            do_keyboard_input();
 #endif
 
 #ifdef ENABLE_MOUSE_INPUT
@@ -402,8 +602,26 @@ int main(int argc, char* argv[]) {
                     uiRenderPixelGrid(this.selected_image);
                 }
 
-                if (this.message.message != NULL &&
-                    this.message.show_for_frames > 0) {
+                float       ditherProgress = iDitherProgress(this.selected_image);
+                const char* flipbook       = iFlipbookStatus();
+
+                if (flipbook != NULL) {
+
+                    if (this.config.show_bar)
+                        uiRenderTextOnInfoBar(flipbook);
+
+                } else if (ditherProgress >= 0) {
+
+                    if (this.config.show_bar)
+                        uiRenderTextOnInfoBar(TextFormat("dithering %d%%", (int)(ditherProgress * 100)));
+
+                } else if (this.selected_image->isProxy && iAsyncHasImage(this.selected_image)) {
+
+                    if (this.config.show_bar)
+                        uiRenderTextOnInfoBar("loading full resolution");
+
+                } else if (this.message.message != NULL &&
+                           this.message.show_for_frames > 0) {
 
                     this.message.show_for_frames--;
 
@@ -434,22 +652,35 @@ int main(int argc, char* argv[]) {
     }
 
 
+    // the index points at the paths
+    iSearchDeinit();
+
+    // stop the dither before its image is unloaded
+    iDitherDeinit();
+    iAnimationDeinit();
+    iStopFlipbook(NULL);
+
+    iResidencyDeinit();
+
     DARRAY_FOR_EACH(this.image_files, i) {
 
-        ImmyImage_t im = this.image_files.buffer[i];
+        ImmyImage_t im = this.image_files.images[i];
 
-        if (im.status == IMAGE_STATUS_LOADED) {
+        if (this.image_files.states[i].status == IMAGE_STATUS_LOADED) {
             UnloadImage(im.rayim);
         }
 
-        if (im.path != NULL) {
-            free(im.path);
-        }
+        free(im.placeholder);
     }
 
-    dImmyImageArrFree(&this.image_files);
+    iCatalogFree(&this.image_files);
 
     uiDeinit();
 
+    // don't lose thumbnails which are still waiting to be written
+    iFlushThumbnailSaves();
+
+    iFreePathPool();
+
     return 0;
 }
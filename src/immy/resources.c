@@ -31,6 +31,32 @@ void free_resource_data(void* data) {
     (void)data;
 }
 
+bool get_baked_font_atlas(BakedFontAtlas_t* atlas) {
+
+#    ifdef BUNDLE_HAS_FONT_ATLAS
+
+    *atlas = (BakedFontAtlas_t){
+        .fontSize   = bundle_font_size,
+        .width      = bundle_font_atlas_width,
+        .height     = bundle_font_atlas_height,
+        .padding    = bundle_font_atlas_padding,
+        .glyphCount = bundle_font_glyph_count,
+        .glyphs     = bundle_font_glyphs,
+        .data       = bundle_font_atlas,
+        .dataSize   = bundle_font_atlas_size,
+    };
+
+    return true;
+
+#    else
+
+    (void)atlas;
+
+    return false;
+
+#    endif
+}
+
 #else
 
 #    include "raylib.h"
@@ -55,4 +81,11 @@ void free_resource_data(void* data) {
     UnloadFileData(data);
 }
 
+bool get_baked_font_atlas(BakedFontAtlas_t* atlas) {
+
+    (void)atlas;
+
+    return false;
+}
+
 #endif
@@ -2,10 +2,26 @@
 #ifndef IMMY_RESOURCES_H
 #define IMMY_RESOURCES_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "config.h"
 
+// ints per glyph of a baked atlas: codepoint, x, y, width, height, offsetX, offsetY, advanceX
+#define BAKED_GLYPH_FIELDS 8
+
+// A glyph atlas rasterized by the bundler at build time
+typedef struct {
+        int                  fontSize;
+        int                  width;
+        int                  height;
+        int                  padding;    // around each glyph
+        size_t               glyphCount;
+        const int*           glyphs;     // BAKED_GLYPH_FIELDS ints per glyph
+        const unsigned char* data;       // raw deflate of width * height coverage bytes
+        size_t               dataSize;
+} BakedFontAtlas_t;
+
 /**
  * Reads the given resource, and outputs the byte count into the given data
  * pointer
@@ -17,6 +33,12 @@ unsigned char* get_resource_data(const char* resource_path, size_t* data_size);
  */
 void free_resource_data(void* data);
 
+/**
+ * Gets the glyph atlas baked into the resource bundle,
+ * returns false if there is no bundle or it has no atlas
+ */
+bool get_baked_font_atlas(BakedFontAtlas_t* atlas);
+
 // If shaders are enabled, define them here
 #if ENABLE_SHADERS
 
@@ -33,7 +55,7 @@ void free_resource_data(void* data);
         "in vec4 fragColor;"                                                       \
         "uniform sampler2D texture0;"                                              \
         "uniform vec4 colDiffuse;"                                                 \
-        "uniform vec2 effects;"                                                    \
+        "uniform vec3 effects;"                                                    \
         "out vec4 finalColor;"                                                     \
         "void main()"                                                              \
         "{"                                                                        \
@@ -45,6 +67,12 @@ void free_resource_data(void* data);
                          STRINGIFY_MACRO(GRAYSCALE_COEF_G) ","                     \
                          STRINGIFY_MACRO(GRAYSCALE_COEF_B) "));"                   \
         "color = mix(color, vec3(gray), effects.y);"                               \
+        "vec2 bp = mod(floor(gl_FragCoord.xy), 4.0);"                              \
+        "vec2 bl = mod(bp, 2.0);"                                                  \
+        "vec2 bh = floor(bp / 2.0);"                                               \
+        "float bayer = (4.0 * mod(2.0 * bl.x + 3.0 * bl.y, 4.0) +"                 \
+        "               mod(2.0 * bh.x + 3.0 * bh.y, 4.0) + 0.5) / 16.0;"          \
+        "color = mix(color, vec3(step(bayer, gray)), effects.z);"                  \
         "finalColor = vec4(color, tColor.a);"                                      \
         "}"
 
@@ -56,7 +84,7 @@ void free_resource_data(void* data);
         "varying vec4 fragColor;"                                                  \
         "uniform sampler2D texture0;"                                              \
         "uniform vec4 colDiffuse;"                                                 \
-        "uniform vec2 effects;"                                                    \
+        "uniform vec3 effects;"                                                    \
         "void main()"                                                              \
         "{"                                                                        \
         "vec4 tColor = texture2D(texture0, fragTexCoord)*colDiffuse*fragColor;"    \
@@ -67,6 +95,12 @@ void free_resource_data(void* data);
                      STRINGIFY_MACRO(GRAYSCALE_COEF_G) ","                         \
                      STRINGIFY_MACRO(GRAYSCALE_COEF_B) " ));"                      \
         "color = mix(color, vec3(gray), float(effects.y));"                        \
+        "vec2 bp = mod(floor(gl_FragCoord.xy), 4.0);"                              \
+        "vec2 bl = mod(bp, 2.0);"                                                  \
+        "vec2 bh = floor(bp / 2.0);"                                               \
+        "float bayer = (4.0 * mod(2.0 * bl.x + 3.0 * bl.y, 4.0) +"                 \
+        "               mod(2.0 * bh.x + 3.0 * bh.y, 4.0) + 0.5) / 16.0;"          \
+        "color = mix(color, vec3(step(bayer, gray)), effects.z);"                  \
         "gl_FragColor = vec4(color, tColor.a);"                                    \
         "}"
 
@@ -79,7 +113,7 @@ void free_resource_data(void* data);
         "varying vec4 fragColor;"                                                  \
         "uniform sampler2D texture0;"                                              \
         "uniform vec4 colDiffuse;"                                                 \
-        "uniform vec2 effects;"                                                    \
+        "uniform vec3 effects;"                                                    \
         "void main()"                                                              \
         "{"                                                                        \
         "vec4 tColor = texture2D(texture0, fragTexCoord)*colDiffuse*fragColor;"    \
@@ -90,6 +124,12 @@ void free_resource_data(void* data);
                      STRINGIFY_MACRO(GRAYSCALE_COEF_G) ","                         \
                      STRINGIFY_MACRO(GRAYSCALE_COEF_B) " ));"                      \
         "color = mix(color, vec3(gray), float(effects.y));"                        \
+        "vec2 bp = mod(floor(gl_FragCoord.xy), 4.0);"                              \
+        "vec2 bl = mod(bp, 2.0);"                                                  \
+        "vec2 bh = floor(bp / 2.0);"                                               \
+        "float bayer = (4.0 * mod(2.0 * bl.x + 3.0 * bl.y, 4.0) +"                 \
+        "               mod(2.0 * bh.x + 3.0 * bh.y, 4.0) + 0.5) / 16.0;"          \
+        "color = mix(color, vec3(step(bayer, gray)), effects.z);"                  \
         "gl_FragColor = vec4(color, tColor.a);"                                    \
         "}" 
 
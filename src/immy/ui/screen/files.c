@@ -13,8 +13,64 @@
 
 
 
+void uiRenderSearchBar(const ImmyControl_t* ctrl) {
+
+    const ImmySearch_t* s = &ctrl->search;
+
+    const char* text;
+
+    if (s->length == 0)
+        text = TextFormat("/%s", s->query);
+    else if (s->matches == 0)
+        text = TextFormat("/%s  no matches", s->query);
+    else
+        text = TextFormat("/%s  %zu of %zu", s->query, s->cursor + 1, s->matches);
+
+    int y = GetScreenHeight() - g_unifontSize;
+
+    DrawRectangle(0, y, GetScreenWidth(), g_unifontSize, BAR_BACKGROUND_COLOR_RGBA);
+
+    uiDrawTextEx(text, (Vector2){FILE_LIST_LEFT_MARGIN, y}, g_unifontSize, UNIFONT_SPACING, TEXT_COLOR_RGBA);
+}
+
+// Lists the search results above the prompt, best at the bottom, scrolled to keep the cursor on screen.
+static void render_search_results(const ImmyControl_t* ctrl) {
+
+    const ImmySearch_t* s = &ctrl->search;
+
+    const int sw   = GetScreenWidth();
+    const int rows = MAX(1, GetScreenHeight() / g_unifontSize - BOTTOM_MARGIN);
+
+    size_t first = s->cursor >= (size_t)rows ? s->cursor - rows + 1 : 0;
+
+    for (size_t r = first; r < s->results.size && r < first + rows; r++) {
+
+        int index = s->results.buffer[r];
+        int y     = GetScreenHeight() - g_unifontSize * (BOTTOM_MARGIN + 1 + (r - first));
+
+        if (index < 0 || (size_t)index >= ctrl->image_files.size)
+            continue;
+
+        DrawRectangle(0, y, sw, g_unifontSize, r == s->cursor ? SELECTED_COLOR_RGBA : BAR_BACKGROUND_COLOR_RGBA);
+
+        uiDrawTextEx(
+            TextFormat("%02d  %s", index + 1, ctrl->image_files.names[index]),
+            (Vector2){FILE_LIST_LEFT_MARGIN, y}, g_unifontSize, UNIFONT_SPACING, TEXT_COLOR_RGBA
+        );
+    }
+
+    uiRenderSearchBar(ctrl);
+}
+
 void uiRenderFileList(const ImmyControl_t* ctrl) {
 
+    if (ctrl->search.active) {
+
+        render_search_results(ctrl);
+
+        return;
+    }
+
     const int sw = GetScreenWidth();
     const int sh = GetScreenHeight() - g_unifontSize;
 
@@ -41,8 +97,6 @@ void uiRenderFileList(const ImmyControl_t* ctrl) {
 
     DARRAY_FOR_I(ctrl->image_files, i, startIndex + scrollOffset * 2) {
 
-        ImmyImage_t* im = ctrl->image_files.buffer + i;
-
         int y = startY + g_unifontSize * (i - startIndex);
 
         if (ctrl->selected_image == NULL || i != ctrl->selected_index) {
@@ -51,16 +105,16 @@ void uiRenderFileList(const ImmyControl_t* ctrl) {
             DrawRectangle(0, y, sw, g_unifontSize, SELECTED_COLOR_RGBA);
         }
 
-        DrawTextEx(
-            g_unifont, TextFormat("%02d  %s", i + 1, im->name),
+        uiDrawTextEx(
+            TextFormat("%02d  %s", i + 1, ctrl->image_files.names[i]),
             (Vector2){FILE_LIST_LEFT_MARGIN, y}, g_unifontSize, UNIFONT_SPACING, TEXT_COLOR_RGBA
         );
     }
 
     DrawRectangle(0, startY + g_unifontSize * (i - startIndex), sw, g_unifontSize, BAR_BACKGROUND_COLOR_RGBA);
 
-    DrawTextEx(
-        g_unifont, TextFormat("%d more files...", ctrl->image_files.size - i),
+    uiDrawTextEx(
+        TextFormat("%d more files...", ctrl->image_files.size - i),
         (Vector2){FILE_LIST_LEFT_MARGIN, startY + g_unifontSize * (i - startIndex)}, g_unifontSize,
         UNIFONT_SPACING, TEXT_COLOR_RGBA
     );
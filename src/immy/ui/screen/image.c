@@ -8,21 +8,213 @@
 #define ImageViewWidth (GetScreenWidth() - screenPadding.width)
 #define ImageViewHeight (GetScreenHeight() - screenPadding.height)
 
+// A texture kept on the GPU for a recently shown image.
+typedef struct {
+        const char* path; // identify the image, the image itself can move
+        Texture2D   texture;
+        size_t      lastUse;
+} ImageTexture_t;
+
 // state for the image screen
-static ImmyImage_t* cImage   = 0;   // identify the current image
-static Texture2D    imageBuf = {0}; // the buffer to show
+static ImageTexture_t textures[RESIDENT_TEXTURE_SLOTS] = {0};
+static size_t         textureClock                     = 0;
+
+// a scaled up thumbnail or placeholder, shown while the image itself is not decoded
+static Texture2D   previewTexture = {0};
+static const char* previewPath    = NULL;
+static Vector2     previewSize    = {0}; // the aspect ratio, the placeholder texture is square
+
+// the rows of a big image decoded so far, drawn over the preview until the image is done
+static Texture2D   progressTexture = {0};
+static const char* progressPath    = NULL;
 
 // x, y are added to image position
 // width, height are subtraced from screen size
 static Rectangle screenPadding = {0};
 
+static size_t texture_bytes(Texture2D t) {
+
+    // the mipmaps add a third
+    return (size_t)GetPixelDataSize(t.width, t.height, t.format) * 4 / 3;
+}
+
+static void drop_texture(ImageTexture_t* t) {
+
+    UnloadTexture(t->texture);
+
+    memset(t, 0, sizeof(*t));
+}
+
+static ImageTexture_t* find_texture(const char* path) {
+
+    for (int i = 0; i < RESIDENT_TEXTURE_SLOTS; i++) {
+
+        if (textures[i].path == path) {
+
+            textures[i].lastUse = ++textureClock;
+
+            return textures + i;
+        }
+    }
+
+    return NULL;
+}
+
+// Makes room within RESIDENT_TEXTURE_BUDGET, the least recently shown textures go first.
+static ImageTexture_t* add_texture(const char* path, Texture2D texture) {
+
+    size_t total = texture_bytes(texture);
+    int    slot  = -1;
+
+    for (int i = 0; i < RESIDENT_TEXTURE_SLOTS; i++) {
+
+        if (textures[i].path == NULL)
+            slot = i;
+        else
+            total += texture_bytes(textures[i].texture);
+    }
+
+    while (slot < 0 || total > RESIDENT_TEXTURE_BUDGET) {
+
+        int oldest = -1;
+
+        for (int i = 0; i < RESIDENT_TEXTURE_SLOTS; i++) {
+
+            if (textures[i].path != NULL && (oldest < 0 || textures[i].lastUse < textures[oldest].lastUse))
+                oldest = i;
+        }
+
+        // the new texture is over the budget on its own
+        if (oldest < 0)
+            break;
+
+        total -= texture_bytes(textures[oldest].texture);
+
+        drop_texture(textures + oldest);
+
+        slot = oldest;
+    }
+
+    textures[slot] = (ImageTexture_t){path, texture, ++textureClock};
+
+    return textures + slot;
+}
+
+// Makes the preview from the cached thumbnail, or the placeholder colors if there is none.
+// Nothing here decodes the image itself.
+static bool load_preview(ImmyImage_t* im) {
+
+    if (previewPath == im->path)
+        return IsTextureReady(previewTexture);
+
+    if (IsTextureReady(previewTexture))
+        UnloadTexture(previewTexture);
+
+    previewTexture = (Texture2D){0};
+    previewPath    = im->path;
+
+    // one small read from the thumbnail cache
+    if (im->state->thumb_status == IMAGE_STATUS_NOT_LOADED)
+        im->state->thumb_status = iGetOrCreateThumb(im) ? IMAGE_STATUS_LOADED : IMAGE_STATUS_FAILED;
+
+    ThumbPlaceholder_t ph;
+
+    if (im->state->thumb_status == IMAGE_STATUS_LOADED) {
+
+        previewTexture = LoadTextureFromImage(im->thumb);
+        previewSize    = (Vector2){im->thumb.width, im->thumb.height};
+
+    } else if (iGetThumbPlaceholder(im->path, &ph)) {
+
+        Image grid = {
+            .data    = ph.grid,
+            .width   = THUMB_PLACEHOLDER_GRID,
+            .height  = THUMB_PLACEHOLDER_GRID,
+            .mipmaps = 1,
+            .format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+
+        previewTexture = LoadTextureFromImage(grid);
+        previewSize    = (Vector2){ph.width, ph.height};
+    }
+
+    if (!IsTextureReady(previewTexture) || previewSize.x <= 0 || previewSize.y <= 0)
+        return false;
+
+    // blurry when scaled up is what a preview should look like
+    SetTextureFilter(previewTexture, TEXTURE_FILTER_BILINEAR);
+
+    return true;
+}
+
+// Draws texture fit to the screen as if it were size.
+static void draw_fit(Texture2D texture, Vector2 size) {
+
+    int    sw    = ImageViewWidth - screenPadding.x;
+    int    sh    = ImageViewHeight - screenPadding.y;
+    double scale = fmin(sw / size.x, sh / size.y);
+    float  w     = size.x * scale;
+    float  h     = size.y * scale;
+
+    Rectangle src = {0, 0, texture.width, texture.height};
+    Rectangle dst = {screenPadding.x + (sw - w) / 2.0, screenPadding.y + (sh - h) / 2.0, w, h};
+
+    DrawTexturePro(texture, src, dst, (Vector2){0, 0}, 0, WHITE);
+}
+
+// Draws the preview fit to the screen, returns false if the image has none.
+static bool draw_preview(ImmyImage_t* im) {
+
+    if (!load_preview(im))
+        return false;
+
+    draw_fit(previewTexture, previewSize);
+
+    return true;
+}
+
+static void drop_progress() {
+
+    if (IsTextureReady(progressTexture))
+        UnloadTexture(progressTexture);
+
+    progressTexture = (Texture2D){0};
+    progressPath    = NULL;
+}
+
+// Draws the rows of the image decoded so far, returns false if there are none yet.
+static bool draw_progress(ImmyImage_t* im) {
+
+    if (progressPath != im->path)
+        drop_progress();
+
+    progressPath = im->path;
+
+    if (!iGetImageAsyncProgress(im, &progressTexture))
+        return false;
+
+    SetTextureFilter(progressTexture, TEXTURE_FILTER_BILINEAR);
+
+    draw_fit(progressTexture, (Vector2){progressTexture.width, progressTexture.height});
+
+    return true;
+}
+
 void uiImagePageClearState() {
 
-    UnloadTexture(imageBuf);
+    for (int i = 0; i < RESIDENT_TEXTURE_SLOTS; i++) {
+
+        if (textures[i].path != NULL)
+            drop_texture(textures + i);
+    }
+
+    if (IsTextureReady(previewTexture))
+        UnloadTexture(previewTexture);
 
-    cImage = NULL;
+    previewTexture = (Texture2D){0};
+    previewPath    = NULL;
 
-    memset(&imageBuf, 0, sizeof(imageBuf));
+    drop_progress();
 }
 
 void uiRenderPixelGrid(const ImmyImage_t* image) {
@@ -49,13 +241,29 @@ void uiRenderPixelGrid(const ImmyImage_t* image) {
 
 void uiRenderImage(ImmyControl_t* ctrl, ImmyImage_t* im) {
 
-    if (cImage != im) {
+    // zoomed in past what the proxy can show, swap in the full image
+    // the proxy is drawn scaled up until it is ready
+    if (im->isProxy && !im->promoteFailed && im->state->status == IMAGE_STATUS_LOADED &&
+        im->scale * im->srcRect.width > im->rayim.width * PROXY_PROMOTE_SCALE) {
+
+        ctrl->renderFrames = RENDER_FRAMES;
+
+        iPromoteImage(im, false);
+    }
+
+    ImageTexture_t* tex = find_texture(im->path);
+
+    if (im->state->status != IMAGE_STATUS_LOADED) {
 
         // ensure the image is not freed if
         // it was being loaded for a thumbnail already
         im->isLoadingForThumbOnly = false;
 
-        switch (im->status) {
+        // a texture left on the GPU keeps the image where it was while its pixels come back
+        Vector2 pos   = im->dstPos;
+        double  scale = im->scale;
+
+        switch (im->state->status) {
 
 #if ASYNC_IMAGE_LOADING
 
@@ -64,16 +272,25 @@ void uiRenderImage(ImmyControl_t* ctrl, ImmyImage_t* im) {
             // force rendering so the image loads
             ctrl->renderFrames = RENDER_FRAMES;
 
+            // it would be abandoned a moment later, only the image the selection stops on is decoded
+            if (iIsScrubbing()) {
+
+                if (tex == NULL)
+                    draw_preview(im);
+
+                break;
+            }
+
             if (!iLoadImageAsync(im)) {
 
                 L_W("Unable to start loading image async");
 
             } else {
 
-                im->status = IMAGE_STATUS_LOADING;
+                im->state->status = IMAGE_STATUS_LOADING;
             }
 
-            return;
+            break;
 
         case IMAGE_STATUS_LOADING:
 
@@ -82,27 +299,75 @@ void uiRenderImage(ImmyControl_t* ctrl, ImmyImage_t* im) {
 
             if (!iGetImageAsync(im)) {
 
-                uiDrawText("image is loading");
+                // the decoded rows fill in over the preview, which shows through the rest
+                if (tex != NULL)
+                    break;
 
-                return;
+                bool drawn = draw_preview(im);
+
+                if (!draw_progress(im) && !drawn)
+                    uiDrawText("image is loading");
+
+                break;
             }
 
-            if (im->status == IMAGE_STATUS_LOADED)
-                uiFitCenterImage(im);
+            drop_progress();
+
+            if (im->state->status == IMAGE_STATUS_LOADED) {
+
+                if (tex != NULL) {
+
+                    im->dstPos = pos;
+                    im->scale  = scale;
+
+                } else {
+
+                    uiFitCenterImage(im);
+                }
+            }
 
             // if the above function returns true
             // the image is done loading and has a new status
-            // if we return here the new status will be handled next frame
-            return;
+            break;
 
 #else
         case IMAGE_STATUS_NOT_LOADED:
 
-            if (!iLoadImage(im)) {
+            // decoding here blocks the frame, so nothing is decoded until the selection stops
+            if (iIsScrubbing()) {
+
+                ctrl->renderFrames = RENDER_FRAMES;
+
+                if (tex == NULL)
+                    draw_preview(im);
+
+                break;
+            }
+
+            // the compressed copy first, it keeps any edits
+            if (iUnpackImage(im->path, im)) {
+
+                im->state->status = IMAGE_STATUS_LOADED;
+
+            } else if (iLoadImage(im)) {
+
+                iMakeProxy(im);
+
+            } else {
+
                 return;
             }
 
-            uiFitCenterImage(im);
+            if (tex != NULL) {
+
+                im->dstPos = pos;
+                im->scale  = scale;
+
+            } else {
+
+                uiFitCenterImage(im);
+            }
+
             break;
 
         case IMAGE_STATUS_LOADING:
@@ -121,31 +386,42 @@ void uiRenderImage(ImmyControl_t* ctrl, ImmyImage_t* im) {
             uiDrawText("The image could not be loaded!");
             return;
         }
+    }
+
+    // swapped between the proxy and the full image, the texture is made again
+    if (tex != NULL && im->state->status == IMAGE_STATUS_LOADED &&
+        (tex->texture.width != im->rayim.width || tex->texture.height != im->rayim.height)) {
+
+        drop_texture(tex);
+
+        tex = NULL;
+    }
+
+    if (im->state->status == IMAGE_STATUS_LOADED && tex == NULL) {
 
         ctrl->renderFrames = RENDER_FRAMES;
 
-        Texture2D nimageBuf = LoadTextureFromImage(im->rayim);
+        Texture2D texture = LoadTextureFromImage(im->rayim);
 
-        if (!IsTextureReady(nimageBuf)) {
+        if (!IsTextureReady(texture)) {
             return;
         }
 
-        if (IsTextureReady(imageBuf)) {
-            UnloadTexture(imageBuf);
-        }
-
-        cImage   = im;
-        imageBuf = nimageBuf;
+        GenTextureMipmaps(&texture);
 
-        GenTextureMipmaps(&imageBuf);
+        tex = add_texture(im->path, texture);
 
-    } else if (im->rebuildBuff) {
+    } else if (im->state->status == IMAGE_STATUS_LOADED && im->rebuildBuff) {
 
         im->rebuildBuff = 0;
-        UpdateTexture(imageBuf, im->rayim.data);
-        GenTextureMipmaps(&imageBuf);
+        im->isEdited    = 1;
+        UpdateTexture(tex->texture, im->rayim.data);
+        GenTextureMipmaps(&tex->texture);
     }
 
+    // not loaded and nothing left on the GPU either, a failure is shown next frame
+    if (tex == NULL || im->state->status == IMAGE_STATUS_FAILED)
+        return;
 
 #if ENABLE_SHADERS
 
@@ -153,25 +429,35 @@ void uiRenderImage(ImmyControl_t* ctrl, ImmyImage_t* im) {
 
         im->updateShaders = false;
 
-        Vector2 effects = {im->applyInvertShader, im->applyGrayscaleShader};
+        Vector3 effects = {im->applyInvertShader, im->applyGrayscaleShader, im->applyBayerShader};
 
-        SetShaderValue(grayscaleShader, grayInvertEffectLocation, &effects, SHADER_UNIFORM_VEC2);
+        SetShaderValue(grayscaleShader, grayInvertEffectLocation, &effects, SHADER_UNIFORM_VEC3);
     }
 
-    if (im->applyGrayscaleShader || im->applyInvertShader) {
+    if (im->applyGrayscaleShader || im->applyInvertShader || im->applyBayerShader) {
 
         BeginShaderMode(grayscaleShader);
     }
 
 #endif
 
-    SetTextureFilter(imageBuf, im->interpolation);
+    // an animated image or a playing sequence shows its current frame instead
+    Texture2D shown = tex->texture;
+
+    if (!iGetFlipbookTexture(im, &shown))
+        iGetAnimationTexture(im, &shown);
+
+    SetTextureFilter(shown, im->interpolation);
 
-    DrawTextureEx(imageBuf, im->dstPos, im->rotation, im->scale, WHITE);
+    // scale is relative to the full image, the texture may be a proxy
+    Rectangle src = {0, 0, shown.width, shown.height};
+    Rectangle dst = {im->dstPos.x, im->dstPos.y, im->srcRect.width * im->scale, im->srcRect.height * im->scale};
+
+    DrawTexturePro(shown, src, dst, (Vector2){0, 0}, im->rotation, WHITE);
 
 #if ENABLE_SHADERS
 
-    if (im->applyGrayscaleShader | im->applyInvertShader) {
+    if (im->applyGrayscaleShader | im->applyInvertShader | im->applyBayerShader) {
 
         EndShaderMode();
     }
@@ -184,36 +470,27 @@ void uiRenderInfoBar(const ImmyImage_t* image) {
     const char* prefix =
         TextFormat("%0.0f x %0.0f  %0.0f%%  ", image->srcRect.width, image->srcRect.height, image->scale * 100);
 
-    const char* postfix = image->name;
-
     int sw = GetScreenWidth();
     int sh = ImageViewHeight;
 
-    int fontSize = g_unifontSize;
+    // both layouts are cached, measuring and fitting only happens when the text or width changes
+    TextLayout_t* pretext = uiLayoutText(prefix, g_unifont.baseSize, UNIFONT_SPACING, 0);
 
-    Vector2 pretextSize;
-    Vector2 textSize;
+    if (pretext == NULL)
+        return;
 
-    pretextSize = MeasureTextEx(g_unifont, prefix, fontSize, UNIFONT_SPACING);
-
-    do {
-        textSize = MeasureTextEx(g_unifont, postfix, fontSize, UNIFONT_SPACING);
-    } while (textSize.x > (sw - pretextSize.x) && --fontSize);
+    TextLayout_t* text = uiLayoutText(GetFileName(image->path), g_unifontSize, UNIFONT_SPACING, MAX(1, sw - pretext->size.x));
 
     DrawRectangle(0, sh, sw, INFO_BAR_HEIGHT, BAR_BACKGROUND_COLOR_RGBA);
 
-    DrawTextEx(
-        g_unifont, prefix, (Vector2){INFO_BAR_LEFT_MARGIN, sh}, g_unifont.baseSize, UNIFONT_SPACING, TEXT_COLOR_RGBA
-    );
-
-    DrawTextEx(
-        g_unifont,
-        postfix,
-        (Vector2){pretextSize.x, sh + (INFO_BAR_HEIGHT - fontSize) / 2.0},
-        fontSize,
-        UNIFONT_SPACING,
-        TEXT_COLOR_RGBA
-    );
+    uiDrawTextLayout(pretext, (Vector2){INFO_BAR_LEFT_MARGIN, sh}, TEXT_COLOR_RGBA);
+
+    if (text != NULL) {
+
+        uiDrawTextLayout(
+            text, (Vector2){pretext->size.x, sh + (INFO_BAR_HEIGHT - text->fontSize) / 2.0}, TEXT_COLOR_RGBA
+        );
+    }
 }
 
 void uiRenderTextOnInfoBar(const char* text) {
@@ -221,17 +498,12 @@ void uiRenderTextOnInfoBar(const char* text) {
     int sw = GetScreenWidth();
     int sh = ImageViewHeight;
 
-    int fontSize = g_unifont.baseSize;
-
-    Vector2 textSize;
-
-    do {
-        textSize = MeasureTextEx(g_unifont, text, fontSize, UNIFONT_SPACING);
-    } while (textSize.x > sw - INFO_BAR_LEFT_MARGIN && --fontSize);
+    TextLayout_t* layout =
+        uiLayoutText(text, g_unifont.baseSize, UNIFONT_SPACING, MAX(1, sw - INFO_BAR_LEFT_MARGIN));
 
     DrawRectangle(0, sh, sw, INFO_BAR_HEIGHT, BAR_BACKGROUND_COLOR_RGBA);
 
-    DrawTextEx(g_unifont, text, (Vector2){INFO_BAR_LEFT_MARGIN, sh}, fontSize, UNIFONT_SPACING, TEXT_COLOR_RGBA);
+    uiDrawTextLayout(layout, (Vector2){INFO_BAR_LEFT_MARGIN, sh}, TEXT_COLOR_RGBA);
 }
 
 void uiFitCenterImage(ImmyImage_t* image) {
@@ -47,8 +47,7 @@ void uiRenderKeybinds(const ImmyControl_t* ctrl) {
             DrawRectangle(0, y, sw, g_unifontSize, SELECTED_COLOR_RGBA);
         }
 
-        DrawTextEx(
-            g_unifont,
+        uiDrawTextEx(
             TextFormat(
                 "%s%*.*s %s%*.*s %s", SCREEN_TEXT, SCR_PAD_LEN, SCR_PAD_LEN, PADDING, KEY_TEXT, KEY_PAD_LEN,
                 KEY_PAD_LEN, PADDING, im->NAME
@@ -73,8 +72,7 @@ void uiRenderKeybinds(const ImmyControl_t* ctrl) {
             DrawRectangle(0, y, sw, g_unifontSize, SELECTED_COLOR_RGBA);
         }
 
-        DrawTextEx(
-            g_unifont,
+        uiDrawTextEx(
             TextFormat(
                 "%s%*.*s %s%*.*s %s", SCREEN_TEXT, SCR_PAD_LEN, SCR_PAD_LEN, PADDING, KEY_TEXT, KEY_PAD_LEN,
                 KEY_PAD_LEN, PADDING, im->NAME
@@ -1,6 +1,7 @@
 
 #include <raylib.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../../darray.h"
@@ -8,11 +9,13 @@
 #include "../ui.h"
 
 static dTexture2DArr_t thumbBufs;
+static size_t          thumbsGen = 0; // image_files_gen the buffers were made for
 
 #if ASYNC_IMAGE_LOADING
 
 static int           thumbsLoading = 0;                             // number of thumbs loading
 static ImmyImage_t* loadingThumbs[THUMB_ASYNC_LOAD_AMOUNT] = {0 }; // loading thumbs
+static const char*  loadingPaths[THUMB_ASYNC_LOAD_AMOUNT]  = {0};  // to find them again if they move
 
 static inline int getThumbLoadingIndex(ImmyImage_t* im) {
 
@@ -27,7 +30,7 @@ static inline int getThumbLoadingIndex(ImmyImage_t* im) {
 
 static inline void handleThumbLoad(ImmyImage_t* im) {
 
-    switch (im->status) {
+    switch (im->state->status) {
 
     // we can load the thumb
     case IMAGE_STATUS_NOT_LOADED:
@@ -52,8 +55,9 @@ static inline void handleThumbLoad(ImmyImage_t* im) {
         // remove it from our list
         thumbsLoading--;
         loadingThumbs[l] = NULL;
+        loadingPaths[l]  = NULL;
 
-        if (im->status == IMAGE_STATUS_FAILED)
+        if (im->state->status == IMAGE_STATUS_FAILED)
             return;
 
         // create a thumbnail
@@ -65,7 +69,7 @@ static inline void handleThumbLoad(ImmyImage_t* im) {
         if (im->isLoadingForThumbOnly) {
 
             im->isLoadingForThumbOnly = false;
-            im->status                = IMAGE_STATUS_NOT_LOADED;
+            im->state->status         = IMAGE_STATUS_NOT_LOADED;
 
             UnloadImage(im->rayim);
         }
@@ -86,18 +90,48 @@ static inline void handleThumbLoad(ImmyImage_t* im) {
 
         if (iLoadImageAsync(im)) {
 
-            im->status = IMAGE_STATUS_LOADING;
+            im->state->status = IMAGE_STATUS_LOADING;
             im->isLoadingForThumbOnly = true;
 
             thumbsLoading++;
 
             loadingThumbs[i] = im;
+            loadingPaths[i]  = im->path;
         }
 
         break;
     }
 }
 
+// Finds the loading images again after the image array moved.
+static void relocateLoadingThumbs(ImmyControl_t* ctrl) {
+
+    for (int i = 0; i < THUMB_ASYNC_LOAD_AMOUNT; i++) {
+
+        if (loadingPaths[i] == NULL)
+            continue;
+
+        loadingThumbs[i] = NULL;
+
+        DARRAY_FOR_EACH(ctrl->image_files, j) {
+
+            if (ctrl->image_files.paths[j] == loadingPaths[i]) {
+
+                loadingThumbs[i] = ctrl->image_files.images + j;
+
+                break;
+            }
+        }
+
+        if (loadingThumbs[i] == NULL) {
+
+            loadingPaths[i] = NULL;
+
+            thumbsLoading--;
+        }
+    }
+}
+
 static inline void checkLoadingThumbs(ImmyControl_t* ctrl) {
 
     if (thumbsLoading <= 0)
@@ -115,6 +149,114 @@ static inline void checkLoadingThumbs(ImmyControl_t* ctrl) {
 
 #endif
 
+// padding between the thumbnail and the edge of the cell
+static inline int cell_padding(int cell) {
+
+    return MAX(2, cell / 21);
+}
+
+#if SHOW_THUMB_PLACEHOLDERS
+
+// Gets the average color of the blocks touching the corner (cx, cy).
+static Color placeholder_corner(const ThumbPlaceholder_t* ph, int cx, int cy) {
+
+    const int G = THUMB_PLACEHOLDER_GRID;
+
+    int r = 0, g = 0, b = 0, n = 0;
+
+    for (int y = cy - 1; y <= cy; y++) {
+
+        for (int x = cx - 1; x <= cx; x++) {
+
+            if (x < 0 || y < 0 || x >= G || y >= G)
+                continue;
+
+            Color c = ph->grid[y * G + x];
+
+            r += c.r;
+            g += c.g;
+            b += c.b;
+            n++;
+        }
+    }
+
+    return (Color){r / n, g / n, b / n, 255};
+}
+
+// Draws the placeholder of the image in the cell.
+// The grid colors are blended across each block so it looks like a blurry thumbnail.
+// Asking for a placeholder counts against requests, the lookup itself happens on the index thread.
+static void draw_placeholder(ImmyControl_t* ctrl, ImmyImage_t* im, int cellX, int cellY, int cell, int* requests) {
+
+    if (im->state->placeholder_status != IMAGE_STATUS_LOADED) {
+
+        ThumbPlaceholder_t found;
+        ImageLoadStatus_t  status = iPollThumbPlaceholder(im->path, &found);
+
+        if (status == IMAGE_STATUS_NOT_LOADED && *requests < THUMB_PLACEHOLDER_REQUESTS_PER_FRAME) {
+
+            (*requests)++;
+
+            iRequestThumbPlaceholder(im->path);
+
+            status = IMAGE_STATUS_LOADING;
+        }
+
+        // only images which reach the grid pay for a placeholder
+        if (status == IMAGE_STATUS_LOADED && (im->placeholder = malloc(sizeof(found))) != NULL)
+            *im->placeholder = found;
+
+        else if (status == IMAGE_STATUS_LOADED)
+            status = IMAGE_STATUS_FAILED;
+
+        // keep drawing until the answer comes back
+        if (status == IMAGE_STATUS_NOT_LOADED || status == IMAGE_STATUS_LOADING)
+            ctrl->renderFrames = RENDER_FRAMES;
+
+        im->state->placeholder_status = status;
+    }
+
+    if (im->state->placeholder_status != IMAGE_STATUS_LOADED)
+        return;
+
+    const ThumbPlaceholder_t* ph = im->placeholder;
+
+    const int   G     = THUMB_PLACEHOLDER_GRID;
+    const int   pad   = cell_padding(cell);
+    const float scale = (float)cell / THUMB_LEVEL_SMALLEST;
+
+    float w = ph->width * scale;
+    float h = ph->height * scale;
+    float x = cellX + (cell - w) / 2.0f + pad;
+    float y = cellY + (cell - h) / 2.0f + pad;
+
+    w -= pad * 2;
+    h -= pad * 2;
+
+    if (w <= 0 || h <= 0)
+        return;
+
+    for (int by = 0; by < G; by++) {
+
+        for (int bx = 0; bx < G; bx++) {
+
+            DrawRectangleGradientEx(
+                (Rectangle){x + bx * w / G, y + by * h / G, w / G, h / G},
+                placeholder_corner(ph, bx, by),
+                placeholder_corner(ph, bx, by + 1),
+                placeholder_corner(ph, bx + 1, by + 1),
+                placeholder_corner(ph, bx + 1, by)
+            );
+        }
+    }
+}
+
+#else
+
+#    define draw_placeholder(ctrl, im, cellX, cellY, cell, requests)
+
+#endif
+
 void uiThumbPageClearState() {
 
     DARRAY_FOR_EACH(thumbBufs, i) {
@@ -130,17 +272,33 @@ void uiRenderThumbs(ImmyControl_t* ctrl) {
     const int sw = GetScreenWidth();
     const int sh = GetScreenHeight();
 
+    // images moved, the buffers are indexed by position
+    if (ctrl->image_files_gen != thumbsGen) {
+
+#if ASYNC_IMAGE_LOADING
+        relocateLoadingThumbs(ctrl);
+#endif
+
+        uiThumbPageClearState();
+
+        thumbsGen = ctrl->image_files_gen;
+    }
+
     // ensure we can always get a thumb buffer
     if (ctrl->image_files.length > thumbBufs.length) {
 
         dTexture2DArrGrowSize(&thumbBufs, ctrl->image_files.length);
     }
 
-    bool syncLoadedThumb = false;
+    bool syncLoadedThumb     = false;
+    int  cacheReads          = 0;
+    int  placeholderRequests = 0;
+
+    const int cell = ctrl->thumbCellSize;
 
-    int cols   = sw / THUMB_SIZE;
-    int rows   = sh / THUMB_SIZE + 1;
-    int offset = (sw % THUMB_SIZE) / 2;
+    int cols   = MAX(1, sw / cell);
+    int rows   = sh / cell + 1;
+    int offset = (sw % cell) / 2;
 
     int col = 0;
     int row = 0;
@@ -171,22 +329,30 @@ void uiRenderThumbs(ImmyControl_t* ctrl) {
         if(row >= rows)
             continue;
 
-        ImmyImage_t* dim = ctrl->image_files.buffer + i;
+        ImmyImage_t* dim = ctrl->image_files.images + i;
+
+        // top left of the cell
+        int cellX = col * cell + offset;
+        int cellY = row * cell;
 
 #if ASYNC_IMAGE_LOADING
-        if (dim->status == IMAGE_STATUS_LOADING) {
+        if (dim->state->status == IMAGE_STATUS_LOADING) {
+
+            if (!iGetImageAsync(dim)) {
+
+                draw_placeholder(ctrl, dim, cellX, cellY, cell, &placeholderRequests);
 
-            if (!iGetImageAsync(dim))
                 continue;
+            }
 
-            if (dim->status == IMAGE_STATUS_LOADED)
+            if (dim->state->status == IMAGE_STATUS_LOADED)
                 uiFitCenterImage(dim);
 
             handleThumbLoad(dim);
         }
 #endif
 
-        if (dim->thumb_status == IMAGE_STATUS_FAILED) {
+        if (dim->state->thumb_status == IMAGE_STATUS_FAILED) {
 
 #if ASYNC_IMAGE_LOADING
 
@@ -194,29 +360,46 @@ void uiRenderThumbs(ImmyControl_t* ctrl) {
 #else
             if (!syncLoadedThumb &&
                 ctrl->frame % (int)SYNC_IMAGE_LOADING_THUMB_INTERVAL == 0 &&
-                dim->status == IMAGE_STATUS_NOT_LOADED && iLoadImage(dim)) {
+                dim->state->status == IMAGE_STATUS_NOT_LOADED && iLoadImage(dim)) {
 
                 syncLoadedThumb = true;
                 iGetOrCreateThumbEx(dim, true);
 
-                dim->status = IMAGE_STATUS_NOT_LOADED;
+                dim->state->status = IMAGE_STATUS_NOT_LOADED;
                 UnloadImage(dim->rayim);
             }
 #endif
 
+            draw_placeholder(ctrl, dim, cellX, cellY, cell, &placeholderRequests);
+
             continue;
         }
 
-        if (dim->thumb_status != IMAGE_STATUS_LOADED) {
+        if (dim->state->thumb_status != IMAGE_STATUS_LOADED) {
+
+            // reading the cache blocks the frame,
+            // so the rest wait for the next frame behind their placeholder
+            if (cacheReads >= THUMB_CACHE_READS_PER_FRAME) {
+
+                draw_placeholder(ctrl, dim, cellX, cellY, cell, &placeholderRequests);
+
+                ctrl->renderFrames = RENDER_FRAMES;
+
+                continue;
+            }
+
+            cacheReads++;
 
             if (!iGetOrCreateThumb(dim)) {
 
-                dim->thumb_status = IMAGE_STATUS_FAILED;
+                dim->state->thumb_status = IMAGE_STATUS_FAILED;
+
+                draw_placeholder(ctrl, dim, cellX, cellY, cell, &placeholderRequests);
 
                 continue;
             }
 
-            dim->thumb_status = IMAGE_STATUS_LOADED;
+            dim->state->thumb_status = IMAGE_STATUS_LOADED;
         }
 
         Texture2D tex = thumbBufs.buffer[i];
@@ -226,44 +409,50 @@ void uiRenderThumbs(ImmyControl_t* ctrl) {
             tex = LoadTextureFromImage(dim->thumb);
 
             if (!IsTextureReady(tex)) {
+
+                draw_placeholder(ctrl, dim, cellX, cellY, cell, &placeholderRequests);
+
                 continue;
             }
 
+            // the level is usually bigger than the cell
+            SetTextureFilter(tex, TEXTURE_FILTER_BILINEAR);
+
             thumbBufs.buffer[i] = tex;
         }
 
-        int x = col * THUMB_SIZE;
-        int y = row * THUMB_SIZE;
+        // the thumbnail was made for a level, scale it to the cell
+        float scale = (float)cell / iGetImageThumbLevel(dim);
 
-        x -= (x % THUMB_SIZE);
-        x += offset;
+        int w = dim->thumb.width * scale;
+        int h = dim->thumb.height * scale;
 
-        x += (THUMB_SIZE - dim->thumb.width) / 2.0f;
-        y += (THUMB_SIZE - dim->thumb.height) / 2.0f; 
+        int x = cellX + (cell - w) / 2.0f;
+        int y = cellY + (cell - h) / 2.0f;
 
-        int pad = 12;
-        int m = 4;
+        int pad = cell_padding(cell);
+        int m   = MAX(1, pad / 3);
 
         if(i == ctrl->selected_index) {
-            DrawRectangle( x, y, dim->thumb.width, dim->thumb.height, THUMB_BACKGROUND_COLOR);
+            DrawRectangle( x, y, w, h, THUMB_BACKGROUND_COLOR);
             DrawRectangleLinesEx(
                 (Rectangle){
                     x + pad - m, 
                     y + pad - m, 
-                    dim->thumb.width  - pad*2 + m*2,
-                    dim->thumb.height - pad*2 + m*2
+                    w - pad*2 + m*2,
+                    h - pad*2 + m*2
                 },
                 m, THUMB_SELECTED_COLOR
             );
         }
         else {
-            DrawRectangle(x, y, dim->thumb.width, dim->thumb.height, THUMB_BACKGROUND_COLOR);
+            DrawRectangle(x, y, w, h, THUMB_BACKGROUND_COLOR);
             DrawRectangleLinesEx(
                 (Rectangle){
                     x + pad - m, 
                     y + pad - m, 
-                    dim->thumb.width  - pad*2 + m*2,
-                    dim->thumb.height - pad*2 + m*2
+                    w - pad*2 + m*2,
+                    h - pad*2 + m*2
                 },
                 m, uiColorInvert(THUMB_BACKGROUND_COLOR)
             );
@@ -281,10 +470,14 @@ void uiRenderThumbs(ImmyControl_t* ctrl) {
             (Rectangle){
                 pad + x,
                 pad + y,
-                dim->thumb.width - pad*2, 
-                dim->thumb.height - pad*2,
+                w - pad*2,
+                h - pad*2,
             },
             (Vector2){0, 0}, 0, WHITE
         );
     }
+
+    // the grid follows the selected result
+    if (ctrl->search.active)
+        uiRenderSearchBar(ctrl);
 }
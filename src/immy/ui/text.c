@@ -0,0 +1,766 @@
+
+#include <math.h>
+#include <raylib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../darray.h"
+#include "../core/core.h"
+#include "../external/hashmap.h"
+#include "../external/miniz.h"
+#include "../resources.h"
+#include "ui.h"
+
+// Glyphs are rasterized the first time they are drawn and packed into rows of the atlas.
+// The atlas keeps its width and doubles in height, so glyphs never move when it grows.
+#define ATLAS_WIDTH 1024
+#define ATLAS_START_HEIGHT 128
+#define ATLAS_MAX_HEIGHT 8192
+
+// Space around each glyph, so filtering does not pick up its neighbours.
+#define GLYPH_PADDING 2
+
+// Codepoints are looked up in pages of 256, a page only exists once one of its glyphs is used.
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define MAX_CODEPOINT 0x10FFFF
+
+#define GLYPH_NONE -1    // not rasterized yet
+#define GLYPH_PENDING -2 // being rasterized by ensure_glyphs
+#define GLYPH_FAILED -3  // drawn as the fallback until the atlas starts over
+
+// Drawn in place of glyphs which could not be rasterized, it is put back every time the atlas starts over.
+#define GLYPH_FALLBACK "?"
+
+// Layouts kept before the least recently used half is dropped.
+#define LAYOUT_CACHE_MAX 1024
+
+static int32_t* glyphPages[(MAX_CODEPOINT >> PAGE_SHIFT) + 1] = {0};
+
+static unsigned char* fontData     = NULL;
+static size_t         fontDataSize = 0;
+static int            glyphCap     = 0;
+
+static Image atlas      = {0}; // copy of the texture, used when the texture is remade
+static int   shelfX     = 0;   // where the next glyph goes in the current row
+static int   shelfY     = 0;
+static int   shelfH     = 0;
+static int   dirtyStart = 0; // rows changed since the last upload
+static int   dirtyEnd   = 0;
+static bool  remakeTex  = false;
+
+// codepoints missing from the last text, reused between calls
+static dIntArr_t missing = {0};
+
+// Bumped when the atlas starts over, layouts made before that point at the wrong glyphs.
+static uint64_t atlasGen = 0;
+
+static struct hashmap* layouts     = NULL; // TextLayout_t*, keyed on text, size, spacing and width
+static uint64_t        layoutClock = 0;    // counts lookups, for dropping old layouts
+
+static inline int glyph_index(int codepoint) {
+
+    if (codepoint < 0 || codepoint > MAX_CODEPOINT)
+        return GLYPH_NONE;
+
+    const int32_t* page = glyphPages[codepoint >> PAGE_SHIFT];
+
+    return page != NULL ? page[codepoint & (PAGE_SIZE - 1)] : GLYPH_NONE;
+}
+
+static bool set_glyph_index(int codepoint, int index) {
+
+    int32_t** page = glyphPages + (codepoint >> PAGE_SHIFT);
+
+    if (*page == NULL) {
+
+        if ((*page = malloc(PAGE_SIZE * sizeof(int32_t))) == NULL)
+            return false;
+
+        for (int i = 0; i < PAGE_SIZE; i++)
+            (*page)[i] = GLYPH_NONE;
+    }
+
+    (*page)[codepoint & (PAGE_SIZE - 1)] = index;
+
+    return true;
+}
+
+// Makes room in the font for count more glyphs.
+static bool reserve_glyphs(int count) {
+
+    if (g_unifont.glyphCount + count <= glyphCap)
+        return true;
+
+    int cap = MAX(256, glyphCap * 2);
+
+    while (cap < g_unifont.glyphCount + count)
+        cap *= 2;
+
+    GlyphInfo* glyphs = realloc(g_unifont.glyphs, cap * sizeof(GlyphInfo));
+
+    if (glyphs != NULL)
+        g_unifont.glyphs = glyphs;
+
+    Rectangle* recs = realloc(g_unifont.recs, cap * sizeof(Rectangle));
+
+    if (recs != NULL)
+        g_unifont.recs = recs;
+
+    if (glyphs == NULL || recs == NULL)
+        return false;
+
+    glyphCap = cap;
+
+    return true;
+}
+
+// Fills rows [from, to) with transparent white, the same as raylib's atlases.
+static void clear_atlas_rows(int from, int to) {
+
+    unsigned char* p = (unsigned char*)atlas.data + (size_t)from * ATLAS_WIDTH * 2;
+
+    for (size_t i = 0; i < (size_t)(to - from) * ATLAS_WIDTH; i++) {
+        p[i * 2]     = 255;
+        p[i * 2 + 1] = 0;
+    }
+}
+
+static bool grow_atlas() {
+
+    if (atlas.height >= ATLAS_MAX_HEIGHT)
+        return false;
+
+    int   height = atlas.height * 2;
+    void* data   = realloc(atlas.data, (size_t)ATLAS_WIDTH * height * 2);
+
+    if (data == NULL)
+        return false;
+
+    int old = atlas.height;
+
+    atlas.data   = data;
+    atlas.height = height;
+
+    clear_atlas_rows(old, height);
+
+    L_D("%s: Glyph atlas is now %dx%d", __func__, ATLAS_WIDTH, height);
+
+    // the texture has the old size, it is made again before the next draw
+    remakeTex = true;
+
+    return true;
+}
+
+// Finds room for a w x h glyph, returns false if the atlas is full.
+static bool pack_glyph(int w, int h, int* x, int* y) {
+
+    w += GLYPH_PADDING * 2;
+    h += GLYPH_PADDING * 2;
+
+    if (w > ATLAS_WIDTH)
+        return false;
+
+    // next row
+    if (shelfX + w > ATLAS_WIDTH) {
+
+        shelfY += shelfH;
+        shelfX  = 0;
+        shelfH  = 0;
+    }
+
+    while (shelfY + h > atlas.height) {
+
+        if (!grow_atlas())
+            return false;
+    }
+
+    *x = shelfX + GLYPH_PADDING;
+    *y = shelfY + GLYPH_PADDING;
+
+    shelfX += w;
+    shelfH  = MAX(shelfH, h);
+
+    return true;
+}
+
+// Fills the empty atlas with the glyphs the bundler rasterized, so the common
+// text needs no rasterizing. Returns false if there are none or they do not fit this atlas.
+static bool load_baked_glyphs() {
+
+    BakedFontAtlas_t baked;
+
+    if (!get_baked_font_atlas(&baked))
+        return false;
+
+    if (baked.fontSize != g_unifont.baseSize || baked.width != ATLAS_WIDTH || baked.padding != GLYPH_PADDING ||
+        baked.height > ATLAS_MAX_HEIGHT) {
+
+        L_W("%s: The baked glyph atlas does not match this font, ignoring it", __func__);
+
+        return false;
+    }
+
+    while (atlas.height < baked.height) {
+
+        if (!grow_atlas())
+            return false;
+    }
+
+    if (!reserve_glyphs(baked.glyphCount))
+        return false;
+
+    size_t         size     = (size_t)baked.width * baked.height;
+    unsigned char* coverage = malloc(size);
+
+    if (coverage == NULL)
+        return false;
+
+    if (tinfl_decompress_mem_to_mem(coverage, size, baked.data, baked.dataSize, 0) != size) {
+
+        L_W("%s: Cannot inflate the baked glyph atlas", __func__);
+
+        free(coverage);
+
+        return false;
+    }
+
+    unsigned char* dst = atlas.data;
+
+    for (size_t i = 0; i < size; i++)
+        dst[i * 2 + 1] = coverage[i];
+
+    free(coverage);
+
+    for (size_t i = 0; i < baked.glyphCount; i++) {
+
+        const int* b     = baked.glyphs + i * BAKED_GLYPH_FIELDS;
+        int        index = g_unifont.glyphCount++;
+
+        g_unifont.glyphs[index] = (GlyphInfo){.value = b[0], .offsetX = b[5], .offsetY = b[6], .advanceX = b[7]};
+        g_unifont.recs[index]   = (Rectangle){b[1], b[2], b[3], b[4]};
+
+        set_glyph_index(b[0], index);
+    }
+
+    // new glyphs go below the baked ones
+    shelfX = 0;
+    shelfY = baked.height;
+    shelfH = 0;
+
+    remakeTex = true;
+
+    L_D("%s: Loaded %zu baked glyphs", __func__, baked.glyphCount);
+
+    return true;
+}
+
+// Forgets every glyph, they are rasterized again as they are drawn.
+static void reset_atlas() {
+
+    L_I("Glyph atlas is full, starting over");
+
+    for (size_t i = 0; i < sizeof(glyphPages) / sizeof(glyphPages[0]); i++) {
+
+        free(glyphPages[i]);
+
+        glyphPages[i] = NULL;
+    }
+
+    g_unifont.glyphCount = 0;
+
+    atlasGen++;
+
+    shelfX = shelfY = shelfH = 0;
+
+    clear_atlas_rows(0, atlas.height);
+
+    remakeTex = true;
+
+    load_baked_glyphs();
+}
+
+// Copies the glyph into the atlas and adds it to the font.
+static bool add_glyph(GlyphInfo glyph) {
+
+    if (!reserve_glyphs(1))
+        return false;
+
+    int x, y;
+    int w = glyph.image.width;
+    int h = glyph.image.height;
+
+    if (!pack_glyph(w, h, &x, &y))
+        return false;
+
+    const unsigned char* src = glyph.image.data;
+    unsigned char*       dst = atlas.data;
+
+    for (int gy = 0; gy < h; gy++) {
+
+        for (int gx = 0; gx < w; gx++)
+            dst[((size_t)(y + gy) * ATLAS_WIDTH + x + gx) * 2 + 1] = src[gy * w + gx];
+    }
+
+    if (dirtyStart == dirtyEnd) {
+        dirtyStart = y;
+        dirtyEnd   = y + h;
+    } else {
+        dirtyStart = MIN(dirtyStart, y);
+        dirtyEnd   = MAX(dirtyEnd, y + h);
+    }
+
+    // the pixels live in the atlas, the font only needs the metrics
+    UnloadImage(glyph.image);
+
+    glyph.image = (Image){0};
+
+    int index = g_unifont.glyphCount++;
+
+    g_unifont.glyphs[index] = glyph;
+    g_unifont.recs[index]   = (Rectangle){x, y, w, h};
+
+    return set_glyph_index(glyph.value, index);
+}
+
+// Sends the changed rows to the gpu.
+static void upload_atlas() {
+
+    if (remakeTex) {
+
+        UnloadTexture(g_unifont.texture);
+
+        g_unifont.texture = LoadTextureFromImage(atlas);
+
+        remakeTex  = false;
+        dirtyStart = dirtyEnd = 0;
+
+        return;
+    }
+
+    if (dirtyStart == dirtyEnd)
+        return;
+
+    UpdateTextureRec(
+        g_unifont.texture,
+        (Rectangle){0, dirtyStart, ATLAS_WIDTH, dirtyEnd - dirtyStart},
+        (unsigned char*)atlas.data + (size_t)dirtyStart * ATLAS_WIDTH * 2
+    );
+
+    dirtyStart = dirtyEnd = 0;
+}
+
+// Rasterizes every codepoint of the text which is not in the atlas yet.
+static void ensure_glyphs(const char* text) {
+
+    missing.size = 0;
+
+    for (const char* p = text; *p;) {
+
+        int size;
+        int cp = GetCodepointNext(p, &size);
+
+        p += size;
+
+        if (glyph_index(cp) == GLYPH_NONE && cp <= MAX_CODEPOINT && set_glyph_index(cp, GLYPH_PENDING))
+            dIntArrAppend(&missing, cp);
+    }
+
+    if (missing.size == 0)
+        return;
+
+    // one call for the whole text, the font is parsed once
+    GlyphInfo* glyphs =
+        LoadFontData(fontData, fontDataSize, g_unifont.baseSize, missing.buffer, missing.size, FONT_DEFAULT);
+
+    bool full = false;
+
+    DARRAY_FOR_EACH(missing, i) {
+
+        if (glyphs == NULL) {
+
+            set_glyph_index(missing.buffer[i], GLYPH_FAILED);
+
+            continue;
+        }
+
+        if (full || !add_glyph(glyphs[i])) {
+
+            full = true;
+
+            set_glyph_index(missing.buffer[i], GLYPH_FAILED);
+
+            UnloadImage(glyphs[i].image);
+        }
+    }
+
+    // only the array, the images were moved into the atlas
+    // raylib allocated it, so it may be from the pixel pool
+    RL_FREE(glyphs);
+
+    // starting over only helps if this text was not the reason it filled up
+    if (full && g_unifont.glyphCount > (int)missing.size) {
+
+        reset_atlas();
+
+        // before the text, so it fits even if the text fills the atlas again
+        ensure_glyphs(GLYPH_FALLBACK);
+        ensure_glyphs(text);
+    }
+}
+
+// Gets the glyph for the codepoint, or the fallback if it could not be rasterized.
+static inline int glyph_or_fallback(int codepoint) {
+
+    int index = glyph_index(codepoint);
+
+    return index >= 0 ? index : MAX(0, glyph_index(*GLYPH_FALLBACK));
+}
+
+bool uiTextInit() {
+
+    fontData = get_resource_data(UNIFONT_PATH, &fontDataSize);
+
+    if (fontData == NULL) {
+
+        L_E("Cannot load g_uifont %s!", UNIFONT_PATH);
+
+        return false;
+    }
+
+    atlas = (Image){
+        .data    = malloc((size_t)ATLAS_WIDTH * ATLAS_START_HEIGHT * 2),
+        .width   = ATLAS_WIDTH,
+        .height  = ATLAS_START_HEIGHT,
+        .mipmaps = 1,
+        .format  = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA,
+    };
+
+    DIE_IF_NULL(atlas.data, "%s: Cannot allocate the glyph atlas", __func__);
+
+    clear_atlas_rows(0, atlas.height);
+
+    dIntArrInit(&missing, 128);
+
+    g_unifont = (Font){
+        .baseSize     = g_unifontSize,
+        .glyphPadding = GLYPH_PADDING,
+    };
+
+    // a release build has the common glyphs already, they go up with the first upload
+    load_baked_glyphs();
+
+    g_unifont.texture = LoadTextureFromImage(atlas);
+    remakeTex         = false;
+
+    // the fallback has to exist before anything is drawn, this does nothing if it was baked
+    ensure_glyphs(GLYPH_FALLBACK);
+    ensure_glyphs(CODEPOINT_INITIAL);
+    upload_atlas();
+
+    return true;
+}
+
+void uiTextDeinit() {
+
+    if (layouts != NULL) {
+
+        hashmap_free(layouts);
+
+        layouts = NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(glyphPages) / sizeof(glyphPages[0]); i++) {
+
+        free(glyphPages[i]);
+
+        glyphPages[i] = NULL;
+    }
+
+    UnloadTexture(g_unifont.texture);
+    UnloadImage(atlas);
+
+    free(g_unifont.glyphs);
+    free(g_unifont.recs);
+
+    g_unifont = (Font){0};
+    atlas     = (Image){0};
+    glyphCap  = 0;
+
+    dIntArrFree(&missing);
+
+    free_resource_data(fontData);
+
+    fontData = NULL;
+}
+
+static inline float glyph_advance(int index, float scale) {
+
+    const GlyphInfo* g = g_unifont.glyphs + index;
+
+    return (g->advanceX != 0 ? g->advanceX : g_unifont.recs[index].width + g->offsetX) * scale;
+}
+
+// The largest font size, up to the requested one, at which every line fits in maxWidth.
+// Widths grow linearly with the font size, so it is solved from the base size widths.
+static float fit_font_size(const TextLayout_t* layout) {
+
+    const char* text  = layout->text;
+    float       fit   = layout->requestedSize;
+    float       line  = 0;
+    int         count = 0;
+
+    for (const char* p = text;;) {
+
+        int n  = 0;
+        int cp = *p ? GetCodepointNext(p, &n) : '\n';
+
+        if (cp == '\n') {
+
+            float room = layout->maxWidth - layout->spacing * (count - 1);
+
+            if (count > 0 && line * fit / g_unifont.baseSize > room)
+                fit = room > 0 ? floorf(room * g_unifont.baseSize / line) : 0;
+
+            line  = 0;
+            count = 0;
+
+            if (*p == 0)
+                break;
+
+            p += n;
+
+            continue;
+        }
+
+        p += n;
+
+        line += glyph_advance(glyph_or_fallback(cp), 1);
+        count++;
+    }
+
+    return MAX(0, fit);
+}
+
+// Places every glyph of the text, relative to the top left of the text.
+static void build_layout(TextLayout_t* layout) {
+
+    ensure_glyphs(layout->text);
+
+    layout->fontSize = layout->maxWidth > 0 ? fit_font_size(layout) : layout->requestedSize;
+
+    const float fontSize = layout->fontSize;
+    const float spacing  = layout->spacing;
+    const float scale    = fontSize / g_unifont.baseSize;
+    const float pad      = g_unifont.glyphPadding;
+
+    float x     = 0;
+    float y     = 0;
+    int   count = 0;
+
+    layout->size      = (Vector2){0, fontSize};
+    layout->quadCount = 0;
+
+    for (const char* p = layout->text; *p;) {
+
+        int n;
+        int cp = GetCodepointNext(p, &n);
+
+        p += n;
+
+        if (cp == '\n') {
+
+            layout->size.x  = MAX(layout->size.x, x - spacing);
+            layout->size.y += fontSize;
+
+            x     = 0;
+            y    += fontSize;
+            count = 0;
+
+            continue;
+        }
+
+        int index = glyph_or_fallback(cp);
+
+        // same as raylib's DrawTextCodepoint, without looking the glyph up again
+        if (cp != ' ' && cp != '\t') {
+
+            const GlyphInfo* g   = g_unifont.glyphs + index;
+            Rectangle        rec = g_unifont.recs[index];
+
+            layout->quads[layout->quadCount++] = (TextQuad_t){
+                .src = {rec.x - pad, rec.y - pad, rec.width + pad * 2, rec.height + pad * 2},
+                .dst = {
+                    x + (g->offsetX - pad) * scale,
+                    y + (g->offsetY - pad) * scale,
+                    (rec.width + pad * 2) * scale,
+                    (rec.height + pad * 2) * scale,
+                },
+            };
+        }
+
+        x += glyph_advance(index, scale) + spacing;
+        count++;
+    }
+
+    if (count > 0)
+        layout->size.x = MAX(layout->size.x, x - spacing);
+
+    layout->atlasGen = atlasGen;
+}
+
+static void free_layout(TextLayout_t* layout) {
+
+    free(layout->text);
+    free(layout->quads);
+    free(layout);
+}
+
+static uint64_t layout_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+
+    const TextLayout_t* l = *(TextLayout_t* const*)item;
+
+    float key[3] = {l->requestedSize, l->spacing, l->maxWidth};
+
+    return hashmap_sip(l->text, strlen(l->text), seed0, seed1) ^ hashmap_sip(key, sizeof(key), seed0, seed1);
+}
+
+static int layout_cmp(const void* a, const void* b, void* udata) {
+
+    const TextLayout_t* la = *(TextLayout_t* const*)a;
+    const TextLayout_t* lb = *(TextLayout_t* const*)b;
+
+    if (la->requestedSize != lb->requestedSize || la->spacing != lb->spacing || la->maxWidth != lb->maxWidth)
+        return 1;
+
+    return strcmp(la->text, lb->text);
+}
+
+static void layout_free(void* item) {
+    free_layout(*(TextLayout_t**)item);
+}
+
+// Drops the layouts which were not asked for in the last half of the cache's worth of lookups.
+// Recent layouts stay, so a pointer returned a few lookups ago is still valid.
+static void evict_layouts() {
+
+    size_t        iter = 0;
+    void*         item;
+    TextLayout_t* old[LAYOUT_CACHE_MAX];
+    size_t        count = 0;
+
+    while (count < LAYOUT_CACHE_MAX && hashmap_iter(layouts, &iter, &item)) {
+
+        TextLayout_t* l = *(TextLayout_t**)item;
+
+        if (l->lastUse + LAYOUT_CACHE_MAX / 2 < layoutClock)
+            old[count++] = l;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        hashmap_delete(layouts, &old[i]);
+
+    for (size_t i = 0; i < count; i++)
+        free_layout(old[i]);
+
+    L_D("%s: Dropped %zu text layouts", __func__, count);
+}
+
+TextLayout_t* uiLayoutText(const char* text, float fontSize, float spacing, float maxWidth) {
+
+    if (text == NULL || g_unifont.glyphCount == 0)
+        return NULL;
+
+    if (layouts == NULL) {
+
+        layouts = hashmap_new(sizeof(TextLayout_t*), 0, 0, 0, layout_hash, layout_cmp, layout_free, NULL);
+
+        DIE_IF_NULL(layouts, "Cannot alloc a new hashmap");
+    }
+
+    layoutClock++;
+
+    TextLayout_t  key = {.text = (char*)text, .requestedSize = fontSize, .spacing = spacing, .maxWidth = maxWidth};
+    TextLayout_t* kp  = &key;
+
+    TextLayout_t* const* found = hashmap_get(layouts, &kp);
+
+    if (found != NULL) {
+
+        TextLayout_t* layout = *found;
+
+        if (layout->atlasGen != atlasGen)
+            build_layout(layout);
+
+        layout->lastUse = layoutClock;
+
+        return layout;
+    }
+
+    if (hashmap_count(layouts) >= LAYOUT_CACHE_MAX)
+        evict_layouts();
+
+    TextLayout_t* layout = malloc(sizeof(TextLayout_t));
+
+    if (layout == NULL)
+        return NULL;
+
+    *layout = key;
+
+    // a quad per byte is enough for any utf-8 text
+    layout->text    = strdup(text);
+    layout->quads   = malloc(MAX(1, strlen(text)) * sizeof(TextQuad_t));
+    layout->lastUse = layoutClock;
+
+    if (layout->text == NULL || layout->quads == NULL) {
+
+        free_layout(layout);
+
+        return NULL;
+    }
+
+    build_layout(layout);
+
+    if (hashmap_set(layouts, &layout) == NULL && hashmap_oom(layouts)) {
+
+        free_layout(layout);
+
+        return NULL;
+    }
+
+    return layout;
+}
+
+void uiDrawTextLayout(TextLayout_t* layout, Vector2 position, Color tint) {
+
+    if (layout == NULL)
+        return;
+
+    // the atlas started over since the layout was made
+    if (layout->atlasGen != atlasGen)
+        build_layout(layout);
+
+    upload_atlas();
+
+    for (int i = 0; i < layout->quadCount; i++) {
+
+        Rectangle dst = layout->quads[i].dst;
+
+        dst.x += position.x;
+        dst.y += position.y;
+
+        DrawTexturePro(g_unifont.texture, layout->quads[i].src, dst, (Vector2){0, 0}, 0, tint);
+    }
+}
+
+Vector2 uiMeasureTextEx(const char* text, float fontSize, float spacing) {
+
+    const TextLayout_t* layout = uiLayoutText(text, fontSize, spacing, 0);
+
+    return layout != NULL ? layout->size : (Vector2){0};
+}
+
+void uiDrawTextEx(const char* text, Vector2 position, float fontSize, float spacing, Color tint) {
+    uiDrawTextLayout(uiLayoutText(text, fontSize, spacing, 0), position, tint);
+}
@@ -9,10 +9,9 @@
 #include "../resources.h"
 #include "ui.h"
 
-bool       g_uiReady         = false; // is the ui ready for drawing
-Font       g_unifont         = {0};   // global font for ui text
-int        g_unifontSize     = 32;    // font size
-dIntArr_t  g_fontCodepoints  = {0};   // codepoints for ui font
+bool       g_uiReady         = false;        // is the ui ready for drawing
+Font       g_unifont         = {0};          // global font for ui text
+int        g_unifontSize     = UNIFONT_SIZE; // font size
 
 Color     g_pixelGridColor = PIXEL_GRID_COLOR_RGBA; // the pixel grid color
 Texture2D g_backgroundBuf  = {0};                   // the background texture
@@ -56,9 +55,8 @@ void uiInit(ImmyConfig_t* config) {
     grayInvertEffectLocation = GetShaderLocation(grayscaleShader, "effects");
 #endif
 
-    dIntArrInit(&g_fontCodepoints, 128);
-
-    uiSetInitialCodePoints(CODEPOINT_INITIAL);
+    // glyphs are added as text is drawn
+    uiTextInit();
 
     g_pixelGridColor = PIXEL_GRID_COLOR_RGBA;
     g_uiReady        = 1;
@@ -78,9 +76,7 @@ void uiDeinit() {
 
     UnloadTexture(g_backgroundBuf);
 
-    UnloadFont(g_unifont);
-
-    dIntArrFree(&g_fontCodepoints);
+    uiTextDeinit();
 
 #if ENABLE_SHADERS
     UnloadShader(grayscaleShader);
@@ -91,94 +87,6 @@ void uiDeinit() {
     g_uiReady = false;
 }
 
-void uiLoadUnifont() {
-
-    L_D("Loading g_uifont from %s\n", UNIFONT_PATH);
-
-    size_t size;
-
-    unsigned char* data = get_resource_data(UNIFONT_PATH, &size);
-
-    if (!data) {
-
-        L_E("Cannot load g_uifont %s!", UNIFONT_PATH);
-
-        return;
-    }
-
-    UnloadFont(g_unifont);
-
-    g_unifont = LoadFontFromMemory(
-        GetFileExtension(UNIFONT_PATH), data, size, g_unifontSize,
-        g_fontCodepoints.buffer, g_fontCodepoints.size
-    );
-
-    /* force raygui font
-    GuiSetFont(g_unifont);
-    for(int i = 0; i < STATUSBAR; i++)
-        GuiSetStyle(i, TEXT_SIZE, g_unifontSize);
-        */
-
-    free_resource_data((void*)data);
-}
-
-void uiSetInitialCodePoints(const char* text) {
-
-    int  codep_count;
-    int* codep = LoadCodepoints(text, &codep_count);
-
-    for (int c = 0; c < codep_count; c++) {
-        dIntArrAppend(&g_fontCodepoints, codep[c]);
-    }
-
-    UnloadCodepoints(codep);
-    uiLoadUnifont();
-}
-
-void uiLoadCodepoints(const char* text, bool reload) {
-
-    L_D("Loading codepoints for text: %s", text);
-
-    int  codep_count;
-    int  BAD_C = GetGlyphIndex(g_unifont, '?');
-    int* codep = LoadCodepoints(text, &codep_count);
-
-    if (codep == NULL || codep_count == 0)
-        return;
-
-    for (int c = 0; c < codep_count; c++) {
-
-        int g = GetGlyphIndex(g_unifont, codep[c]);
-
-        if (g == BAD_C && codep[c] != '?') {
-
-            L_D("Adding new codepoint %d", codep[c]);
-
-            dIntArrAppend(&g_fontCodepoints, codep[c]);
-        }
-    }
-
-    UnloadCodepoints(codep);
-
-    if (reload) {
-        uiLoadUnifont();
-    }
-}
-
-void uiLoadCodepointsFromFileList(const ImmyControl_t* ctrl) {
-
-    DARRAY_FOR_EACH(ctrl->image_files, i) {
-
-        ImmyImage_t* im = ctrl->image_files.buffer + i;
-
-        uiLoadCodepoints(im->path, false);
-    }
-
-    uiLoadUnifont();
-}
-
-
-
 Texture2D uiLoadBackgroundTile(size_t w, size_t h, Color a, Color b) {
 
     Image image = GenImageColor(w, h, a);
@@ -5,6 +5,7 @@
 
 #include <raylib.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "../config.h"
 #include "../core/core.h"
@@ -12,7 +13,6 @@
 extern bool      g_uiReady;        // is the ui ready for drawing
 extern Font      g_unifont;        // global font for ui text
 extern int       g_unifontSize;    // font size
-extern dIntArr_t g_fontCodepoints; // codepoints for ui font
 
 extern Color     g_pixelGridColor; // the pixel grid color
 extern Texture2D g_backgroundBuf;  // the background texture
@@ -59,11 +59,37 @@ typedef struct DraggablePanel {
 */
 
 
+// a glyph of laid out text
+typedef struct TextQuad {
+        Rectangle src; // in the glyph atlas
+        Rectangle dst; // relative to the top left of the text
+} TextQuad_t;
+
+// text which has been measured and placed, cached by uiLayoutText
+typedef struct TextLayout {
+        char*       text;
+        float       requestedSize;
+        float       spacing;
+        float       maxWidth;  // the font size is shrunk to fit this, 0 to never shrink
+        float       fontSize;  // the font size after fitting
+        Vector2     size;      // size of the text at fontSize
+        int         quadCount;
+        TextQuad_t* quads;
+        uint64_t    atlasGen;  // glyph atlas the quads point into
+        uint64_t    lastUse;
+} TextLayout_t;
+
+// text functions
+bool          uiTextInit();                                                             // load the font, needs the window
+void          uiTextDeinit();                                                           // unload the font
+TextLayout_t* uiLayoutText(const char* text, float fontSize, float spacing, float maxWidth); // cached layout, NULL on failure
+void          uiDrawTextLayout(TextLayout_t* layout, Vector2 position, Color tint);     // draw a layout from uiLayoutText
+Vector2       uiMeasureTextEx(const char* text, float fontSize, float spacing);         // size of the text
+void          uiDrawTextEx(const char* text, Vector2 position, float fontSize, float spacing, Color tint); // draw text, new glyphs are rasterized
+
 // helper functions
 static inline void uiDrawTextAt(const char* str, float x, float y) {
-    return DrawTextEx(
-        g_unifont, str, (Vector2){x, y}, g_unifont.baseSize, 1, TEXT_COLOR_RGBA
-    );
+    return uiDrawTextEx(str, (Vector2){x, y}, g_unifont.baseSize, 1, TEXT_COLOR_RGBA);
 }
 
 static inline void uiDrawText(const char* str) {
@@ -81,12 +107,6 @@ static inline Color uiColorInvert(Color c) {
 void uiInit(ImmyConfig_t* ctrl); // init the ui
 void uiDeinit();                  // deinit the ui
 
-// font functions
-void uiLoadUnifont();                                          // unload and load unifont
-void uiSetInitialCodePoints(const char* text);                 // load these codepoints
-void uiLoadCodepoints(const char* text, bool reloadFont);      // load codepoints from
-void uiLoadCodepointsFromFileList(const ImmyControl_t* ctrl); // load codepoints from
-
 // background functions
 Texture2D uiLoadBackgroundTile(size_t w, size_t h, Color a, Color b); // get the background texture
 void      uiRenderBackground();                                       // render the background
@@ -118,6 +138,7 @@ void uiRenderThumbs(ImmyControl_t* ctrl); // render thumbnails
 
 // file list screen functions
 void uiRenderFileList(const ImmyControl_t* ctrl);
+void uiRenderSearchBar(const ImmyControl_t* ctrl); // the search prompt at the bottom of the screen
 
 // keybinds screen functions
 void uiRenderKeybinds(const ImmyControl_t* ctrl);
@@ -2,78 +2,94 @@
 #include "imylib2.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
-il2Loader loaders[] = {
+// Loaders in the order they are tried, the format is the imlib2 loader name.
+static const struct {
+        const char* format;
+        il2Loader   load;
+} loaders[] = {
 
 #ifdef BUILD_PNG_LOADER
-    il2LoadPNG,
+    {"png", il2LoadPNG},
 #endif
 
 #ifdef BUILD_JPEG_LOADER
-    il2LoadJPEG,
+    {"jpeg", il2LoadJPEG},
 #endif
 
-    il2LoadQOI,
+    {"qoi", il2LoadQOI},
 
 #ifdef BUILD_WEBP_LOADER
-    il2LoadWEBP,
+    {"webp", il2LoadWEBP},
 #endif
 
 #ifdef BUILD_GIF_LOADER
-    il2LoadGIF,
+    {"gif", il2LoadGIF},
 #endif
 
 #ifdef BUILD_JXL_LOADER
-    il2LoadJXL,
+    {"jxl", il2LoadJXL},
 #endif
 
-    il2LoadBMP,
+    {"bmp", il2LoadBMP},
 
 #ifdef BUILD_TIFF_LOADER
-    il2LoadTIFF,
+    {"tiff", il2LoadTIFF},
 #endif
 
 #ifdef BUILD_HEIF_LOADER
-    il2LoadHEIF,
+    {"heif", il2LoadHEIF},
 #endif
 
 #ifdef BUILD_SVG_LOADER
-    il2LoadSVG,
+    {"svg", il2LoadSVG},
 #endif
 
-    il2LoadANI,  il2LoadARGB, il2LoadFF, il2LoadICO, il2LoadLBM, il2LoadPNM, il2LoadTGA, il2LoadXBM, 
+    {"ani", il2LoadANI},
+    {"argb", il2LoadARGB},
+    {"ff", il2LoadFF},
+    {"ico", il2LoadICO},
+    {"lbm", il2LoadLBM},
+    {"pnm", il2LoadPNM},
+    {"tga", il2LoadTGA},
+    {"xbm", il2LoadXBM},
 
-    // il2LoadXPM,
+    // {"xpm", il2LoadXPM},
 
 #ifdef BUILD_BZ2_LOADER
-    il2LoadBZ2,
+    {"bz2", il2LoadBZ2},
 #endif
 
 #ifdef BUILD_ID3_LOADER
-    il2LoadID3,
+    {"id3", il2LoadID3},
 #endif
 
 #ifdef BUILD_J2K_LOADER
-    il2LoadJ2K,
+    {"j2k", il2LoadJ2K},
 #endif
 
 #ifdef BUILD_LZMA_LOADER
-    il2LoadLZMA,
+    {"lzma", il2LoadLZMA},
 #endif
 
 #ifdef BUILD_PS_LOADER
-    il2LoadPS,
+    {"ps", il2LoadPS},
 #endif
 
 #ifdef BUILD_RAW_LOADER
-    il2LoadRAW,
+    {"raw", il2LoadRAW},
 #endif
 
 };
 #define LOADER_LENGTH sizeof(loaders)/sizeof(loaders[0])
 
+// Allocates and frees the pixels of every image loaded, NULL for malloc and free.
+static ImlibImageDataMemoryFunction dataMemoryFunc = NULL;
+
 
 
 /* from imlib2-1.12.2/src/lib/file.c __imlib_FileOpen */
@@ -134,7 +150,9 @@ ImlibImageFrame * __imlib_GetFrame(ImlibImage *im_)
 }
 
 /* from /imlib2-1.12.2/src/lib/image.c __imlib_AllocateData */
-uint32_t* __imlib_AllocateData(ImlibImage* im) {
+uint32_t* __imlib_AllocateData(ImlibImage* im_) {
+
+    struct ImlibImage* im = (struct ImlibImage*)im_;
 
     int w = im->w;
     int h = im->h;
@@ -142,22 +160,45 @@ uint32_t* __imlib_AllocateData(ImlibImage* im) {
     if (w <= 0 || h <= 0)
         return NULL;
 
-    im->data = malloc(w * h * sizeof(uint32_t));
+    if (im->data_memory_func)
+        im->data = im->data_memory_func(NULL, (size_t)w * h * sizeof(uint32_t));
+    else
+        im->data = malloc((size_t)w * h * sizeof(uint32_t));
 
     return im->data;
 }
 
 /* from /imlib2-1.12.2/src/lib/image.c __imlib_FreeData */
-void __imlib_FreeData(ImlibImage* im) {
+void __imlib_FreeData(ImlibImage* im_) {
+
+    struct ImlibImage* im = (struct ImlibImage*)im_;
 
     if (!im->data)
         return;
 
-    free(im->data);
+    if (im->data_memory_func)
+        im->data_memory_func(im->data, (size_t)im->w * im->h * sizeof(uint32_t));
+    else
+        free(im->data);
 
     im->data = NULL;
 }
 
+void il2SetDataMemoryFunction(ImlibImageDataMemoryFunction func) {
+
+    dataMemoryFunc = func;
+}
+
+// Frees whatever a loader left in im and sets it back to how the next loader expects to find it.
+// A loader which fails part way can leave its size, pixels or frame info behind.
+static void il2ResetImage(struct ImlibImage* im, ImlibImageFileInfo* fi, int frame) {
+
+    __imlib_FreeData((ImlibImage*)im);
+    free(im->pframe);
+
+    *im = (struct ImlibImage){.fi = fi, .frame = frame, .data_memory_func = dataMemoryFunc};
+}
+
 /* from /imlib2-1.12.2/src/lib/image.c __imlib_LoadProgressSetPass */
 void __imlib_LoadProgressSetPass(ImlibImage* im, int pass, int n_pass) {
 
@@ -228,7 +269,7 @@ bool il2FileContextOpenEx(ImlibImageFileInfo* fi, FILE* fp, const void* fdata, o
     } else {
         fi->fp = __imlib_FileOpen(fi->name, "rb", &st);
         if (!fi->fp)
-            return -1;
+            return false;
         fsize = st.st_size;
     }
 
@@ -272,35 +313,50 @@ int il2DefaultProgress(ImlibImage* im, char percent, int update_x, int update_y,
 
 bool il2LoadImageAsRGBA(const char* path, struct ImlibImage* image) {
 
-    bool r = il2LoadImageAsBGRA(path, image);
+    return il2LoadImageAsRGBAEx(path, image, NULL, NULL);
+}
+
+bool il2LoadImageAsRGBAEx(const char* path, struct ImlibImage* image, il2ProgressFunction progress, void* data) {
+
+    bool r = il2LoadImageAsBGRAEx(path, image, progress, data);
+
+    // is stored as 0xAARRGGBB
+    if (r)
+        il2SwapRedBlue(image->data, image->data, (size_t)image->w * image->h);
 
-    if (r) {
+    return r;
+}
 
-        uint32_t* cp = image->data;
+bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image) {
 
-        size_t f = image->w * image->h;
+    return il2LoadImageAsBGRAEx(path, image, NULL, NULL);
+}
 
-        for (size_t i = 0; i < f; i++) {
+// An image being loaded with a progress function, the loaders only see im.
+typedef struct {
+        struct ImlibImage   im; // must be first, the loader context hands back a pointer to it
+        ImlibLoaderCtx      lc;
+        il2ProgressFunction progress;
+        void*               data;
+} il2ProgressImage;
 
-            // is stored as 0xAABBGGRR
-            uint32_t bgra = cp[i];
+static int il2ProgressRows(ImlibImage* im_, char percent, int update_x, int update_y, int update_w, int update_h) {
 
-            cp[i] = ((bgra & 0xff00ff00)) |       // 0xAA__GG__ keep
-                    ((bgra & 0x000000ff) << 16) | // 0x______RR << 16
-                    ((bgra & 0x00ff0000) >> 16);  // 0x__BB____ >> 16
-        }
-    }
+    il2ProgressImage* p = (il2ProgressImage*)im_;
 
-    return r;
+    // the loader stops when this returns 0
+    return p->progress(p->data, p->im.data, p->im.w, p->im.h, update_y, update_h, p->lc.pass);
 }
 
-bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image) {
+bool il2LoadImageAsBGRAEx(const char* path, struct ImlibImage* image, il2ProgressFunction progress, void* data) {
 
-    ImlibLoadArgs      ila = {.pgran = 100, .immed = 1, .nocache = 1};
+    ImlibLoadArgs      ila = {.pgran = IL2_PROGRESS_STEP, .immed = 1, .nocache = 1};
     ImlibImageFileInfo fi  = {.name = (char*)path};
-    struct ImlibImage  im  = {.fi = &fi};
+    il2ProgressImage   p   = {.progress = progress, .data = data};
+
+    il2ResetImage(&p.im, &fi, 0);
 
-    if(!il2FileContextOpen(im.fi)) {
+    if(!il2FileContextOpen(p.im.fi)) {
         printf("Could not open file context\n");
         return false;
     }
@@ -309,7 +365,16 @@ bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image) {
 
     for(int i = 0; i < LOADER_LENGTH; ++i) {
 
-        ImlibLoadStatus_t ls = loaders[i](&im, ila.immed);
+        il2ResetImage(&p.im, &fi, 0);
+
+        // every loader starts counting rows from the top
+        if (progress != NULL) {
+
+            p.lc   = (ImlibLoaderCtx){.progress = il2ProgressRows, .granularity = ila.pgran, .n_pass = 1};
+            p.im.lc = &p.lc;
+        }
+
+        ImlibLoadStatus_t ls = loaders[i].load(&p.im, ila.immed);
 
         switch (ls) {
 
@@ -338,13 +403,19 @@ bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image) {
         }
     }
 
-    il2FileContextClose(im.fi);
+    il2FileContextClose(p.im.fi);
 
     if(rCode) {
 
-        im.fi = NULL;
+        p.im.fi = NULL;
+        p.im.lc = NULL;
 
-        *image = im;
+        *image = p.im;
+
+    } else {
+
+        // a break keeps the rows decoded before it
+        il2ResetImage(&p.im, &fi, 0);
     }
 
     return rCode;
@@ -353,3 +424,207 @@ bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image) {
 
 
 
+bool il2Probe(const char* path, ImlibImageInfo* info) {
+
+    ImlibImageFileInfo fi = {.name = (char*)path};
+
+    struct ImlibImage  im = {0};
+
+    *info = (ImlibImageInfo){0};
+
+    // the whole file is mapped, but only the pages the header parser touches are read
+    if (!il2FileContextOpen(&fi)) {
+
+        il2FileContextClose(&fi);
+
+        return false;
+    }
+
+    for (int i = 0; i < LOADER_LENGTH; ++i) {
+
+        // frame 1 so animated loaders report their frame count, every image has a first frame
+        il2ResetImage(&im, &fi, 1);
+
+        ImlibLoadStatus_t ls = loaders[i].load(&im, 0);
+
+        // a loader which does not do frames, ask it again for the plain image
+        if (ls == IMLIB_STATUS_LOAD_BADFRAME) {
+
+            il2ResetImage(&im, &fi, 0);
+
+            ls = loaders[i].load(&im, 0);
+        }
+
+        if (ls != IMLIB_STATUS_LOAD_SUCCESS)
+            continue;
+
+        info->w         = im.w;
+        info->h         = im.h;
+        info->has_alpha = im.has_alpha;
+        info->frames    = im.pframe && im.pframe->frame_count > 0 ? im.pframe->frame_count : 1;
+        info->format    = loaders[i].format;
+
+        break;
+    }
+
+    il2FileContextClose(&fi);
+
+    // loaders should not decode without load_data, but some allocate before checking
+    il2ResetImage(&im, NULL, 0);
+
+    return info->format != NULL;
+}
+
+bool il2OpenAnimation(const char* path, il2Animation* anim) {
+
+    *anim = (il2Animation){.fi = {.name = (char*)path}};
+
+    struct ImlibImage im = {0};
+
+    if (!il2FileContextOpen(&anim->fi)) {
+
+        il2FileContextClose(&anim->fi);
+
+        return false;
+    }
+
+    for (int i = 0; i < LOADER_LENGTH; ++i) {
+
+        il2ResetImage(&im, &anim->fi, 1);
+
+        ImlibLoadStatus_t ls = loaders[i].load(&im, 0);
+
+        // knows the file but not frames, it is not animated
+        if (ls == IMLIB_STATUS_LOAD_BADFRAME)
+            break;
+
+        if (ls != IMLIB_STATUS_LOAD_SUCCESS)
+            continue;
+
+        if (im.pframe && im.pframe->frame_count > 1) {
+
+            anim->load     = loaders[i].load;
+            anim->format   = loaders[i].format;
+            anim->frames   = im.pframe->frame_count;
+            anim->loops    = im.pframe->loop_count;
+            anim->canvas_w = im.pframe->canvas_w > 0 ? im.pframe->canvas_w : im.w;
+            anim->canvas_h = im.pframe->canvas_h > 0 ? im.pframe->canvas_h : im.h;
+        }
+
+        break;
+    }
+
+    il2ResetImage(&im, NULL, 0);
+
+    if (anim->load == NULL) {
+
+        il2FileContextClose(&anim->fi);
+
+        return false;
+    }
+
+    return true;
+}
+
+bool il2LoadFrame(il2Animation* anim, int frame, il2Frame* out) {
+
+    struct ImlibImage im = {.fi = &anim->fi, .frame = frame, .data_memory_func = dataMemoryFunc};
+
+    *out = (il2Frame){0};
+
+    ImlibLoadStatus_t ls = anim->load(&im, 1);
+
+    // the caller only needs to know the frame could not be read
+    if (ls != IMLIB_STATUS_LOAD_SUCCESS || im.data == NULL) {
+
+        __imlib_FreeData((ImlibImage*)&im);
+        free(im.pframe);
+
+        return false;
+    }
+
+    out->data      = im.data;
+    out->w         = im.w;
+    out->h         = im.h;
+    out->has_alpha = im.has_alpha;
+
+    if (im.pframe) {
+
+        out->x     = im.pframe->frame_x;
+        out->y     = im.pframe->frame_y;
+        out->delay = im.pframe->frame_delay;
+        out->flags = im.pframe->frame_flags;
+
+        free(im.pframe);
+    }
+
+    return true;
+}
+
+void il2FreeFrame(il2Frame* frame) {
+
+    struct ImlibImage im = {.w = frame->w, .h = frame->h, .data = frame->data, .data_memory_func = dataMemoryFunc};
+
+    __imlib_FreeData((ImlibImage*)&im);
+
+    frame->data = NULL;
+}
+
+void il2CloseAnimation(il2Animation* anim) {
+
+    il2FileContextClose(&anim->fi);
+
+    anim->load = NULL;
+}
+
+typedef struct {
+        const char* const* paths;
+        ImlibImageInfo*    infos;
+        size_t             count;
+        atomic_size_t      next;
+        atomic_size_t      found;
+} il2ProbeBatchArgs;
+
+// Files are handed out one at a time, a slow file on a network mount does not hold up a whole chunk.
+static void* il2ProbeBatchMain(void* raw_arg) {
+
+    il2ProbeBatchArgs* args = raw_arg;
+
+    for (size_t i; (i = atomic_fetch_add(&args->next, 1)) < args->count;) {
+
+        if (il2Probe(args->paths[i], args->infos + i))
+            atomic_fetch_add(&args->found, 1);
+    }
+
+    return NULL;
+}
+
+size_t il2ProbeBatch(const char* const* paths, size_t count, ImlibImageInfo* infos, int threads) {
+
+    il2ProbeBatchArgs args = {.paths = paths, .infos = infos, .count = count};
+
+    if (threads < 1)
+        threads = 1;
+
+    if ((size_t)threads > count)
+        threads = count;
+
+    pthread_t workers[IL2_PROBE_MAX_THREADS];
+    int       started = 0;
+
+    // the calling thread works too
+    while (started < threads - 1 && started < IL2_PROBE_MAX_THREADS) {
+
+        if (pthread_create(workers + started, NULL, il2ProbeBatchMain, &args) != 0)
+            break;
+
+        started++;
+    }
+
+    il2ProbeBatchMain(&args);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    return atomic_load(&args.found);
+}
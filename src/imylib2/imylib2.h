@@ -93,6 +93,45 @@ typedef enum {
 
 typedef ImlibLoadStatus_t (*il2Loader)(struct ImlibImage *im, int load_data);
 
+// What il2Probe reads from the header of an image.
+typedef struct {
+        int         w, h;
+        bool        has_alpha;
+        int         frames; // 1 unless the loader reports more
+        const char* format; // name of the loader which read it, NULL if none could
+} ImlibImageInfo;
+
+// An animated image opened by il2OpenAnimation, the file stays mapped until il2CloseAnimation.
+typedef struct {
+        ImlibImageFileInfo fi;
+        il2Loader          load;
+        const char*        format;
+        int                frames;             // always more than 1
+        int                loops;              // 0 means forever
+        int                canvas_w, canvas_h; // the frames are drawn onto this
+} il2Animation;
+
+// One frame of an animation, it covers w x h of the canvas at x, y.
+typedef struct {
+        uint32_t* data; // BGRA, freed with il2FreeFrame
+        int       w, h;
+        int       x, y;
+        int       delay; // milliseconds, 0 if the file does not say
+        int       flags; // FF_FRAME_BLEND, FF_FRAME_DISPOSE_CLEAR or FF_FRAME_DISPOSE_PREV
+        bool      has_alpha;
+} il2Frame;
+
+// Called on the loading thread as rows of an image are decoded, y and rows give the rows which are done.
+// pixels is the whole BGRA image being written, w x h. Interlaced images go over it in more than one pass.
+// Return false to stop loading.
+typedef bool (*il2ProgressFunction)(void* data, const uint32_t* pixels, int w, int h, int y, int rows, int pass);
+
+// Percent of an image decoded between calls to the progress function.
+#define IL2_PROGRESS_STEP 2
+
+// The most threads il2ProbeBatch starts.
+#define IL2_PROBE_MAX_THREADS 64
+
 
 int il2DefaultProgress(ImlibImage * im, char percent, int update_x, int update_y, int update_w, int update_h);
 
@@ -100,9 +139,45 @@ bool il2FileContextOpen(ImlibImageFileInfo* fi);
 bool il2FileContextOpenEx(ImlibImageFileInfo* fi, FILE* fp, const void* fdata, off_t fsize);
 void il2FileContextClose(ImlibImageFileInfo* fi);
 
+// Sets the imlib2 memory hook used for the pixels of every image loaded after this.
+// It is called with NULL and a size to allocate, and with the pixels and their size to free them.
+// The pixels il2LoadImageAsBGRA returns must be freed with it, NULL means malloc and free.
+void il2SetDataMemoryFunction(ImlibImageDataMemoryFunction func);
+
 bool il2LoadImageAsBGRA(const char* path, struct ImlibImage* image);
 bool il2LoadImageAsRGBA(const char* path, struct ImlibImage* image);
 
+// Loads like the above, calling progress with data as the rows are decoded.
+// Only loaders which report their rows call it, the pixels are BGRA until the load is done.
+bool il2LoadImageAsBGRAEx(const char* path, struct ImlibImage* image, il2ProgressFunction progress, void* data);
+bool il2LoadImageAsRGBAEx(const char* path, struct ImlibImage* image, il2ProgressFunction progress, void* data);
+
+// Swaps the red and blue channels of count pixels, BGRA to RGBA or back.
+// Works in place when dst == src, picks the widest SIMD the cpu has on the first call.
+void il2SwapRedBlue(uint32_t* dst, const uint32_t* src, size_t count);
+
+// Reads the size, alpha and frame count of an image without decoding the pixels.
+// Thread-safe, returns false if no loader knows the file.
+bool il2Probe(const char* path, ImlibImageInfo* info);
+
+// Probes every path on up to threads threads, including the calling thread.
+// Returns the number of files a loader knew, infos[i].format is NULL for the rest.
+size_t il2ProbeBatch(const char* const* paths, size_t count, ImlibImageInfo* infos, int threads);
+
+// Opens an image for decoding one frame at a time, path must live until il2CloseAnimation.
+// Returns false if no loader knows the file or it has only one frame.
+bool il2OpenAnimation(const char* path, il2Animation* anim);
+
+// Decodes frame, counting from 1, of an open animation. Only the frame itself is decoded,
+// blending it onto the canvas is left to the caller. Returns false if the frame cannot be read.
+bool il2LoadFrame(il2Animation* anim, int frame, il2Frame* out);
+
+// Frees the pixels of a frame from il2LoadFrame.
+void il2FreeFrame(il2Frame* frame);
+
+// Unmaps the file of an animation.
+void il2CloseAnimation(il2Animation* anim);
+
 ImlibLoadStatus_t il2LoadQOI(struct ImlibImage *im, int load_data);
 ImlibLoadStatus_t il2LoadBMP(struct ImlibImage *im, int load_data);
 ImlibLoadStatus_t il2LoadANI(struct ImlibImage *im, int load_data);
@@ -0,0 +1,124 @@
+
+#include "imylib2.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define IL2_X86
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#    define IL2_NEON
+#endif
+
+typedef void (*il2SwapFunc)(uint32_t* dst, const uint32_t* src, size_t count);
+
+static il2SwapFunc    swapRedBlue;
+static pthread_once_t swapRedBlueOnce = PTHREAD_ONCE_INIT;
+
+// 0xAABBGGRR <-> 0xAARRGGBB, in place when dst == src so nothing here is restrict.
+static void swap_red_blue_scalar(uint32_t* dst, const uint32_t* src, size_t count) {
+
+    for (size_t i = 0; i < count; i++) {
+
+        uint32_t p = src[i];
+
+        dst[i] = (p & 0xff00ff00) | ((p & 0x000000ff) << 16) | ((p & 0x00ff0000) >> 16);
+    }
+}
+
+#ifdef IL2_X86
+
+// SSE2 has no byte shuffle, the same masks and shifts as the scalar code 4 pixels at a time.
+__attribute__((target("sse2"))) static void swap_red_blue_sse2(uint32_t* dst, const uint32_t* src, size_t count) {
+
+    const __m128i ag = _mm_set1_epi32(0xff00ff00);
+    const __m128i rb = _mm_set1_epi32(0x00ff00ff);
+
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i c = _mm_and_si128(p, rb);
+
+        c = _mm_or_si128(_mm_slli_epi32(c, 16), _mm_srli_epi32(c, 16));
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(p, ag), c));
+    }
+
+    swap_red_blue_scalar(dst + i, src + i, count - i);
+}
+
+// 16 pixels per iteration with one byte shuffle per 8.
+__attribute__((target("avx2"))) static void swap_red_blue_avx2(uint32_t* dst, const uint32_t* src, size_t count) {
+
+    const __m256i order = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+    );
+
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, order));
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_shuffle_epi8(b, order));
+    }
+
+    swap_red_blue_sse2(dst + i, src + i, count - i);
+}
+
+#endif
+
+#ifdef IL2_NEON
+
+// De-interleaves 16 pixels into planes, so the swap is just storing the planes in another order.
+static void swap_red_blue_neon(uint32_t* dst, const uint32_t* src, size_t count) {
+
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+
+        uint8x16x4_t p = vld4q_u8((const uint8_t*)(src + i));
+        uint8x16_t   t = p.val[0];
+
+        p.val[0] = p.val[2];
+        p.val[2] = t;
+
+        vst4q_u8((uint8_t*)(dst + i), p);
+    }
+
+    swap_red_blue_scalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+static void pick_swap_red_blue() {
+
+    swapRedBlue = swap_red_blue_scalar;
+
+#if defined(IL2_X86)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        swapRedBlue = swap_red_blue_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        swapRedBlue = swap_red_blue_sse2;
+
+#elif defined(IL2_NEON)
+
+    swapRedBlue = swap_red_blue_neon;
+
+#endif
+}
+
+void il2SwapRedBlue(uint32_t* dst, const uint32_t* src, size_t count) {
+
+    pthread_once(&swapRedBlueOnce, pick_swap_red_blue);
+
+    swapRedBlue(dst, src, count);
+}